@@ -17,7 +17,8 @@ extern "C" {
 
 /**
  * @brief 库调试追踪开关
- * @note 库内所有的打印都是基于用户的 print() 接口
+ * @note 文本模式下库内所有的打印都是基于用户的 print() 接口；二进制模式下错误、警告、信息、调试记录只写入内存中的环形缓冲区，
+ *       库信息（卡识别结果等）仍通过 print() 打印。可通过 sd_trace_set_level() 在运行时降低记录等级。
  */
 #define SD_SPI_TRACE_LEVEL_NONE     0       // 关闭任何打印内容
 #define SD_SPI_TRACE_LEVEL_LIB      1       // 库信息，打印如卡识别结果、版本号等
@@ -27,6 +28,161 @@ extern "C" {
 #define SD_SPI_TRACE_LEVEL_DEBUG    5       // 调试
 #define SD_SPI_TRACE_LEVEL          SD_SPI_TRACE_LEVEL_DEBUG
 #define SD_SPI_TRACE_ENABLE         1       // 打印追踪开关
+#define SD_SPI_TRACE_MODE_TEXT      0       // 文本模式：带文件名、行号、颜色同步调用 print()
+#define SD_SPI_TRACE_MODE_BINARY    1       // 二进制模式：只记录时间戳、事件号和至多 4 个整数参数，格式字符串由主机端工具 tools/sd_trace_decode.py 还原
+#define SD_SPI_TRACE_MODE           SD_SPI_TRACE_MODE_TEXT
+#define SD_SPI_TRACE_RING_SIZE      64      // 二进制模式环形缓冲区的记录条数（2 的幂），每条 28 字节
+
+
+/**
+ * @brief 读写传输配置
+ */
+#define SD_SPI_MULTI_BLOCK_ENABLE   1           // 多块传输开关，开启后多块读写使用 CMD18/CMD25，关闭则逐块使用 CMD17/CMD24
+#define SD_SPI_READ_TIMEOUT_US      100000      // 等待数据令牌的超时时间，规范规定 SDHC/SDXC 读访问时间不超过 100ms
+#define SD_SPI_WRITE_TIMEOUT_US     500000      // 等待写入编程完成的超时时间，规范规定 SDXC 写忙时间不超过 500ms
+#define SD_SPI_WRITE_DEFAULT_OPTS   SD_WR_OPT_NONE  // sd_card_write() 使用的写入选项，见 sd_def.h 中的 SD_WR_OPT_XXX
+#define SD_SPI_BUSY_TIMEOUT_US      500000      // 等待卡退出忙状态的超时时间（如 CMD12 等 R1b 响应）
+#define SD_SPI_ERASE_TIMEOUT_US     30000000    // 等待擦除完成的超时时间
+#define SD_SPI_POLL_FAST_COUNT      64          // 轮询令牌/忙状态时，进入延时轮询前连续查询的字节数
+#define SD_SPI_POLL_INTERVAL_US     100         // 延时轮询的间隔，单位：微秒
+#define SD_SPI_BOUNCE_BUF_SIZE      512         // 非对齐读写（sd_card_pread/sd_card_pwrite）共用的中转缓冲区大小，不能小于卡的块大小
+
+
+/**
+ * @brief 初始化配置
+ * @note ACMD41 按实际时间（未实现 now_us() 时按累计延时估算）限时，轮询间隔从 SD_SPI_INIT_POLL_MIN_US 开始每次翻倍，
+ *       既能尽快发现很快完成初始化的卡，又不会在慢卡上频繁占用总线。各阶段耗时可通过 sd_card_get_init_timing() 获取。
+ */
+#define SD_SPI_INIT_TIMEOUT_US      1000000     // 从开始初始化到 ACMD41 完成的时间预算，规范规定 ACMD41 初始化不超过 1s
+#define SD_SPI_INIT_CMD0_ATTEMPTS   8           // CMD0 的最多发送次数，卡未响应或未进入空闲状态时重发
+#define SD_SPI_INIT_CMD0_RESP_BYTES 16          // 每次发送 CMD0 后等待响应的最多字节数，规范规定 NCR 不超过 8 字节
+#define SD_SPI_INIT_POLL_MIN_US     100         // CMD0 重发与 ACMD41 轮询的初始间隔，单位：微秒
+#define SD_SPI_INIT_POLL_MAX_US     2000        // CMD0 重发与 ACMD41 轮询间隔的上限，单位：微秒
+#define SD_SPI_INIT_EARLY_CLOCK     1           // ACMD41 完成后立即切换到默认速度模式的时钟（不超过 25MHz），读取 OCR/CSD 不再使用识别阶段的低速时钟
+
+
+/**
+ * @brief 批量传输配置
+ * @note 减少每条命令调用端口 transfer() 的次数：命令帧与响应窗口在同一次调用中收发，等待响应、令牌和忙状态时分块读取并在块内查找。
+ *       多读出的字节暂存在卡对象中，由之后的读取优先取用。SD_SPI_XFER_RESP_WINDOW 为 0 且 SD_SPI_XFER_SCAN_CHUNK 为 1 时与逐字节收发相同。
+ */
+#define SD_SPI_XFER_RESP_WINDOW     8           // 发送命令帧的同一次调用中读取的响应字节数，规范规定 NCR 不超过 8 字节，0 表示命令帧后单独轮询响应
+#define SD_SPI_XFER_SCAN_CHUNK      8           // 轮询响应、令牌和忙状态时每次读取的字节数（1~255），越大调用次数越少，但每次多占用的总线时间越长
+
+
+/**
+ * @brief 卡统计信息配置
+ * @note 开启后每张卡在 struct sd_card 中记录命令、轮询、忙等待、传输字节数和错误的计数，通过 sd_card_get_stats() 获取。
+ */
+#define SD_SPI_STATS_ENABLE         0           // 卡统计信息开关
+
+
+/**
+ * @brief 延迟直方图配置
+ * @note 开启后每张卡按操作类型记录耗时的对数分桶直方图，通过 sd_card_get_latency() 获取 p50/p99/最大值（需要实现 now_us()）。
+ */
+#define SD_SPI_LATENCY_ENABLE       0           // 延迟直方图开关
+
+
+/**
+ * @brief 片上基准测试配置
+ * @note 开启后可调用 sd_card_bench() 在卡的一段临时区域上测试顺序/随机读写、写入延迟分布和擦除耗时，结果通过调试接口打印（需要实现 now_us()）。
+ *       测试缓冲区占用 SD_SPI_BENCH_MAX_BLOCKS 个 512 字节块的静态内存。
+ */
+#define SD_SPI_BENCH_ENABLE         0           // 片上基准测试开关
+#define SD_SPI_BENCH_MAX_BLOCKS     16          // 最大请求的块数（不小于 8），即大块顺序读写每次的块数
+
+
+/**
+ * @brief 总线抓取配置
+ * @note 开启后可调用 sd_capture_start() 包装一张卡的 SPI 接口，将每次端口调用的时间戳、方向和数据记录到内存中的二进制日志，
+ *       由 sd_capture_read() 读出（可边抓取边导出），再由 tools/sd_capture_decode.py 还原为命令级的时间线。
+ */
+#define SD_SPI_CAPTURE_ENABLE       0           // 总线抓取开关
+#define SD_SPI_CAPTURE_BUF_SIZE     8192        // 日志缓冲区大小（字节，2 的幂），满时丢弃新的记录
+#define SD_SPI_CAPTURE_MAX_PAYLOAD  16          // 每次调用每个方向最多记录的数据字节数，0 表示全部记录；不应小于 SD_SPI_XFER_RESP_WINDOW + 6
+
+
+/**
+ * @brief CRC 校验配置
+ * @note 开启后，卡初始化完成时通过 CMD59 打开卡的 CRC 校验（命令帧始终携带真实的 CRC7），接收的数据块校验 CRC16，
+ *       写入的数据块发送真实的 CRC16。出现 CRC 错误时只重新传输出错的块。
+ */
+#define SD_SPI_CRC16_BITWISE        0           // 逐位计算，不占用常量表，最慢
+#define SD_SPI_CRC16_TABLE          1           // 单字节查表，占用 512 B 常量表
+#define SD_SPI_CRC16_SLICE4         2           // slice-by-4，每次处理 4 字节，占用 2 KB 常量表
+#define SD_SPI_CRC16_SLICE8         3           // slice-by-8，每次处理 8 字节，占用 4 KB 常量表
+#define SD_SPI_CRC_ENABLE           0           // CRC 校验开关
+#define SD_SPI_CRC16_KERNEL         SD_SPI_CRC16_TABLE  // CRC16 的计算方式，可通过 sd_crc16_bench() 选择满足总线速率且开销最小的方式
+#define SD_SPI_CRC_RETRY            3           // 同一个块连续出现 CRC 错误时的最大重传次数
+#define SD_SPI_CRC_BENCH_ENABLE     0           // CRC16 微基准测试开关，开启后编译所有计算方式及其常量表，供 sd_crc16_bench() 比较
+
+
+/**
+ * @brief SPI 时钟配置
+ * @note 端口实现 set_clock() 时按频率设置时钟：识别阶段使用 SD_SPI_CLOCK_INIT_HZ，之后使用 CSD 中 TRAN_SPEED 与 SD_SPI_CLOCK_MAX_HZ
+ *       中的较小者；未实现时仍通过 control() 切换低速/高速，以下其余配置均不生效。训练和运行时降速每次将时钟降为当前的 3/4，
+ *       最低降至 SD_SPI_CLOCK_INIT_HZ。
+ */
+#define SD_SPI_CLOCK_INIT_HZ            400000      // 识别阶段的时钟（Hz），规范要求不超过 400kHz
+#define SD_SPI_CLOCK_MAX_HZ             25000000    // 时钟上限（Hz），受 SPI 外设和板级走线限制
+#define SD_SPI_CLOCK_TRAIN_ENABLE       0           // 时钟训练开关，开启后初始化时从最高时钟开始反复读取训练块，出错则降低时钟，占用 2 倍 SD_SPI_CLOCK_TRAIN_BUF_SIZE 的静态内存
+#define SD_SPI_CLOCK_TRAIN_BLOCK        0           // 训练块号，训练只读取该块，不写入
+#define SD_SPI_CLOCK_TRAIN_ROUNDS       8           // 每个时钟下读取训练块的次数，全部与低速读取的数据一致且没有 CRC 错误才认为该时钟可靠
+#define SD_SPI_CLOCK_TRAIN_BUF_SIZE     512         // 训练缓冲区大小，块大小超过该值的卡不进行训练
+#define SD_SPI_CLOCK_FALLBACK_ERRORS    4           // 运行时降速阈值：统计窗口内 CRC 错误达到该次数时降低时钟，0 表示关闭（需要开启 CRC 校验）
+#define SD_SPI_CLOCK_FALLBACK_WINDOW    1024        // 运行时降速的统计窗口（块），传输的块数达到该值后重新统计
+
+
+/**
+ * @brief 高速模式配置
+ * @note 默认速度模式下卡的 TRAN_SPEED 为 25MHz。开启后初始化时通过 CMD6 查询功能组 1 是否支持高速模式，支持则切换，
+ *       TRAN_SPEED 提高到 50MHz。需要端口实现 set_clock() 并将 SD_SPI_CLOCK_MAX_HZ 提高到 25MHz 以上才能用上更高的时钟。
+ */
+#define SD_SPI_HIGH_SPEED_ENABLE        0           // 高速模式开关，卡不支持（如 v1.00 卡）或切换失败时保持默认速度
+
+
+/**
+ * @brief 异步请求配置
+ * @note 异步接口（sd_card_submit/sd_card_poll）需要用户实现 struct sd_spi_interface 中的 now_us()
+ */
+#define SD_SPI_ASYNC_SLICE_US       500         // sd_card_poll() 单次调用的时间片，用完后在当前步骤结束时返回，0 表示每次只执行一个步骤
+#define SD_SPI_ASYNC_CHUNK_SIZE     128         // 数据阶段每个步骤收发的字节数，必须能整除块大小
+
+
+/**
+ * @brief 块缓存配置
+ * @note 块缓存为所有卡共用的组相联写回缓存，占用约 SD_SPI_CACHE_SETS * SD_SPI_CACHE_WAYS 个缓存行大小的静态内存。
+ *       开启后写入的数据可能暂存在缓存中，需要调用 sd_card_sync() 写回卡（如 FATFS 的 CTRL_SYNC）。
+ */
+#define SD_SPI_CACHE_ENABLE             0       // 块缓存开关
+#define SD_SPI_CACHE_BLOCK_SIZE         512     // 缓存行大小，块大小与之不同的卡不使用缓存
+#define SD_SPI_CACHE_SETS               8       // 组数，块号对组数取余决定所在的组
+#define SD_SPI_CACHE_WAYS               2       // 每组的缓存行数，组内按 LRU 替换
+#define SD_SPI_CACHE_MAX_XFER_BLOCKS    2       // 块数不超过该值的读写经过缓存，更大的读写直接访问卡（仍与缓存保持一致）
+
+
+/**
+ * @brief 顺序预读配置
+ * @note 检测到连续的顺序读取后，用一次多块读取预先读入后续的块，之后的读取直接从预读缓冲区返回。
+ *       预读缓冲区为所有卡共用，占用 SD_SPI_RAHEAD_MAX_BLOCKS 个块大小的静态内存。
+ */
+#define SD_SPI_RAHEAD_ENABLE            0       // 顺序预读开关
+#define SD_SPI_RAHEAD_BLOCK_SIZE        512     // 预读缓冲区的块大小，块大小与之不同的卡不使用预读
+#define SD_SPI_RAHEAD_MIN_BLOCKS        2       // 预读窗口的初始块数
+#define SD_SPI_RAHEAD_MAX_BLOCKS        16      // 预读窗口的最大块数（同时也是预读缓冲区的块数），顺序读取持续时窗口每次翻倍直至该值
+#define SD_SPI_RAHEAD_TRIGGER           2       // 连续多少次顺序读取后开始预读，访问变为随机时立即停止预读并将窗口恢复为初始值
+
+
+/**
+ * @brief 写合并配置
+ * @note 将块号连续的多次写入收集在写合并缓冲区中，合并为一次多块写入。缓冲区为所有卡共用，占用 SD_SPI_WCOMB_MAX_BLOCKS
+ *       个块大小的静态内存。开启后写入的数据可能暂存在缓冲区中，需要调用 sd_card_sync() 写回卡（如 FATFS 的 CTRL_SYNC）。
+ */
+#define SD_SPI_WCOMB_ENABLE             0       // 写合并开关
+#define SD_SPI_WCOMB_BLOCK_SIZE         512     // 写合并缓冲区的块大小，块大小与之不同的卡不使用写合并
+#define SD_SPI_WCOMB_MAX_BLOCKS         8       // 写合并缓冲区的块数，收集满后立即写回，块数不小于该值的写入直接写卡
+#define SD_SPI_WCOMB_MAX_AGE_US         50000   // 缓冲区中最早的数据超过该时间后，在下一次读写时写回，0 表示不限制（需要实现 now_us()）
 
 
 /**
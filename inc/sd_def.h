@@ -60,6 +60,9 @@ enum sd_error
     Sd_Err_Param,           // 无效参数
     Sd_Err_No_Ready,        // 卡未就绪
     Sd_Err_Response,        // 不正常的响应
+    Sd_Err_Crc,             // CRC 校验错误
+
+    Sd_Err_Num,             // 错误码的数量（不是错误码）
 };
 
 /**
@@ -85,6 +88,7 @@ enum sd_cmd_index
     Sd_Cmd0_Idle                = CMD_ADD_FLAG(0),      // 复位卡，响应 R1
 
     // Sd_Cmd1_Op_Cond             = CMD_ADD_FLAG(1),      // 仅MMC使用
+    Sd_Cmd6_Switch_Func         = CMD_ADD_FLAG(6),      // 查询/切换卡功能（如高速模式），响应 R1 + 64字节数据块
     Sd_Cmd8_If_Cond             = CMD_ADD_FLAG(8),      // 检查SD电压范围，响应 R7
     Sd_Cmd9_Csd                 = CMD_ADD_FLAG(9),      // 读取CSD寄存器，响应 R1
     Sd_Cmd10_Cid                = CMD_ADD_FLAG(10),     // 读取CID寄存器，响应 R1
@@ -108,13 +112,39 @@ enum sd_cmd_index
     /** 其他 **/
     Sd_Cmd55_App_Cmd            = CMD_ADD_FLAG(55),     // 应用命令前缀，响应 R1
     Sd_Cmd58_Rd_Ocr             = CMD_ADD_FLAG(58),     // 读取OCR寄存器，响应 R3
+    Sd_Cmd59_Crc_On_Off         = CMD_ADD_FLAG(59),     // 打开/关闭CRC校验，响应 R1
 
     /** 应用命令 (需要先发送CMD55) **/
+    Sd_Acmd22_Num_Wr_Blocks     = CMD_ADD_FLAG(22),     // 读取最近一次写操作正确写入的块数，响应 R1 + 4字节数据块
+    Sd_Acmd23_Set_Wr_Blk_Erase  = CMD_ADD_FLAG(23),     // 设置多块写入前的预擦除块数，响应 R1
     Sd_Acmd41_Op_Cond           = CMD_ADD_FLAG(41),     // 开始SD卡初始化和检查SD卡是否初始化完成，响应 R1
 
 #undef CMD_ADD_FLAG
 };
 
+/**
+ * @brief 命令帧最后一个字节（CRC7 + 结束位）
+ * @note 参数固定的命令使用预先计算好的值，免去发送时的计算；参数可变的命令使用 SD_CMD_CRC_AUTO，由驱动查表计算。
+ *       有效的 CRC 字节结束位为 1，因此 0x00 不会与任何预计算值冲突。
+ */
+#define SD_CMD_CRC_AUTO                 (0x00)      // 发送时根据命令与参数计算
+#define SD_CMD_CRC_CMD0                 (0x95)      // CMD0,  arg = 0
+#define SD_CMD_CRC_CMD6_CHECK_HS        (0x1F)      // CMD6,  arg = 0x00FFFFF1
+#define SD_CMD_CRC_CMD6_SWITCH_HS       (0x29)      // CMD6,  arg = 0x80FFFFF1
+#define SD_CMD_CRC_CMD8_1AA             (0x87)      // CMD8,  arg = 0x1AA
+#define SD_CMD_CRC_CMD9                 (0xAF)      // CMD9,  arg = 0
+#define SD_CMD_CRC_CMD10                (0x1B)      // CMD10, arg = 0
+#define SD_CMD_CRC_CMD12                (0x61)      // CMD12, arg = 0
+#define SD_CMD_CRC_CMD13                (0x0D)      // CMD13, arg = 0
+#define SD_CMD_CRC_CMD16_512            (0x15)      // CMD16, arg = 512
+#define SD_CMD_CRC_CMD38                (0xA5)      // CMD38, arg = 0
+#define SD_CMD_CRC_CMD55                (0x65)      // CMD55, arg = 0
+#define SD_CMD_CRC_CMD58                (0xFD)      // CMD58, arg = 0
+#define SD_CMD_CRC_CMD59_ON             (0x83)      // CMD59, arg = 1
+#define SD_CMD_CRC_ACMD22               (0x43)      // ACMD22, arg = 0
+#define SD_CMD_CRC_ACMD41               (0xE5)      // ACMD41, arg = 0
+#define SD_CMD_CRC_ACMD41_HCS           (0x77)      // ACMD41, arg = 0x40000000
+
 /**
  * @brief SD 命令响应标志位
  */
@@ -128,6 +158,38 @@ enum sd_cmd_index
 #define SD_FR_PARAMETER_ERROR           (1 << 6)    // 参数错误（0x40）
 #define SD_FR_FAILED                    (0xff)      // 擦除失败
 
+/**
+ * @brief CMD6（SWITCH_FUNC）参数
+ * @note 位 31 为模式，位 23:0 依次为功能组 6~1 的功能号（各 4 位），0xF 表示该功能组保持不变。
+ */
+#define SD_SWITCH_MODE_CHECK            (0x00000000)    // 查询模式：只返回功能状态，不切换
+#define SD_SWITCH_MODE_SWITCH           (0x80000000)    // 切换模式：切换并返回切换后的功能状态
+#define SD_SWITCH_GROUP1_HIGH_SPEED     (0x00FFFFF1)    // 功能组 1（访问模式）选择功能 1（高速），其余功能组不变
+#define SD_SWITCH_FUNC_INVALID          (0x0F)          // 功能状态中表示切换失败或不支持的功能号
+#define SD_HIGH_SPEED_MAX_HZ            (50000000)      // 高速模式的最高时钟（Hz）
+#define SD_DEFAULT_SPEED_MAX_HZ         (25000000)      // 默认速度模式的最高时钟（Hz），所有 SD 卡退出识别状态后都支持
+
+/**
+ * @brief CMD6 返回的 64 字节功能状态（解析后）
+ * @note 数组下标 0~5 对应功能组 1~6。
+ */
+struct sd_switch_status
+{
+    uint16_t max_current;               // 所选功能下的最大电流（mA），0 表示出错
+    uint16_t support[6];                // 各功能组支持的功能，位 n 对应功能 n
+    uint8_t  selected[6];               // 各功能组查询或切换后的功能号，SD_SWITCH_FUNC_INVALID 表示不支持或切换失败
+    uint8_t  version;                   // 数据结构版本，1 时 busy 有效
+    uint16_t busy[6];                   // 各功能组中正忙的功能，位 n 对应功能 n
+};
+
+/**
+ * @brief SD 卡写入选项
+ * @note 用于 sd_card_write_ex()，可按位组合使用。
+ */
+#define SD_WR_OPT_NONE                  (0 << 0)    // 无选项
+#define SD_WR_OPT_PRE_ERASE             (1 << 0)    // 多块写入前发送 ACMD23 告知卡预擦除的块数
+#define SD_WR_OPT_DEFER_BUSY            (1 << 1)    // 卡接受数据后立即返回，编程忙等待推迟到下一条命令或 sd_card_sync()
+
 /**
  * @brief SD 命令请求结构体
  */
@@ -135,7 +197,7 @@ struct sd_cmd_req
 {
     enum sd_cmd_index   cmd;            // 命令索引
     uint32_t            arg;            // 命令参数
-    uint8_t             crc;            // CRC校验值
+    uint8_t             crc;            // 命令帧最后一个字节（CRC7 + 结束位），SD_CMD_CRC_XXX
     enum sd_resp_type   resp_type;      // 期待的响应类型
     uint8_t             retry;          // 接收响应的重试次数
 };
@@ -167,6 +229,237 @@ struct sd_lba_oparg
     uint32_t lba_count;     // 连续块数量
 };
 
+/**
+ * @brief SD 分散/聚集读写的数据段
+ * @note 用于 sd_card_readv()/sd_card_writev()，多个数据段依次拼接后对应一段连续的块，单个数据段的长度不要求是块大小的倍数。
+ */
+struct sd_iovec
+{
+    void*       buf;    // 数据段缓冲区
+    uint32_t    len;    // 数据段长度（字节）
+};
+
+/**
+ * @brief SD 块缓存统计
+ */
+struct sd_cache_stats
+{
+    uint32_t hits;              // 命中的块数
+    uint32_t misses;            // 未命中的块数
+    uint32_t evictions;         // 替换出有效缓存行的次数
+    uint32_t write_backs;       // 写回卡的脏块数
+    uint32_t bypasses;          // 直接访问卡的大块读写次数
+};
+
+/**
+ * @brief SD 顺序预读统计
+ */
+struct sd_rahead_stats
+{
+    uint32_t hits;              // 从预读缓冲区返回的块数
+    uint32_t prefetches;        // 执行预读的次数
+    uint32_t prefetch_blocks;   // 预读的块数（不含本次请求本身的块）
+    uint32_t discards;          // 预读但未被使用就被丢弃的块数
+    uint32_t shutoffs;          // 因访问变为随机而停止预读的次数
+};
+
+/**
+ * @brief 单张卡的统计信息
+ */
+struct sd_card_stats
+{
+    uint32_t cmds[64];                  // 按命令索引统计的命令发送次数（ACMD 与同号的 CMD 合并计数）
+    uint32_t r1_retries;                // 等待 R1 响应时，第一个字节之后额外查询的字节数
+    uint32_t token_waits;               // 等待数据令牌时查询的字节数
+    uint32_t busy_waits;                // 等待卡退出忙状态时查询的字节数
+    uint64_t busy_us;                   // 等待卡退出忙状态的总时间，单位：微秒（未实现 now_us() 时按延时时间估算）
+    uint64_t bytes_read;                // 从卡读取的数据块字节数
+    uint64_t bytes_written;             // 写入卡的数据块字节数
+    uint32_t errors[Sd_Err_Num];        // 读写、擦除失败的次数，按错误码分类
+    uint32_t inits;                     // 初始化成功的次数
+    uint32_t reinits;                   // 第一次之后的初始化次数（含失败），如拔插卡、出错后重新初始化
+    uint32_t clock_drops;               // 运行时因 CRC 错误降低 SPI 时钟的次数
+};
+
+/**
+ * @brief 二进制追踪记录（SD_SPI_TRACE_MODE_BINARY），小端字节序导出后由 tools/sd_trace_decode.py 解码
+ */
+struct sd_trace_entry
+{
+    uint32_t seq;                       // 记录序号加 1，0 表示正在写入
+    uint32_t ts_us;                     // 时间戳，单位：微秒（未实现 now_us() 时为 0）
+    uint16_t id;                        // 事件号：高 5 位为源文件编号（SD_TRACE_FILE_ID），低 11 位为行号
+    uint8_t  level;                     // 等级，SD_SPI_TRACE_LEVEL_XXX
+    uint8_t  argc;                      // 参数个数
+    uint32_t args[4];                   // 参数
+};
+
+/**
+ * @brief 总线抓取记录的类型
+ */
+#define SD_CAPTURE_CONTROL      0       // control()，ctrl 为控制操作
+#define SD_CAPTURE_TRANSFER     1       // transfer()，先发送 tx_len 字节，再接收 rx_len 字节（期间发送 0xFF）
+#define SD_CAPTURE_RX_FILL      2       // rx_fill()，接收 rx_len 字节（期间发送 0xFF）
+#define SD_CAPTURE_DUPLEX       3       // duplex()，全双工收发 tx_len 字节
+#define SD_CAPTURE_XFER_START   4       // xfer_start()，全双工收发 tx_len 字节，接收的数据记录在之后的 SD_CAPTURE_XFER_DONE 中
+#define SD_CAPTURE_XFER_DONE    5       // xfer_poll() 返回完成或失败
+
+/**
+ * @brief 总线抓取记录的标志
+ */
+#define SD_CAPTURE_F_TX         0x01    // 记录后附有发送的数据，否则发送的是 0xFF
+#define SD_CAPTURE_F_RX         0x02    // 记录后附有接收的数据，否则接收的数据被丢弃
+#define SD_CAPTURE_F_GAP        0x04    // 缓冲区已满，本条记录之前有记录丢失
+
+/**
+ * @brief 总线抓取记录头（SD_SPI_CAPTURE_ENABLE），小端字节序导出后由 tools/sd_capture_decode.py 解码
+ * @note 记录头之后依次为发送的数据和接收的数据（有对应标志时），每个方向最多 limit 字节。
+ */
+struct sd_capture_rec
+{
+    uint32_t ts_us;                     // 调用开始时的时间戳，单位：微秒（未实现 now_us() 时为 0）
+    uint32_t tx_len;                    // 发送的字节数
+    uint32_t rx_len;                    // 接收的字节数
+    uint16_t limit;                     // 每个方向最多记录的字节数，超出部分不记录，0 表示全部记录
+    uint8_t  type;                      // 类型，SD_CAPTURE_XXX
+    uint8_t  flags;                     // 标志，SD_CAPTURE_F_XXX 的按位组合
+    int8_t   ret;                       // 返回值
+    uint8_t  ctrl;                      // control() 的控制操作（enum sd_user_ctrl）
+    uint16_t dur_us;                    // 调用耗时，单位：微秒，超过 65535 时记为 65535
+};
+
+/**
+ * @brief 延迟直方图的操作类型
+ */
+enum sd_lat_op
+{
+    Sd_Lat_Cmd_Resp,        // 命令响应：发送命令帧到收到 R1
+    Sd_Lat_Token_Wait,      // 数据令牌等待：开始等待到收到读数据令牌
+    Sd_Lat_Block_Xfer,      // 数据块传输：读为令牌之后的数据和 CRC，写为令牌、数据、CRC 和数据响应
+    Sd_Lat_Write_Busy,      // 写入忙：卡接受数据块到退出编程忙状态
+    Sd_Lat_Erase,           // 擦除：发送 CMD38 到卡退出忙状态
+    Sd_Lat_Init,            // 初始化：整个 sd_card_init()
+
+    Sd_Lat_Op_Num,          // 操作类型的数量（不是操作类型）
+};
+
+/**
+ * @brief 延迟直方图的桶数，第 i 个桶记录耗时的二进制位数为 i 的操作，即 [2^(i-1), 2^i) 微秒，第 0 个桶记录 0 微秒
+ */
+#define SD_LAT_BUCKETS      32
+
+/**
+ * @brief 一种操作的延迟直方图
+ */
+struct sd_lat_hist
+{
+    uint32_t buckets[SD_LAT_BUCKETS];   // 各桶的操作次数
+    uint32_t count;                     // 总次数
+    uint32_t max_us;                    // 最大耗时，单位：微秒
+    uint64_t total_us;                  // 总耗时，单位：微秒
+};
+
+/**
+ * @brief 延迟直方图的统计结果，单位：微秒
+ * @note 百分位数取所在桶的上界（不超过最大值），即真实值不大于报告值，最多偏大一倍。
+ */
+struct sd_lat_report
+{
+    uint32_t count;                     // 次数
+    uint32_t p50_us;                    // 50 百分位数
+    uint32_t p99_us;                    // 99 百分位数
+    uint32_t max_us;                    // 最大值
+    uint32_t avg_us;                    // 平均值
+};
+
+/**
+ * @brief 总线开销：端口数据传输接口产生的总线活动
+ * @note SPI 模式下每个字节占 8 个时钟，包括命令帧、轮询响应/令牌/忙状态读出的字节、CRC 和虚拟时钟。
+ */
+struct sd_bus_cost
+{
+    uint32_t calls;                     // 端口数据传输接口（transfer()/rx_fill()/duplex()/xfer_start()）的调用次数
+    uint32_t bytes;                     // 总线上收发的字节数
+    uint64_t clocks;                    // SPI 时钟数
+};
+
+/**
+ * @brief 片上基准测试的负载，即 struct sd_bench_report 中结果的下标
+ */
+enum sd_bench_case
+{
+    Sd_Bench_Seq_Read_1,                // 顺序读，每次 1 块
+    Sd_Bench_Seq_Read_8,                // 顺序读，每次 8 块
+    Sd_Bench_Seq_Read_Max,              // 顺序读，每次 SD_SPI_BENCH_MAX_BLOCKS 块
+    Sd_Bench_Rand_Read_1,               // 随机读，每次 1 块
+    Sd_Bench_Rand_Read_8,               // 随机读，每次 8 块
+    Sd_Bench_Seq_Write_1,               // 顺序写，每次 1 块
+    Sd_Bench_Seq_Write_8,               // 顺序写，每次 8 块
+    Sd_Bench_Seq_Write_Max,             // 顺序写，每次 SD_SPI_BENCH_MAX_BLOCKS 块
+    Sd_Bench_Rand_Write_1,              // 随机写，每次 1 块
+    Sd_Bench_Rand_Write_8,              // 随机写，每次 8 块
+    Sd_Bench_Erase,                     // 擦除，每次 1 个擦除扇区
+
+    Sd_Bench_Case_Num,
+};
+
+/**
+ * @brief 片上基准测试配置
+ */
+struct sd_bench_config
+{
+    uint32_t start_blk;                 // 临时区域的起始块号
+    uint32_t blocks;                    // 临时区域的块数，不小于 SD_SPI_BENCH_MAX_BLOCKS
+    uint32_t ops;                       // 每个负载的操作次数，0 表示 64 次
+    bool     write;                     // 是否测试写入和擦除，临时区域中原有的数据将被破坏
+};
+
+/**
+ * @brief 片上基准测试一个负载的结果
+ */
+struct sd_bench_result
+{
+    uint32_t ops;                       // 成功的操作次数，0 表示未测试
+    uint32_t errors;                    // 失败的操作次数
+    uint32_t kb_s;                      // 吞吐，单位：KB/s
+    uint32_t iops;                      // 每秒操作次数
+    uint32_t p50_us;                    // 延迟 50 百分位数（所在对数桶的上界），单位：微秒
+    uint32_t p99_us;                    // 延迟 99 百分位数（所在对数桶的上界），单位：微秒
+    uint32_t max_us;                    // 最大延迟，单位：微秒
+};
+
+/**
+ * @brief 片上基准测试报告
+ */
+struct sd_bench_report
+{
+    struct sd_bench_result result[Sd_Bench_Case_Num];   // 各负载的结果
+    struct sd_lat_hist     write_hist;                  // 随机写 8 块的延迟分布
+};
+
+/**
+ * @brief CRC16 微基准测试结果，按 SD_SPI_CRC16_XXX 计算方式索引
+ */
+struct sd_crc_bench
+{
+    uint32_t ns_per_block[4];   // 计算一个 512 字节块的平均耗时，单位：纳秒，未编译的计算方式为 0
+};
+
+/**
+ * @brief 写合并统计信息
+ */
+struct sd_wcomb_stats
+{
+    uint32_t writes;            // 进入写合并缓冲区的写入次数
+    uint32_t blocks;            // 进入写合并缓冲区的块数
+    uint32_t flushes;           // 写回缓冲区的次数，每次为一次多块写入
+    uint32_t flush_gap;         // 因写入不连续而写回的次数
+    uint32_t flush_full;        // 因缓冲区已满而写回的次数
+    uint32_t flush_age;         // 因数据超时而写回的次数
+    uint32_t flush_read;        // 因读取与缓冲区重叠而写回的次数
+    uint32_t flush_sync;        // 因同步、擦除等操作而写回的次数
+};
+
 /**
  * @brief SD 卡信息
  */
@@ -177,6 +470,9 @@ struct sd_info
     uint32_t      erase_sector_size;    // 最小擦除扇区大小（单位：字节）
     uint16_t      block_size;           // 块大小（单位：字节）
     enum sd_type  type;                 // 类型
+    uint32_t      max_hz;               // CSD 中 TRAN_SPEED 规定的最高时钟（单位：Hz），0 表示无效；切换至高速模式后为 50MHz
+    uint16_t      ccc;                  // CSD 中的卡命令类（CCC），位 n 对应 class n
+    bool          is_high_speed;        // 是否已通过 CMD6 切换至高速模式
 };
 
 /**
@@ -223,6 +519,18 @@ struct sd_spi_interface
     int  (*control)         (struct sd_card* card, enum sd_user_ctrl ctrl);                          // 硬件控制，执行成功返回 0，失败返回 -1
     int  (*transfer)        (struct sd_card* card, struct sd_spi_buf* tx, struct sd_spi_buf* rx);    // 发送和接收数据
     void (*delay_us)        (struct sd_card* card, uint32_t us);                                     // 延时函数，单位为微秒
+    uint32_t (*now_us)      (struct sd_card* card);                                                  // 可选，获取单调递增的微秒时间戳（允许回绕），异步请求接口依赖此函数
+
+    /** 可选的批量传输能力，数据块直接使用用户缓冲区收发；未实现时退回 transfer() **/
+    int  (*rx_fill)         (struct sd_card* card, void* rx, size_t len);                            // 可选，接收 len 字节，期间发送 0xFF，成功返回 0，失败返回 -1
+    int  (*duplex)          (struct sd_card* card, const void* tx, void* rx, size_t len);            // 可选，全双工收发 len 字节，tx 与 rx 可以指向同一缓冲区，rx 为 NULL 时丢弃接收的数据，成功返回 0，失败返回 -1
+    int  (*xfer_start)      (struct sd_card* card, const void* tx, void* rx, size_t len);            // 可选，启动异步传输（如 DMA）并立即返回，tx 为 NULL 时发送 0xFF，rx 为 NULL 时丢弃接收的数据，成功返回 0，失败返回 -1
+    int  (*xfer_poll)       (struct sd_card* card);                                                  // 可选，与 xfer_start() 配套，查询异步传输：完成返回 0，进行中返回 1，失败返回 -1
+    uint16_t dma_align;                                                                              // 可选，xfer_start() 要求的缓冲区地址和长度对齐（字节，2 的幂），0 表示无要求
+    uint16_t dma_min_len;                                                                            // 可选，使用 xfer_start() 的最小长度，更短的传输使用同步接口
+
+    /** 可选的按频率调速能力；未实现时退回 control() 的低速/高速切换 **/
+    uint32_t (*set_clock)   (struct sd_card* card, uint32_t hz);                                     // 可选，设置 SPI 时钟，返回实际的时钟（Hz，不超过请求值；无法满足时返回可用的最低时钟），失败返回 0
 };
 
 /**
@@ -233,6 +541,109 @@ struct sd_debug_interface
     void (*print) (struct sd_card* card, const char* format, ...);        // 打印调试信息
 };
 
+/**
+ * @brief SD 异步请求操作类型
+ */
+enum sd_req_op
+{
+    Sd_Req_Op_Read,         // 读取数据
+    Sd_Req_Op_Write,        // 写入数据
+    Sd_Req_Op_Erase,        // 擦除扇区
+};
+
+/**
+ * @brief SD 异步请求
+ * @note 由用户分配并填写输入字段后通过 sd_card_submit() 提交，完成（回调被调用或 sd_card_poll() 返回结果）之前不能释放或修改。
+ */
+struct sd_request
+{
+    /** 输入 **/
+    enum sd_req_op      op;             // 操作类型
+    uint64_t            addr;           // 字节地址（必须是块大小的倍数）
+    void*               buf;            // 数据缓冲区，擦除时不使用
+    uint32_t            len;            // 读写时为字节长度（必须是块大小的倍数），擦除时为擦除扇区数
+    uint32_t            opts;           // 写入选项，SD_WR_OPT_XXX 的按位组合，仅写入时有效
+    void (*callback)    (struct sd_card* card, struct sd_request* req);   // 完成回调，可为 NULL
+    void*               user_data;      // 用户数据
+
+    /** 输出 **/
+    enum sd_error       result;         // 执行结果
+    uint32_t            done_blocks;    // 已完成的块数
+};
+
+/**
+ * @brief SD 异步请求执行上下文（内部使用）
+ */
+struct sd_async
+{
+    struct sd_request*  req;            // 当前请求，NULL 表示空闲
+    uint8_t             state;          // 状态机当前状态
+    bool                is_multi;       // 是否使用 CMD18/CMD25 多块传输
+    enum sd_error       err;            // 执行过程中出现的错误
+    uint32_t            arg;            // 当前块的命令地址
+    uint32_t            count;          // 总块数
+    uint32_t            offset;         // 当前块内已传输的字节数
+    uint32_t            t_start;        // 当前等待阶段的起始时间戳，单位：微秒
+    uint32_t            timeout_us;     // 当前等待阶段的超时时间，单位：微秒
+    uint16_t            crc;            // 当前块已传输数据的 CRC16
+    uint8_t             retries;        // 当前块因 CRC 错误重传的次数
+    uint8_t             crc_errs;       // 本次请求出现的 CRC 错误次数（达到 255 后不再增加）
+    bool                is_resume;      // 当前块因 CRC 错误被丢弃，结束本次多块传输后从该块重新开始
+    uint32_t            dma_len;        // 已通过 xfer_start() 启动、尚未完成的传输长度，0 表示没有
+};
+
+/**
+ * @brief 初始化阶段
+ */
+enum sd_init_phase
+{
+    Sd_Init_Phase_Power,        // 硬件初始化与上电时钟
+    Sd_Init_Phase_Idle,         // CMD0 进入空闲状态
+    Sd_Init_Phase_If_Cond,      // CMD8 检查电压范围
+    Sd_Init_Phase_Op_Cond,      // CMD55+ACMD41 等待卡完成初始化
+    Sd_Init_Phase_Registers,    // CMD58/CMD16/CMD9 读取 OCR、设置块长度、读取 CSD
+    Sd_Init_Phase_Setup,        // 打开 CRC 校验、切换高速模式、设置时钟与训练
+    Sd_Init_Phase_Num,          // 阶段数量（不是阶段）
+};
+
+/**
+ * @brief 最近一次初始化的阶段耗时
+ * @note 耗时由 now_us() 测量，未实现 now_us() 时耗时全部为 0。初始化失败时保留已完成阶段的耗时。
+ */
+struct sd_init_timing
+{
+    uint32_t phase_us[Sd_Init_Phase_Num];   // 各阶段耗时，单位：微秒
+    uint32_t total_us;                      // 截至最近完成的阶段的总耗时，单位：微秒
+    uint32_t acmd41_polls;                  // 发送 ACMD41 的次数
+    uint32_t t_start;                       // 内部使用：初始化开始的时间戳
+    uint32_t t_mark;                        // 内部使用：上一阶段结束的时间戳
+    uint32_t waited_us;                     // 内部使用：主动延时的累计时间，未实现 now_us() 时用于估算时间预算
+};
+
+/**
+ * @brief SPI 时钟状态（端口实现 set_clock() 时有效）
+ */
+struct sd_clock
+{
+    uint32_t            hz;             // 当前时钟（Hz），端口未实现 set_clock() 时为 0
+    uint32_t            max_hz;         // 允许使用的最高时钟（Hz），初始为 TRAN_SPEED 与 SD_SPI_CLOCK_MAX_HZ 中的较小者，训练和运行时降速会降低该值
+    uint32_t            crc_errs;       // 累计出现的数据块 CRC 错误次数（含重传后成功的）
+    uint32_t            win_blocks;     // 运行时降速：当前统计窗口内已传输的块数
+    uint32_t            win_errs;       // 运行时降速：当前统计窗口内的 CRC 错误次数
+    bool                is_training;    // 是否正在训练，训练期间不触发运行时降速
+};
+
+/**
+ * @brief 批量传输中多读出、尚未被取用的字节
+ */
+#define SD_RX_AHEAD_SIZE    ((SD_SPI_XFER_SCAN_CHUNK > SD_SPI_XFER_RESP_WINDOW) ? SD_SPI_XFER_SCAN_CHUNK : SD_SPI_XFER_RESP_WINDOW)
+struct sd_rx_ahead
+{
+    uint8_t             buf[SD_RX_AHEAD_SIZE];  // 字节缓冲区
+    uint8_t             pos;                    // 下一个待取用字节的位置
+    uint8_t             len;                    // 缓冲区中的字节数
+};
+
 /**
  * @brief SD 卡对象
  */
@@ -243,9 +654,26 @@ struct sd_card
     struct sd_debug_interface*  debug_if;             // 调试接口
     void*                       user_data;            // 用户数据
     struct sd_info              info;                 // 卡信息
+    uint32_t                    xfer_blocks;          // 最近一次读写操作完成的块数
+    struct sd_async             async;                // 异步请求上下文
+    struct sd_rx_ahead          ahead;                // 批量传输多读出的字节
+    uint32_t                    port_calls;           // 累计调用端口数据传输接口的次数
+    uint32_t                    port_bytes;           // 累计经端口数据传输接口收发的字节数
+    struct sd_clock             clock;                // SPI 时钟状态
+    struct sd_init_timing       init_timing;          // 最近一次初始化的阶段耗时
+#if (SD_SPI_STATS_ENABLE == 1)
+    struct sd_card_stats        stats;                // 统计信息
+    volatile uint32_t           stats_seq;            // 统计信息的更新序号，奇数表示正在更新
+#endif
+#if (SD_SPI_LATENCY_ENABLE == 1)
+    struct sd_lat_hist          lat[Sd_Lat_Op_Num];   // 各类操作的延迟直方图
+    volatile uint32_t           lat_seq;              // 延迟直方图的更新序号，奇数表示正在更新
+#endif
     bool                        is_inited     :1;     // 是否已初始化
     bool                        is_selected   :1;     // 是否已选中SD卡
     bool                        is_xfering    :1;     // 是否正处于数据收发状态
+    bool                        is_busy_pending :1;   // 卡是否可能仍在执行推迟等待的写入编程
+    bool                        is_single_block :1;   // 是否强制逐块传输（CMD17/CMD24），见 sd_card_set_multi_block()
 };
 #define SD_CARD_OBJ_INIT(_name, _spi_if, _debug_if) \
    {                                                \
@@ -254,9 +682,17 @@ struct sd_card
         .debug_if       = _debug_if,                \
         .user_data      = NULL,                     \
         .info           = (struct sd_info){0},      \
+        .xfer_blocks    = 0,                        \
+        .async          = {0},                      \
+        .ahead          = {{0}},                    \
+        .port_calls     = 0,                        \
+        .port_bytes     = 0,                        \
+        .clock          = {0},                      \
+        .init_timing    = {{0}},                    \
         .is_inited      = false,                    \
         .is_selected    = false,                    \
         .is_xfering     = false,                    \
+        .is_busy_pending = false,                   \
     }
 
 
@@ -18,60 +18,135 @@ extern "C" {
 #include "sd_config.h"
 
 #if (SD_SPI_TRACE_ENABLE == 1)
-    #define trace(_card, _color, _fmt, ...)       \
-        do \
-        { \
-            if (_card->debug_if != NULL && _card->debug_if->print != NULL) \
-                _card->debug_if->print(_card, _color "[%s:%d] %s: " _fmt "\033[0m\r\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
-        } while (0)
+    extern volatile uint8_t sd_trace_level;
+
+    /** 运行时等级过滤，等级高于 sd_trace_level 的记录在求值参数之前即被跳过 **/
+    #define trace_on(_level)        ((_level) <= sd_trace_level)
+
+    #if (SD_SPI_TRACE_MODE == SD_SPI_TRACE_MODE_BINARY)
+        /**
+         * 二进制模式：事件号由文件编号（每个源文件在包含头文件后定义 SD_TRACE_FILE_ID）和行号组成，
+         * 参数统一转换为 uint32_t，参数多于 4 个时编译报错。
+         */
+        #define trace_id()          ((uint16_t) (((SD_TRACE_FILE_ID) << 11) | (__LINE__ & 0x7FF)))
+        #define _trace_pick(_0, _1, _2, _3, _4, _5, _x, ...)     _x
+        #define _trace_argc(...)    _trace_pick(0, ##__VA_ARGS__, trace_too_many_args, 4, 3, 2, 1, 0, 0)
+        #define _trace_args(...)    _trace_pick(0, ##__VA_ARGS__, trace_too_many_args, _trace_a4, _trace_a3, _trace_a2, _trace_a1, _trace_a0, 0)(__VA_ARGS__)
+        #define _trace_a0()                 0, 0, 0, 0
+        #define _trace_a1(a)                (uint32_t) (a), 0, 0, 0
+        #define _trace_a2(a, b)             (uint32_t) (a), (uint32_t) (b), 0, 0
+        #define _trace_a3(a, b, c)          (uint32_t) (a), (uint32_t) (b), (uint32_t) (c), 0
+        #define _trace_a4(a, b, c, d)       (uint32_t) (a), (uint32_t) (b), (uint32_t) (c), (uint32_t) (d)
+
+        #define trace(_card, _level, _color, _fmt, ...)       \
+            do \
+            { \
+                if (trace_on(_level)) \
+                    sd_trace_put(_card, trace_id(), _level, _trace_argc(__VA_ARGS__), _trace_args(__VA_ARGS__)); \
+            } while (0)
+    #else
+        #define trace(_card, _level, _color, _fmt, ...)       \
+            do \
+            { \
+                if (trace_on(_level) && _card->debug_if != NULL && _card->debug_if->print != NULL) \
+                    _card->debug_if->print(_card, _color "[%s:%d] %s: " _fmt "\033[0m\r\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+            } while (0)
+    #endif
 
     #if (SD_SPI_TRACE_LEVEL >= SD_SPI_TRACE_LEVEL_DEBUG)
-        #define trace_d(_card, _fmt,...)    trace(_card, "\033[37m", _fmt, ##__VA_ARGS__)
+        #define trace_d(_card, _fmt,...)    trace(_card, SD_SPI_TRACE_LEVEL_DEBUG, "\033[37m", _fmt, ##__VA_ARGS__)
     #else
-        #define trace_d(_card, _fmt,...)
+        #define trace_d(_card, _fmt,...)    do {} while (0)
     #endif
 
     #if (SD_SPI_TRACE_LEVEL >= SD_SPI_TRACE_LEVEL_INFO)
-        #define trace_i(_card, _fmt,...)    trace(_card, "\033[32m", _fmt, ##__VA_ARGS__)
+        #define trace_i(_card, _fmt,...)    trace(_card, SD_SPI_TRACE_LEVEL_INFO, "\033[32m", _fmt, ##__VA_ARGS__)
     #else
-        #define trace_i(_card, _fmt,...)
+        #define trace_i(_card, _fmt,...)    do {} while (0)
     #endif
 
     #if (SD_SPI_TRACE_LEVEL >= SD_SPI_TRACE_LEVEL_WARN)
-        #define trace_w(_card, _fmt,...)    trace(_card, "\033[33m", _fmt, ##__VA_ARGS__)
+        #define trace_w(_card, _fmt,...)    trace(_card, SD_SPI_TRACE_LEVEL_WARN, "\033[33m", _fmt, ##__VA_ARGS__)
     #else
-        #define trace_w(_card, _fmt,...)
+        #define trace_w(_card, _fmt,...)    do {} while (0)
     #endif
 
     #if (SD_SPI_TRACE_LEVEL >= SD_SPI_TRACE_LEVEL_ERROR)
-        #define trace_e(_card, _fmt,...)    trace(_card, "\033[31m", _fmt, ##__VA_ARGS__)
+        #define trace_e(_card, _fmt,...)    trace(_card, SD_SPI_TRACE_LEVEL_ERROR, "\033[31m", _fmt, ##__VA_ARGS__)
     #else
-        #define trace_e(_card, _fmt,...)
+        #define trace_e(_card, _fmt,...)    do {} while (0)
     #endif
 
     #if (SD_SPI_TRACE_LEVEL >= SD_SPI_TRACE_LEVEL_LIB)
         #define trace_l(_card, _fmt,...)       \
             do \
             { \
-                if (_card->debug_if != NULL && _card->debug_if->print != NULL) \
+                if (trace_on(SD_SPI_TRACE_LEVEL_LIB) && _card->debug_if != NULL && _card->debug_if->print != NULL) \
                     _card->debug_if->print(_card, "\033[34;1m" _fmt "\033[0m\r\n", ##__VA_ARGS__); \
             } while (0)
     #else
-        #define trace_l(card, fmt,...)
+        #define trace_l(card, fmt,...)      do {} while (0)
     #endif
 
 #else
-    #define trace_l(card, fmt,...)
-    #define trace_e(card, fmt,...)
-    #define trace_w(card, fmt,...)
-    #define trace_i(card, fmt,...)
-    #define trace_d(card, fmt,...)
-    #define trace(_card, _level, _fmt,...)
+    #define trace_l(card, fmt,...)    do {} while (0)
+    #define trace_e(card, fmt,...)    do {} while (0)
+    #define trace_w(card, fmt,...)    do {} while (0)
+    #define trace_i(card, fmt,...)    do {} while (0)
+    #define trace_d(card, fmt,...)    do {} while (0)
+    #define trace(_card, _level, _color, _fmt,...)    do {} while (0)
+#endif
+
+/**
+ * @brief 编译器屏障，保证统计信息的更新序号与数据的读写顺序
+ * @note 适用于单核 MCU；多核平台需替换为对应的内存屏障。
+ */
+#if defined(__GNUC__) || defined(__clang__)
+    #define sd_barrier()    __asm__ volatile ("" ::: "memory")
+#else
+    #define sd_barrier()
+#endif
+
+/**
+ * @brief 卡统计信息的更新
+ * @note 更新前后各将更新序号加 1，读取方据此判断读到的快照是否完整（顺序锁）。
+ */
+#if (SD_SPI_STATS_ENABLE == 1)
+    #define stats_begin(_card)          do { (_card)->stats_seq++; sd_barrier(); } while (0)
+    #define stats_end(_card)            do { sd_barrier(); (_card)->stats_seq++; } while (0)
+    #define stats_add(_card, _field, _n) \
+        do { stats_begin(_card); (_card)->stats._field += (_n); stats_end(_card); } while (0)
+#else
+    #define stats_begin(_card)          do {} while (0)
+    #define stats_end(_card)            do {} while (0)
+    #define stats_add(_card, _field, _n) do {} while (0)
+#endif
+
+/**
+ * @brief 延迟直方图的记录：lat_begin() 获取起始时间戳，操作成功后 lat_record() 记录耗时
+ */
+#if (SD_SPI_LATENCY_ENABLE == 1)
+    #define lat_begin(_card)                sd_spi_hw_now_us(_card)
+    #define lat_record(_card, _op, _t0)     sd_lat_record(_card, _op, _t0)
+#else
+    #define lat_begin(_card)                0
+    #define lat_record(_card, _op, _t0)     ((void) (_t0))
 #endif
 
 
 
 
+/**
+ * @brief 数据段游标，记录分散/聚集读写的当前位置
+ */
+struct sd_iov_cursor
+{
+    const struct sd_iovec*  iov;        // 数据段数组
+    uint32_t                idx;        // 当前数据段下标
+    uint32_t                off;        // 当前数据段内的偏移（字节）
+};
+
+
 enum sd_error sd_spi_hw_io_init     (struct sd_card* card);
 enum sd_error sd_spi_hw_io_deinit   (struct sd_card* card);
 
@@ -82,18 +157,68 @@ enum sd_error sd_spi_hw_read_byte   (struct sd_card* card, void* buf);
 enum sd_error sd_spi_hw_read_bytes  (struct sd_card* card, void* buf, uint32_t len);
 enum sd_error sd_spi_hw_write_byte  (struct sd_card* card, uint8_t buf);
 enum sd_error sd_spi_hw_write_bytes (struct sd_card* card, void* buf, uint32_t len);
+enum sd_error sd_spi_hw_write_read  (struct sd_card* card, const void* tx, uint32_t tx_len, uint32_t rx_len);
+enum sd_error sd_spi_hw_scan        (struct sd_card* card, bool until_ff, uint32_t max, uint8_t* byte, uint32_t* scanned);
+enum sd_error sd_spi_hw_bulk_read   (struct sd_card* card, void* buf, uint32_t len);
+enum sd_error sd_spi_hw_bulk_write  (struct sd_card* card, const void* buf, uint32_t len);
+bool          sd_spi_hw_can_start   (struct sd_card* card, const void* buf, uint32_t len);
+enum sd_error sd_spi_hw_xfer_start  (struct sd_card* card, const void* tx, void* rx, uint32_t len);
+enum sd_error sd_spi_hw_xfer_poll   (struct sd_card* card);
 
 void          sd_spi_hw_udelay      (struct sd_card* card, uint32_t us);
+uint32_t      sd_spi_hw_now_us      (struct sd_card* card);
 enum sd_error sd_spi_hw_send_dummy  (struct sd_card* card, uint8_t count);
 
 enum sd_error sd_card_into_idle     (struct sd_card* card);
+void          sd_card_init_begin    (struct sd_card* card);
+void          sd_card_init_mark     (struct sd_card* card, enum sd_init_phase phase);
+uint32_t      sd_card_init_elapsed  (struct sd_card* card);
+uint32_t      sd_card_init_backoff  (struct sd_card* card, uint32_t interval);
 enum sd_error sd_card_identify     (struct sd_card* card);
+void          sd_card_parse_switch_status   (const uint8_t raw[64], struct sd_switch_status* status);
 enum sd_error sd_card_send_cmd_req  (struct sd_card* card, struct sd_cmd_req* req, struct sd_resp_res* resp);
 enum sd_error sd_card_get_status    (struct sd_card *card, uint8_t *status);
+enum sd_error sd_card_wait_ready    (struct sd_card* card, uint32_t timeout_us);
+enum sd_error sd_card_wait_token    (struct sd_card* card, uint8_t* token, uint32_t timeout_us);
+uint32_t      sd_card_lba_step      (struct sd_card* card);
+enum sd_error sd_card_rw_blocks     (struct sd_card* card, uint32_t blk, uint32_t count, struct sd_iov_cursor* cur, bool is_write, uint32_t opts);
+enum sd_error sd_card_rw_blocks_direct  (struct sd_card* card, uint32_t blk, uint32_t count, struct sd_iov_cursor* cur, bool is_write, uint32_t opts);
+void          sd_iov_copy           (struct sd_iov_cursor* cur, void* buf, uint32_t len, bool to_iov);
+
+uint8_t       sd_crc7               (const uint8_t* buf, uint32_t len);
+uint16_t      sd_crc16              (uint16_t crc, const uint8_t* buf, uint32_t len);
+uint16_t      sd_crc16_bitwise      (uint16_t crc, const uint8_t* buf, uint32_t len);
+uint16_t      sd_crc16_table        (uint16_t crc, const uint8_t* buf, uint32_t len);
+uint16_t      sd_crc16_slice4       (uint16_t crc, const uint8_t* buf, uint32_t len);
+uint16_t      sd_crc16_slice8       (uint16_t crc, const uint8_t* buf, uint32_t len);
+
+void          sd_trace_put          (struct sd_card* card, uint16_t id, uint8_t level, uint8_t argc, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+
+void          sd_lat_record         (struct sd_card* card, enum sd_lat_op op, uint32_t t0);
+uint8_t       sd_lat_bucket         (uint32_t us);
+uint32_t      sd_lat_percentile     (const struct sd_lat_hist* hist, uint32_t permille);
+
+enum sd_error sd_cache_rw_blocks    (struct sd_card* card, uint32_t blk, uint32_t count, struct sd_iov_cursor* cur, bool is_write, uint32_t opts);
+enum sd_error sd_cache_flush        (struct sd_card* card);
+enum sd_error sd_cache_evict_range  (struct sd_card* card, uint32_t blk, uint32_t count, bool write_back);
+uint32_t      sd_cache_dirty_count  (struct sd_card* card);
+
+enum sd_error sd_rahead_read        (struct sd_card* card, uint32_t blk, uint32_t count, struct sd_iov_cursor* cur);
+void          sd_rahead_invalidate  (struct sd_card* card, uint32_t blk, uint32_t count);
+
+enum sd_error sd_wcomb_write        (struct sd_card* card, uint32_t blk, uint32_t count, struct sd_iov_cursor* cur, uint32_t opts);
+enum sd_error sd_wcomb_flush        (struct sd_card* card, bool write_back);
+enum sd_error sd_wcomb_flush_range  (struct sd_card* card, uint32_t blk, uint32_t count);
 
 void          sd_spi_hw_set_speed           (struct sd_card* card, enum sd_user_ctrl speed);
+uint32_t      sd_spi_hw_set_clock           (struct sd_card* card, uint32_t hz);
 bool          sd_spi_hw_is_card_detached    (struct sd_card* card);
 
+void          sd_clock_set_identify (struct sd_card* card);
+void          sd_clock_set_default  (struct sd_card* card);
+enum sd_error sd_clock_set_transfer (struct sd_card* card);
+void          sd_clock_account      (struct sd_card* card, uint32_t blocks, uint32_t crc_errs);
+
 void          sd_card_print_info    (struct sd_card* card);
 
 #ifdef __cplusplus
@@ -30,6 +30,16 @@ enum sd_error   sd_card_init    (struct sd_card* card);
 enum sd_error   sd_card_deinit  (struct sd_card* card);
 enum sd_error   sd_card_read    (struct sd_card* card, const uint64_t addr, uint8_t* buf, const uint32_t len);
 enum sd_error   sd_card_write   (struct sd_card* card, const uint64_t addr, const uint8_t* buf, const uint32_t len);
+enum sd_error   sd_card_write_ex(struct sd_card* card, const uint64_t addr, const uint8_t* buf, const uint32_t len, const uint32_t opts);
+enum sd_error   sd_card_readv   (struct sd_card* card, const uint64_t addr, const struct sd_iovec* iov, const uint32_t iovcnt);
+enum sd_error   sd_card_writev  (struct sd_card* card, const uint64_t addr, const struct sd_iovec* iov, const uint32_t iovcnt);
+enum sd_error   sd_card_writev_ex(struct sd_card* card, const uint64_t addr, const struct sd_iovec* iov, const uint32_t iovcnt, const uint32_t opts);
+enum sd_error   sd_card_pread   (struct sd_card* card, const uint64_t addr, uint8_t* buf, const uint32_t len);
+enum sd_error   sd_card_pwrite  (struct sd_card* card, const uint64_t addr, const uint8_t* buf, const uint32_t len);
+enum sd_error   sd_card_sync    (struct sd_card* card);
+
+enum sd_error   sd_card_submit  (struct sd_card* card, struct sd_request* req);
+enum sd_error   sd_card_poll    (struct sd_card* card);
 
 enum sd_error   sd_card_erase_sector  (struct sd_card* card, const uint64_t addr, const uint32_t count);
 enum sd_error   sd_card_erase_chip    (struct sd_card* card);
@@ -40,11 +50,41 @@ enum sd_type    sd_card_get_type        (struct sd_card* card);
 uint32_t        sd_card_get_block_size  (struct sd_card* card);
 uint64_t        sd_card_get_erase_size  (struct sd_card* card);
 bool            sd_card_is_inserted     (struct sd_card* card);
+uint32_t        sd_card_get_xfer_blocks (struct sd_card* card);
+uint32_t        sd_card_get_port_calls  (struct sd_card* card);
+void            sd_card_reset_port_calls(struct sd_card* card);
+void            sd_card_get_bus_cost    (struct sd_card* card, struct sd_bus_cost* cost);
+void            sd_card_reset_bus_cost  (struct sd_card* card);
+uint32_t        sd_card_get_clock       (struct sd_card* card);
+enum sd_error   sd_card_train_clock     (struct sd_card* card);
+enum sd_error   sd_card_get_init_timing (struct sd_card* card, struct sd_init_timing* timing);
+enum sd_error   sd_card_get_stats       (struct sd_card* card, struct sd_card_stats* stats);
+void            sd_card_reset_stats     (struct sd_card* card);
+enum sd_error   sd_card_get_latency     (struct sd_card* card, enum sd_lat_op op, struct sd_lat_report* report);
+void            sd_card_reset_latency   (struct sd_card* card);
+void            sd_card_set_multi_block (struct sd_card* card, bool enable);
 void            sd_card_set_user_data   (struct sd_card* card, void* data);
 void*           sd_card_get_user_data   (struct sd_card* card);
 
 const char*     sd_get_capacity_class_name  (enum sd_type type);
 
+void            sd_cache_get_stats      (struct sd_cache_stats* stats);
+void            sd_cache_reset_stats    (void);
+void            sd_rahead_get_stats     (struct sd_rahead_stats* stats);
+void            sd_rahead_reset_stats   (void);
+void            sd_wcomb_get_stats      (struct sd_wcomb_stats* stats);
+void            sd_wcomb_reset_stats    (void);
+enum sd_error   sd_crc16_bench          (struct sd_card* card, uint32_t rounds, struct sd_crc_bench* out);
+enum sd_error   sd_card_bench           (struct sd_card* card, const struct sd_bench_config* cfg, struct sd_bench_report* report);
+
+void            sd_trace_set_level      (uint8_t level);
+uint8_t         sd_trace_get_level      (void);
+uint32_t        sd_trace_read           (struct sd_trace_entry* out, uint32_t max, uint32_t* lost);
+
+enum sd_error   sd_capture_start        (struct sd_card* card);
+enum sd_error   sd_capture_stop         (struct sd_card* card);
+uint32_t        sd_capture_read         (void* buf, uint32_t max, uint32_t* lost);
+
 #ifdef __cplusplus
 }
 #endif
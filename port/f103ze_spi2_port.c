@@ -12,11 +12,18 @@
 #include "stm32f1xx_hal.h"
 #include "stdarg.h"
 #include "stdio.h"
+#include "string.h"
 #include "rtthread.h"
 #include "rthw.h"
 
+#define PORT_SPI_DMA_ENABLE     1       // 数据块使用 DMA 收发（SPI2_RX: DMA1_Channel4，SPI2_TX: DMA1_Channel5）
+
 static SPI_HandleTypeDef hspi2;
 static struct rt_mutex mutex_spisd;
+#if (PORT_SPI_DMA_ENABLE == 1)
+static DMA_HandleTypeDef hdma_spi2_rx;
+static DMA_HandleTypeDef hdma_spi2_tx;
+#endif
 
 static void _init(struct sd_card* card)
 {
@@ -39,6 +46,33 @@ static void _init(struct sd_card* card)
     hspi2.Init.CRCPolynomial = 10;
     HAL_SPI_Init(&hspi2);
 
+#if (PORT_SPI_DMA_ENABLE == 1)
+    /** DMA 初始化 **/
+    __HAL_RCC_DMA1_CLK_ENABLE();
+    hdma_spi2_rx.Instance = DMA1_Channel4;
+    hdma_spi2_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_spi2_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_spi2_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_spi2_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_spi2_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_spi2_rx.Init.Mode = DMA_NORMAL;
+    hdma_spi2_rx.Init.Priority = DMA_PRIORITY_HIGH;
+    HAL_DMA_Init(&hdma_spi2_rx);
+    __HAL_LINKDMA(&hspi2, hdmarx, hdma_spi2_rx);
+
+    hdma_spi2_tx.Instance = DMA1_Channel5;
+    hdma_spi2_tx.Init = hdma_spi2_rx.Init;
+    hdma_spi2_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_spi2_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
+    HAL_DMA_Init(&hdma_spi2_tx);
+    __HAL_LINKDMA(&hspi2, hdmatx, hdma_spi2_tx);
+
+    HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+    HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 5, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+#endif
+
     /** GPIO 初始化 **/
     GPIO_InitTypeDef GPIO_InitStruct = {0};
     __HAL_RCC_GPIOG_CLK_ENABLE();
@@ -62,6 +96,12 @@ static void _init(struct sd_card* card)
 static void _deinit(struct sd_card* card)
 {
     __HAL_RCC_SPI2_CLK_DISABLE();
+#if (PORT_SPI_DMA_ENABLE == 1)
+    HAL_NVIC_DisableIRQ(DMA1_Channel4_IRQn);
+    HAL_NVIC_DisableIRQ(DMA1_Channel5_IRQn);
+    HAL_DMA_DeInit(&hdma_spi2_rx);
+    HAL_DMA_DeInit(&hdma_spi2_tx);
+#endif
     HAL_GPIO_DeInit(GPIOG, GPIO_PIN_14);
     HAL_GPIO_DeInit(GPIOB, GPIO_PIN_13|GPIO_PIN_14|GPIO_PIN_15);
 
@@ -69,6 +109,56 @@ static void _deinit(struct sd_card* card)
     rt_mutex_detach(&mutex_spisd);
 }
 
+static int _rx_fill(struct sd_card* card, void* rx, size_t len)
+{
+    /** 以接收缓冲区自身作为发送数据，一次调用完成整段接收，期间发送 0xFF **/
+    memset(rx, 0xFF, len);
+    return (HAL_SPI_TransmitReceive(&hspi2, rx, rx, len, 0xffff) == HAL_OK) ? 0 : -1;
+}
+
+#if (PORT_SPI_DMA_ENABLE == 1)
+static int _xfer_start(struct sd_card* card, const void* tx, void* rx, size_t len)
+{
+    HAL_StatusTypeDef ret;
+
+    if(tx == NULL)
+    {
+        memset(rx, 0xFF, len);
+        ret = HAL_SPI_TransmitReceive_DMA(&hspi2, rx, rx, len);
+    }
+    else if(rx == NULL)
+        ret = HAL_SPI_Transmit_DMA(&hspi2, (uint8_t*) tx, len);
+    else
+        ret = HAL_SPI_TransmitReceive_DMA(&hspi2, (uint8_t*) tx, rx, len);
+
+    return (ret == HAL_OK) ? 0 : -1;
+}
+
+static int _xfer_poll(struct sd_card* card)
+{
+    switch(HAL_SPI_GetState(&hspi2))
+    {
+    case HAL_SPI_STATE_READY:   return (hspi2.ErrorCode == HAL_SPI_ERROR_NONE) ? 0 : -1;
+    case HAL_SPI_STATE_ERROR:   return -1;
+    default:                    return 1;
+    }
+}
+
+void DMA1_Channel4_IRQHandler(void)
+{
+    rt_interrupt_enter();
+    HAL_DMA_IRQHandler(&hdma_spi2_rx);
+    rt_interrupt_leave();
+}
+
+void DMA1_Channel5_IRQHandler(void)
+{
+    rt_interrupt_enter();
+    HAL_DMA_IRQHandler(&hdma_spi2_tx);
+    rt_interrupt_leave();
+}
+#endif
+
 static int _transfer(struct sd_card* card, struct sd_spi_buf* tx, struct sd_spi_buf* rx)
 {
     if(tx)
@@ -90,14 +180,10 @@ static int _transfer(struct sd_card* card, struct sd_spi_buf* tx, struct sd_spi_
     if(rx)
     {
         rx->used = 0;
-        while(rx->used < rx->size)
-        {
-            uint8_t dummy = 0xff;
-            if(HAL_SPI_TransmitReceive(&hspi2, &dummy, rx->data + rx->used, 1, 0xffff)!= HAL_OK)
-                return -1;
-            else
-                rx->used++;
-        }
+        if(_rx_fill(card, rx->data, rx->size) != 0)
+            return -1;
+        else
+            rx->used = rx->size;
 
     #if 1
         rt_kprintf("read len: %d, content: ", rx->used);
@@ -127,19 +213,14 @@ static void _delay_us(struct sd_card* card, uint32_t us)
         rt_hw_us_delay(us);
 }
 
-static void _set_speed(struct sd_card* card, enum sd_user_ctrl speed)
+static void _set_prescaler(uint32_t prescaler)
 {
     /** 停止 SPI 外设 **/
     __HAL_RCC_SPI2_CLK_DISABLE();
     while (__HAL_RCC_SPI2_IS_CLK_ENABLED());
 
     /** 重置时钟分频 **/
-    switch(speed)
-    {
-    case Sd_User_Ctrl_Set_Low_Speed:  hspi2.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_256; break;
-    case Sd_User_Ctrl_Set_High_Speed: hspi2.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_2; break;
-    default: break;
-    }
+    hspi2.Init.BaudRatePrescaler = prescaler;
 
     /** 重新初始化 SPI 外设 **/
     HAL_SPI_Init(&hspi2);
@@ -149,6 +230,33 @@ static void _set_speed(struct sd_card* card, enum sd_user_ctrl speed)
     while (__HAL_RCC_SPI2_IS_CLK_DISABLED());
 }
 
+static void _set_speed(struct sd_card* card, enum sd_user_ctrl speed)
+{
+    switch(speed)
+    {
+    case Sd_User_Ctrl_Set_Low_Speed:  _set_prescaler(SPI_BAUDRATEPRESCALER_256); break;
+    case Sd_User_Ctrl_Set_High_Speed: _set_prescaler(SPI_BAUDRATEPRESCALER_2); break;
+    default: break;
+    }
+}
+
+static uint32_t _set_clock(struct sd_card* card, uint32_t hz)
+{
+    static const uint32_t prescalers[] =
+    {
+        SPI_BAUDRATEPRESCALER_2,  SPI_BAUDRATEPRESCALER_4,  SPI_BAUDRATEPRESCALER_8,   SPI_BAUDRATEPRESCALER_16,
+        SPI_BAUDRATEPRESCALER_32, SPI_BAUDRATEPRESCALER_64, SPI_BAUDRATEPRESCALER_128, SPI_BAUDRATEPRESCALER_256,
+    };
+    uint32_t pclk = HAL_RCC_GetPCLK1Freq();     // SPI2 挂在 APB1 上
+    uint32_t i = 0;
+
+    /** 选择不超过请求值的最高时钟，无法满足时使用 256 分频 **/
+    while(i < 7 && (pclk >> (i + 1)) > hz)
+        i++;
+    _set_prescaler(prescalers[i]);
+    return pclk >> (i + 1);
+}
+
 static int _control(struct sd_card* card, enum sd_user_ctrl ctrl)
 {
     switch(ctrl)
@@ -184,6 +292,13 @@ static struct sd_spi_interface _spi2_intf =
     .control  = _control,
     .transfer = _transfer,
     .delay_us = _delay_us,
+    .set_clock = _set_clock,
+    .rx_fill  = _rx_fill,
+#if (PORT_SPI_DMA_ENABLE == 1)
+    .xfer_start  = _xfer_start,
+    .xfer_poll   = _xfer_poll,
+    .dma_min_len = 16,
+#endif
 };
 
 static struct sd_debug_interface _debug_intf =
@@ -0,0 +1,1052 @@
+/**
+ * @file host_sim_port.c
+ * @author SouthernSandbox (https://github.com/SouthernSandbox)
+ * @brief Linux 主机端移植：基于字节级 SPI 模式 SD 卡模型实现 struct sd_spi_interface
+ * @version 0.1
+ * @date 2025-08-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ * @note 仿真模型以 MOSI 字节为输入、MISO 字节为输出，逐字节推进卡的协议状态机，覆盖 SDSC v1/v2、SDHC、SDXC 的识别流程，
+ *       CSD/CID/OCR，单块/多块读写，擦除与忙状态。所有延迟都基于仿真时钟：每个总线字节推进 8 个 SPI 时钟周期，
+ *       delay_us() 直接推进仿真时间，因此同一配置下的吞吐与延迟结果可复现。
+ */
+#define _GNU_SOURCE
+#include "sd_spi_driver.h"
+#include "host_sim_port.h"
+#include "stdarg.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "fcntl.h"
+#include "unistd.h"
+
+#define SIM_BLOCK_SIZE      512
+#define SIM_QUEUE_SIZE      1024
+
+/**
+ * @brief 卡协议状态
+ */
+enum sim_state
+{
+    Sim_St_Cmd,             // 等待命令
+    Sim_St_Read,            // 正在输出读数据（CMD17/CMD18）
+    Sim_St_Wr_Token,        // 等待写数据令牌（CMD24/CMD25）
+    Sim_St_Wr_Data,         // 接收写数据块
+    Sim_St_Busy,            // 忙（编程、擦除等）
+};
+
+/**
+ * @brief 仿真卡对象
+ */
+struct sim_card
+{
+    struct sd_sim_config    cfg;
+    struct sd_sim_stats     stats;
+    int                     fd;                 // 镜像文件
+    bool                    is_setup;
+    bool                    cs;                 // 片选是否有效
+    uint32_t                hz;                 // 当前 SPI 时钟
+    uint64_t                now_ps;             // 仿真时间（皮秒）
+    uint32_t                rng;                // 伪随机状态
+
+    /** 协议状态 **/
+    enum sim_state          state;
+    enum sim_state          state_after_busy;   // 忙结束后的状态
+    uint64_t                busy_until_ps;      // 忙结束时间
+    uint8_t                 cmd[6];             // 命令帧
+    uint8_t                 cmd_len;
+    bool                    is_idle;            // 空闲状态（R1 bit0）
+    bool                    is_app_cmd;         // 下一条命令为 ACMD
+    bool                    is_ready;           // ACMD41 初始化完成
+    bool                    is_crc_on;          // CMD59 CRC 校验
+    uint32_t                dma_left;           // 异步传输剩余的查询次数
+    bool                    is_hs;              // 已切换至高速模式
+    uint64_t                ready_at_ps;        // ACMD41 完成时间，0 表示尚未开始
+
+    /** 输出队列 **/
+    uint8_t                 queue[SIM_QUEUE_SIZE];
+    uint32_t                q_head;
+    uint32_t                q_tail;
+
+    /** 读写状态 **/
+    uint64_t                rd_block;           // 下一个要输出的块号
+    bool                    rd_multi;
+    uint64_t                rd_ready_ps;        // 数据令牌可输出的时间
+    uint64_t                wr_block;           // 下一个要写入的块号
+    bool                    wr_multi;
+    uint8_t                 wr_buf[SIM_BLOCK_SIZE + 2];
+    uint32_t                wr_pos;
+    uint32_t                wr_ok_count;        // 最近一次写操作成功写入的块数（ACMD22）
+    uint32_t                pre_erase_count;    // ACMD23 设定的预擦除块数
+    uint64_t                gc_counter;
+    uint64_t                erase_start;
+    uint64_t                erase_end;
+};
+
+static struct sim_card sim;
+
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief CRC7 计算（多项式 x^7 + x^3 + 1）
+ */
+static uint8_t _crc7(const uint8_t* buf, uint32_t len)
+{
+    uint8_t crc = 0;
+    for(uint32_t i = 0; i < len; i++)
+    {
+        uint8_t byte = buf[i];
+        for(int b = 0; b < 8; b++)
+        {
+            crc <<= 1;
+            if(((byte & 0x80) ^ (crc & 0x80)) != 0)
+                crc ^= 0x09;
+            byte <<= 1;
+        }
+    }
+    return crc & 0x7F;
+}
+
+/**
+ * @brief CRC16-CCITT 计算（多项式 0x1021，初值 0）
+ */
+static uint16_t _crc16(const uint8_t* buf, uint32_t len)
+{
+    uint16_t crc = 0;
+    for(uint32_t i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t) buf[i] << 8;
+        for(int b = 0; b < 8; b++)
+            crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+    }
+    return crc;
+}
+
+/**
+ * @brief 伪随机数（xorshift32）
+ */
+static uint32_t _rand(void)
+{
+    uint32_t x = sim.rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim.rng = x;
+    return x;
+}
+
+/**
+ * @brief 按当前配置判断本次数据块传输是否注入错误
+ */
+static bool _inject_error(void)
+{
+    uint32_t ppm = sim.cfg.crc_err_ppm;
+    if(sim.cfg.reliable_hz != 0 && sim.hz > sim.cfg.reliable_hz && sim.cfg.fast_err_ppm > ppm)
+        ppm = sim.cfg.fast_err_ppm;
+    if(ppm == 0)
+        return false;
+    if((_rand() % 1000000) >= ppm)
+        return false;
+    sim.stats.crc_errs++;
+    return true;
+}
+
+static uint64_t _us_to_ps(uint64_t us)
+{
+    return us * 1000000ULL;
+}
+
+static uint64_t _block_count(void)
+{
+    return sim.cfg.capacity / SIM_BLOCK_SIZE;
+}
+
+static bool _is_high_capacity(void)
+{
+    return sim.cfg.type == Sd_Type_SDHC || sim.cfg.type == Sd_Type_SDXC;
+}
+
+/**
+ * @brief 将命令参数转换为块号（SDSC 使用字节地址）
+ */
+static uint64_t _arg_to_block(uint32_t arg)
+{
+    return _is_high_capacity() ? arg : (arg / SIM_BLOCK_SIZE);
+}
+
+static void _q_reset(void)
+{
+    sim.q_head = sim.q_tail = 0;
+}
+
+static uint32_t _q_used(void)
+{
+    return sim.q_tail - sim.q_head;
+}
+
+static void _q_push(uint8_t byte)
+{
+    if(_q_used() < SIM_QUEUE_SIZE)
+        sim.queue[(sim.q_tail++) % SIM_QUEUE_SIZE] = byte;
+}
+
+static void _q_push_buf(const uint8_t* buf, uint32_t len)
+{
+    for(uint32_t i = 0; i < len; i++)
+        _q_push(buf[i]);
+}
+
+/**
+ * @brief 压入命令响应（前置 Ncr 个 0xFF）
+ */
+static void _q_push_resp(const uint8_t* buf, uint32_t len)
+{
+    for(uint32_t i = 0; i < sim.cfg.ncr_bytes; i++)
+        _q_push(0xFF);
+    _q_push_buf(buf, len);
+}
+
+/**
+ * @brief 压入数据包：数据令牌 + 数据 + CRC16
+ */
+static void _q_push_data_packet(const uint8_t* data, uint32_t len)
+{
+    uint16_t crc = _crc16(data, len);
+    _q_push(0xFE);
+    _q_push_buf(data, len);
+    _q_push((uint8_t) (crc >> 8));
+    _q_push((uint8_t) crc);
+}
+
+/**
+ * @brief 进入忙状态
+ */
+static void _enter_busy(uint64_t us, enum sim_state next)
+{
+    uint64_t start = sim.busy_until_ps > sim.now_ps ? sim.busy_until_ps : sim.now_ps;
+    sim.busy_until_ps = start + _us_to_ps(us);
+    sim.state = Sim_St_Busy;
+    sim.state_after_busy = next;
+    sim.stats.busy_us += us;
+}
+
+static uint8_t _r1(void)
+{
+    return sim.is_idle ? SD_FR_IN_IDLE_STATE : SD_FR_NONE;
+}
+
+static void _read_block(uint64_t block, uint8_t* buf)
+{
+    if(pread(sim.fd, buf, SIM_BLOCK_SIZE, (off_t) (block * SIM_BLOCK_SIZE)) != SIM_BLOCK_SIZE)
+        memset(buf, 0, SIM_BLOCK_SIZE);
+}
+
+static void _write_block(uint64_t block, const uint8_t* buf)
+{
+    if(pwrite(sim.fd, buf, SIM_BLOCK_SIZE, (off_t) (block * SIM_BLOCK_SIZE)) != SIM_BLOCK_SIZE)
+        fprintf(stderr, "sim: image write failed at block %llu\n", (unsigned long long) block);
+}
+
+/**
+ * @brief 擦除块区间（擦除后读出为 0）
+ */
+static void _erase_blocks(uint64_t start, uint64_t end)
+{
+    uint64_t count = end - start + 1;
+    if(fallocate(sim.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                 (off_t) (start * SIM_BLOCK_SIZE), (off_t) (count * SIM_BLOCK_SIZE)) == 0)
+        return;
+
+    static const uint8_t zero[SIM_BLOCK_SIZE];
+    for(uint64_t b = start; b <= end; b++)
+        _write_block(b, zero);
+}
+
+/**
+ * @brief 生成 CSD 寄存器
+ */
+static void _build_csd(uint8_t csd[16])
+{
+    memset(csd, 0, 16);
+    if(_is_high_capacity())
+    {
+        uint32_t c_size = (uint32_t) (sim.cfg.capacity / (512 * 1024)) - 1;
+        csd[0]  = 0x40;                         // CSD_STRUCTURE = 1
+        csd[1]  = 0x0E;                         // TAAC
+        csd[3]  = sim.is_hs ? 0x5A : 0x32;      // TRAN_SPEED：50MHz / 25MHz
+        csd[4]  = 0x5B;                         // CCC（含 class 10）
+        csd[5]  = 0x59;                         // READ_BL_LEN = 9
+        csd[7]  = (uint8_t) ((c_size >> 16) & 0x3F);
+        csd[8]  = (uint8_t) (c_size >> 8);
+        csd[9]  = (uint8_t) c_size;
+        csd[10] = 0x7F;                         // ERASE_BLK_EN = 1, SECTOR_SIZE
+        csd[11] = 0x80;
+        csd[12] = 0x0A;
+        csd[13] = 0x40;
+    }
+    else
+    {
+        /** READ_BL_LEN = 9，C_SIZE_MULT = 7，每个 C_SIZE 单位 256KB **/
+        uint32_t c_size = (uint32_t) (sim.cfg.capacity / (256 * 1024)) - 1;
+        csd[1]  = 0x26;
+        csd[3]  = sim.is_hs ? 0x5A : 0x32;
+        csd[4]  = sim.cfg.type == Sd_Type_SDSC_V1 ? 0x1F : 0x5F;   // v1 卡不支持 class 10（CMD6）
+        csd[5]  = 0x59;
+        csd[6]  = (uint8_t) ((c_size >> 10) & 0x03);
+        csd[7]  = (uint8_t) (c_size >> 2);
+        csd[8]  = (uint8_t) ((c_size & 0x03) << 6);
+        csd[9]  = 0x03;                         // C_SIZE_MULT[2:1]
+        csd[10] = 0x80 | 0x40 | 0x3F;           // C_SIZE_MULT[0]，ERASE_BLK_EN，SECTOR_SIZE
+        csd[11] = 0x80;
+        csd[12] = 0x0A;
+        csd[13] = 0x40;
+    }
+    csd[15] = (uint8_t) ((_crc7(csd, 15) << 1) | 0x01);
+}
+
+/**
+ * @brief 生成 CID 寄存器
+ */
+static void _build_cid(uint8_t cid[16])
+{
+    static const uint8_t base[15] = { 0x03, 'S', 'D', 'S', 'I', 'M', '0', '1', 0x10, 0x12, 0x34, 0x56, 0x78, 0x01, 0x9A };
+    memcpy(cid, base, sizeof(base));
+    cid[15] = (uint8_t) ((_crc7(cid, 15) << 1) | 0x01);
+}
+
+/**
+ * @brief 生成 CMD6 的 64 字节功能状态
+ */
+static void _build_switch_status(uint32_t arg, uint8_t status[64])
+{
+    uint8_t fn = arg & 0x0F;
+    bool is_switch = (arg & 0x80000000) != 0;
+
+    memset(status, 0, 64);
+    status[1]  = 100;                           // 最大电流 100mA
+    status[13] = 0x03;                          // 功能组 1 支持：默认速度与高速
+    status[17] = 0x01;                          // 数据结构版本
+
+    if(fn == 0x0F)
+        fn = sim.is_hs ? 1 : 0;
+    if(fn > 1)
+        status[16] = 0x0F;                      // 不支持的功能
+    else
+    {
+        status[16] = fn;
+        if(is_switch)
+            sim.is_hs = (fn == 1);
+    }
+}
+
+/**
+ * @brief 处理一条完整的命令帧
+ */
+static void _handle_cmd(void)
+{
+    uint8_t  idx = sim.cmd[0] & 0x3F;
+    uint32_t arg = ((uint32_t) sim.cmd[1] << 24) | ((uint32_t) sim.cmd[2] << 16) | ((uint32_t) sim.cmd[3] << 8) | sim.cmd[4];
+    bool     is_app = sim.is_app_cmd;
+    uint8_t  r1;
+
+    sim.is_app_cmd = false;
+    sim.stats.cmds++;
+
+    /** 读过程中仅响应 CMD12：先输出填充字节，再输出 R1 **/
+    if(sim.state == Sim_St_Read)
+    {
+        if(idx != 12)
+            return;
+        _q_reset();
+        _q_push(0x3C);                          // stuff byte
+        uint8_t resp = _r1();
+        _q_push_resp(&resp, 1);
+        sim.state = Sim_St_Cmd;
+        _enter_busy(2, Sim_St_Cmd);
+        return;
+    }
+
+    /** CRC 校验：CMD0 与 CMD8 始终校验，其余命令在 CMD59 打开后校验 **/
+    if(sim.is_crc_on || idx == 0 || idx == 8)
+    {
+        if(((sim.cmd[5] >> 1) & 0x7F) != _crc7(sim.cmd, 5) || (sim.cmd[5] & 0x01) == 0)
+        {
+            r1 = _r1() | SD_FR_COM_CRC_ERROR;
+            _q_push_resp(&r1, 1);
+            return;
+        }
+    }
+
+    /** 未完成初始化前，仅允许识别相关命令 **/
+    if(!sim.is_ready && !(idx == 0 || idx == 8 || idx == 55 || idx == 58 || idx == 59 || (is_app && idx == 41)))
+    {
+        r1 = _r1() | SD_FR_ILLEGAL_COMMAND;
+        _q_push_resp(&r1, 1);
+        return;
+    }
+
+    if(is_app)
+    {
+        switch(idx)
+        {
+        case 41:
+            if(sim.ready_at_ps == 0)
+                sim.ready_at_ps = sim.now_ps + _us_to_ps(sim.cfg.init_us);
+            /** SDHC/SDXC 卡在主机未声明 HCS 时始终保持空闲 **/
+            if(sim.now_ps >= sim.ready_at_ps && (!_is_high_capacity() || (arg & 0x40000000)))
+            {
+                sim.is_ready = true;
+                sim.is_idle = false;
+            }
+            r1 = _r1();
+            _q_push_resp(&r1, 1);
+            return;
+
+        case 22:
+            {
+                uint8_t r = _r1();
+                uint8_t num[4] = { (uint8_t) (sim.wr_ok_count >> 24), (uint8_t) (sim.wr_ok_count >> 16),
+                                   (uint8_t) (sim.wr_ok_count >> 8), (uint8_t) sim.wr_ok_count };
+                _q_push_resp(&r, 1);
+                _q_push(0xFF);
+                _q_push_data_packet(num, sizeof(num));
+            }
+            return;
+
+        case 23:
+            sim.pre_erase_count = arg & 0x7FFFFF;
+            r1 = _r1();
+            _q_push_resp(&r1, 1);
+            return;
+
+        default:
+            break;      // 其他 ACMD 按普通命令处理
+        }
+    }
+
+    switch(idx)
+    {
+    case 0:
+        sim.is_idle = true;
+        sim.is_ready = false;
+        sim.is_crc_on = false;
+        sim.is_hs = false;
+        sim.ready_at_ps = 0;
+        r1 = _r1();
+        _q_push_resp(&r1, 1);
+        break;
+
+    case 8:
+        if(sim.cfg.type == Sd_Type_SDSC_V1)
+        {
+            r1 = _r1() | SD_FR_ILLEGAL_COMMAND;
+            _q_push_resp(&r1, 1);
+        }
+        else
+        {
+            uint8_t r7[5] = { _r1(), 0x00, 0x00, (uint8_t) ((arg >> 8) & 0x0F), (uint8_t) arg };
+            _q_push_resp(r7, sizeof(r7));
+        }
+        break;
+
+    case 6:
+        if(sim.cfg.type == Sd_Type_SDSC_V1)
+        {
+            r1 = _r1() | SD_FR_ILLEGAL_COMMAND;
+            _q_push_resp(&r1, 1);
+        }
+        else
+        {
+            uint8_t status[64];
+            r1 = _r1();
+            _build_switch_status(arg, status);
+            _q_push_resp(&r1, 1);
+            _q_push(0xFF);
+            _q_push_data_packet(status, sizeof(status));
+        }
+        break;
+
+    case 9:
+    case 10:
+        {
+            uint8_t reg[16];
+            if(idx == 9)
+                _build_csd(reg);
+            else
+                _build_cid(reg);
+            r1 = _r1();
+            _q_push_resp(&r1, 1);
+            _q_push(0xFF);
+            _q_push_data_packet(reg, sizeof(reg));
+        }
+        break;
+
+    case 12:
+        r1 = _r1();
+        _q_push_resp(&r1, 1);
+        break;
+
+    case 13:
+        {
+            uint8_t r2[2] = { _r1(), 0x00 };
+            _q_push_resp(r2, sizeof(r2));
+        }
+        break;
+
+    case 16:
+        r1 = _r1() | ((!_is_high_capacity() && arg != SIM_BLOCK_SIZE) ? SD_FR_PARAMETER_ERROR : 0);
+        _q_push_resp(&r1, 1);
+        break;
+
+    case 17:
+    case 18:
+        if(_arg_to_block(arg) >= _block_count())
+        {
+            r1 = _r1() | SD_FR_PARAMETER_ERROR;
+            _q_push_resp(&r1, 1);
+            break;
+        }
+        r1 = _r1();
+        _q_push_resp(&r1, 1);
+        sim.rd_block = _arg_to_block(arg);
+        sim.rd_multi = (idx == 18);
+        sim.rd_ready_ps = sim.now_ps + _us_to_ps(sim.cfg.nac_us);
+        sim.state = Sim_St_Read;
+        break;
+
+    case 24:
+    case 25:
+        if(_arg_to_block(arg) >= _block_count())
+        {
+            r1 = _r1() | SD_FR_PARAMETER_ERROR;
+            _q_push_resp(&r1, 1);
+            break;
+        }
+        r1 = _r1();
+        _q_push_resp(&r1, 1);
+        sim.wr_block = _arg_to_block(arg);
+        sim.wr_multi = (idx == 25);
+        sim.wr_ok_count = 0;
+        sim.state = Sim_St_Wr_Token;
+        break;
+
+    case 32:
+    case 33:
+        if(idx == 32)
+            sim.erase_start = _arg_to_block(arg);
+        else
+            sim.erase_end = _arg_to_block(arg);
+        r1 = _r1();
+        _q_push_resp(&r1, 1);
+        break;
+
+    case 38:
+        {
+            uint64_t end = sim.erase_end < _block_count() ? sim.erase_end : _block_count() - 1;
+            r1 = _r1();
+            _q_push_resp(&r1, 1);
+            if(sim.erase_start > end)
+                break;
+            _erase_blocks(sim.erase_start, end);
+            uint64_t mb = ((end - sim.erase_start + 1) * SIM_BLOCK_SIZE) >> 20;
+            _enter_busy(sim.cfg.erase_us + mb * sim.cfg.erase_us_per_mb, Sim_St_Cmd);
+        }
+        break;
+
+    case 55:
+        sim.is_app_cmd = true;
+        r1 = _r1();
+        _q_push_resp(&r1, 1);
+        break;
+
+    case 58:
+        {
+            uint32_t ocr = 0x00FF8000;
+            if(sim.is_ready)
+                ocr |= 0x80000000 | (_is_high_capacity() ? 0x40000000 : 0);
+            uint8_t r3[5] = { _r1(), (uint8_t) (ocr >> 24), (uint8_t) (ocr >> 16), (uint8_t) (ocr >> 8), (uint8_t) ocr };
+            _q_push_resp(r3, sizeof(r3));
+        }
+        break;
+
+    case 59:
+        sim.is_crc_on = (arg & 0x01) != 0;
+        r1 = _r1();
+        _q_push_resp(&r1, 1);
+        break;
+
+    default:
+        r1 = _r1() | SD_FR_ILLEGAL_COMMAND;
+        _q_push_resp(&r1, 1);
+        break;
+    }
+}
+
+/**
+ * @brief 计算一次写操作结束时的读改写时间
+ * @note 卡按擦除单元管理闪存，每次写操作结束时需要对涉及的每个擦除单元执行一次读改写（合并旧数据、擦除、回写），
+ *       与写入的块数无关，因此逐块 CMD24 每块都要付出一次，CMD25 只在停止令牌后付出一次。
+ *       ACMD23 预擦除的块（从写操作的起始块开始）已提前擦除，不再计入。
+ * @return uint64_t [out] 读改写时间（微秒）
+ */
+static uint64_t _rmw_us(void)
+{
+    uint64_t unit = sim.cfg.rmw_unit ? sim.cfg.rmw_unit : 64;
+    uint64_t first = sim.wr_block - sim.wr_ok_count;        // 本次写操作的起始块
+    uint64_t from = first + (sim.wr_multi ? sim.pre_erase_count : 0);
+
+    sim.pre_erase_count = 0;
+    if(sim.wr_ok_count == 0 || from >= sim.wr_block)
+        return 0;
+    return (((sim.wr_block - 1) / unit) - (from / unit) + 1) * sim.cfg.rmw_us;
+}
+
+/**
+ * @brief 写数据块接收完成
+ */
+static void _finish_write_block(void)
+{
+    uint16_t crc = ((uint16_t) sim.wr_buf[SIM_BLOCK_SIZE] << 8) | sim.wr_buf[SIM_BLOCK_SIZE + 1];
+    bool is_corrupted = _inject_error();
+    uint64_t prog_us = sim.cfg.prog_us;
+
+    /** 总线错误：CRC 打开时卡拒绝该块，关闭时损坏的数据被静默写入 **/
+    if(is_corrupted)
+        sim.wr_buf[_rand() % SIM_BLOCK_SIZE] ^= 0x10;
+
+    if(sim.is_crc_on && crc != _crc16(sim.wr_buf, SIM_BLOCK_SIZE))
+    {
+        _q_push(0xEB);
+        _enter_busy(1, sim.wr_multi ? Sim_St_Wr_Token : Sim_St_Cmd);
+        return;
+    }
+    if(sim.wr_block >= _block_count())
+    {
+        _q_push(0xED);
+        _enter_busy(1, sim.wr_multi ? Sim_St_Wr_Token : Sim_St_Cmd);
+        return;
+    }
+
+    _write_block(sim.wr_block++, sim.wr_buf);
+    sim.wr_ok_count++;
+    if(sim.cfg.gc_every != 0 && (++sim.gc_counter % sim.cfg.gc_every) == 0)
+        prog_us += sim.cfg.gc_us;
+    if(!sim.wr_multi)
+        prog_us += _rmw_us();
+
+    _q_push(0xE5);
+    _enter_busy(prog_us, sim.wr_multi ? Sim_St_Wr_Token : Sim_St_Cmd);
+}
+
+/**
+ * @brief 读状态下补充输出队列
+ */
+static void _feed_read(void)
+{
+    if(_q_used() != 0 || sim.now_ps < sim.rd_ready_ps)
+        return;
+
+    if(sim.rd_block >= _block_count())
+    {
+        sim.state = Sim_St_Cmd;
+        return;
+    }
+
+    uint8_t data[SIM_BLOCK_SIZE];
+    _read_block(sim.rd_block++, data);
+    uint16_t crc = _crc16(data, SIM_BLOCK_SIZE);
+    if(_inject_error())
+        data[_rand() % SIM_BLOCK_SIZE] ^= 0x01;
+
+    _q_push(0xFE);
+    _q_push_buf(data, SIM_BLOCK_SIZE);
+    _q_push((uint8_t) (crc >> 8));
+    _q_push((uint8_t) crc);
+
+    if(sim.rd_multi)
+        sim.rd_ready_ps = sim.now_ps + _us_to_ps(sim.cfg.nac_us);
+    else
+        sim.state = Sim_St_Cmd;
+}
+
+/**
+ * @brief 交换一个字节
+ * @param mosi      [in]  主机发送的字节
+ * @return uint8_t  [out] 卡输出的字节
+ */
+static uint8_t _xchg(uint8_t mosi)
+{
+    uint8_t miso = 0xFF;
+
+    sim.now_ps += 8000000000000ULL / sim.hz;
+    if(!sim.cs)
+    {
+        sim.stats.idle_bytes++;
+        return 0xFF;
+    }
+    sim.stats.bytes++;
+
+    /** 1. 输出：队列优先，其次为忙状态或读数据 **/
+    if(sim.state == Sim_St_Busy && _q_used() == 0)
+    {
+        if(sim.now_ps < sim.busy_until_ps)
+            return 0x00;
+        sim.state = sim.state_after_busy;
+    }
+    if(sim.state == Sim_St_Read)
+        _feed_read();
+    if(_q_used() != 0)
+        miso = sim.queue[(sim.q_head++) % SIM_QUEUE_SIZE];
+
+    /** 2. 输入：按状态解析主机数据 **/
+    switch(sim.state)
+    {
+    case Sim_St_Cmd:
+    case Sim_St_Read:
+        if(sim.cmd_len == 0 && (mosi & 0xC0) != 0x40)
+            break;
+        sim.cmd[sim.cmd_len++] = mosi;
+        if(sim.cmd_len == sizeof(sim.cmd))
+        {
+            sim.cmd_len = 0;
+            _handle_cmd();
+        }
+        break;
+
+    case Sim_St_Wr_Token:
+        if(_q_used() != 0)
+            break;
+        if((mosi == 0xFE && !sim.wr_multi) || (mosi == 0xFC && sim.wr_multi))
+        {
+            sim.wr_pos = 0;
+            sim.state = Sim_St_Wr_Data;
+        }
+        else if(mosi == 0xFD && sim.wr_multi)
+        {
+            uint64_t us = sim.cfg.stop_us + _rmw_us();
+            _q_push(0xFF);
+            _enter_busy(us, Sim_St_Cmd);
+        }
+        break;
+
+    case Sim_St_Wr_Data:
+        sim.wr_buf[sim.wr_pos++] = mosi;
+        if(sim.wr_pos == sizeof(sim.wr_buf))
+            _finish_write_block();
+        break;
+
+    case Sim_St_Busy:
+        break;
+    }
+
+    return miso;
+}
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 记录一次端口数据传输调用，并按配置推进调用的固定开销
+ */
+static void _port_call(void)
+{
+    sim.stats.xfer_calls++;
+    sim.now_ps += (uint64_t) sim.cfg.call_ns * 1000ULL;
+}
+
+static int _transfer(struct sd_card* card, struct sd_spi_buf* tx, struct sd_spi_buf* rx)
+{
+    (void) card;
+    _port_call();
+
+    if(tx)
+    {
+        for(tx->used = 0; tx->used < tx->size; tx->used++)
+            _xchg(((uint8_t*) tx->data)[tx->used]);
+    }
+
+    if(rx)
+    {
+        for(rx->used = 0; rx->used < rx->size; rx->used++)
+            ((uint8_t*) rx->data)[rx->used] = _xchg(0xFF);
+    }
+
+    return 0;
+}
+
+static int _rx_fill(struct sd_card* card, void* rx, size_t len)
+{
+    (void) card;
+    _port_call();
+    for(size_t i = 0; i < len; i++)
+        ((uint8_t*) rx)[i] = _xchg(0xFF);
+    return 0;
+}
+
+static int _duplex(struct sd_card* card, const void* tx, void* rx, size_t len)
+{
+    (void) card;
+    _port_call();
+    for(size_t i = 0; i < len; i++)
+    {
+        uint8_t b = _xchg(((const uint8_t*) tx)[i]);
+        if(rx != NULL)
+            ((uint8_t*) rx)[i] = b;
+    }
+    return 0;
+}
+
+static int _xfer_start(struct sd_card* card, const void* tx, void* rx, size_t len)
+{
+    (void) card;
+    if(sim.dma_left != 0 || (sim.cfg.dma_align > 1 && (((uintptr_t) tx | (uintptr_t) rx | len) & (sim.cfg.dma_align - 1)) != 0))
+        return -1;
+    _port_call();
+    sim.stats.dma_starts++;
+    for(size_t i = 0; i < len; i++)
+    {
+        uint8_t b = _xchg(tx != NULL ? ((const uint8_t*) tx)[i] : 0xFF);
+        if(rx != NULL)
+            ((uint8_t*) rx)[i] = b;
+    }
+    sim.dma_left = sim.cfg.dma_polls + 1;
+    return 0;
+}
+
+static int _xfer_poll(struct sd_card* card)
+{
+    (void) card;
+    if(sim.dma_left == 0)
+        return -1;
+    return (--sim.dma_left == 0) ? 0 : 1;
+}
+
+static void _delay_us(struct sd_card* card, uint32_t us)
+{
+    (void) card;
+    sim.now_ps += _us_to_ps(us);
+}
+
+static uint32_t _now_us(struct sd_card* card)
+{
+    (void) card;
+    return (uint32_t) sd_sim_now_us();
+}
+
+static int _control(struct sd_card* card, enum sd_user_ctrl ctrl)
+{
+    (void) card;
+    sim.stats.ctrl_calls++;
+
+    switch(ctrl)
+    {
+    case Sd_User_Ctrl_Init_Hardware:     return sim.is_setup ? 0 : -1;
+    case Sd_User_Ctrl_Deinit_Hardware:   break;
+    case Sd_User_Ctrl_Is_Card_Detached:  return sim.is_setup ? -1 : 0;
+
+    case Sd_User_Ctrl_Select_Card:       sim.cs = true; break;
+    case Sd_User_Ctrl_Deselect_Card:     sim.cs = false; sim.cmd_len = 0; break;
+
+    case Sd_User_Ctrl_Take_Bus:          break;
+    case Sd_User_Ctrl_Release_Bus:       break;
+
+    case Sd_User_Ctrl_Set_Low_Speed:     sim.hz = sim.cfg.low_hz; break;
+    case Sd_User_Ctrl_Set_High_Speed:    sim.hz = sim.cfg.high_hz; break;
+    }
+    return 0;
+}
+
+static uint32_t _set_clock(struct sd_card* card, uint32_t hz)
+{
+    (void) card;
+    uint32_t div = 2;
+
+    /** 模拟 SPI 外设的 2 的幂分频器：取不超过请求值的最高时钟，无法满足时取最大分频 **/
+    while(div < 256 && sim.cfg.clk_src_hz / div > hz)
+        div <<= 1;
+    sim.hz = sim.cfg.clk_src_hz / div;
+    return sim.hz;
+}
+
+static void _print(struct sd_card* card, const char* format, ...)
+{
+    (void) card;
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+static struct sd_spi_interface _sim_intf =
+{
+    .control  = _control,
+    .transfer = _transfer,
+    .delay_us = _delay_us,
+    .now_us   = _now_us,
+};
+
+static struct sd_debug_interface _debug_intf =
+{
+    .print = _print,
+};
+
+/**
+ * @brief sd_card 对象
+ */
+struct sd_card card0 = SD_CARD_OBJ_INIT("card0", &_sim_intf, &_debug_intf);
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 获取默认仿真配置
+ * @param cfg   [out] 配置
+ * @param type  [in]  卡类型
+ */
+void sd_sim_config_default (struct sd_sim_config* cfg, enum sd_type type)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->type            = type;
+    cfg->low_hz          = 400000;
+    cfg->high_hz         = 18000000;
+    cfg->ncr_bytes       = 1;
+    cfg->nac_us          = 10;
+    cfg->init_us         = 50000;
+    cfg->prog_us         = 250;
+    cfg->stop_us         = 100;
+    cfg->rmw_us          = 2000;
+    cfg->rmw_unit        = 64;
+    cfg->erase_us        = 2000;
+    cfg->erase_us_per_mb = 100;
+    cfg->seed            = 0x12345678;
+
+    switch(type)
+    {
+    case Sd_Type_SDSC_V1:
+    case Sd_Type_SDSC_V2:   cfg->capacity = 1ULL << 30; break;
+    case Sd_Type_SDHC:      cfg->capacity = 4ULL << 30; break;
+    default:                cfg->capacity = 64ULL << 30; break;
+    }
+}
+
+/**
+ * @brief 按配置建立仿真卡（需在 sd_card_init() 之前调用）
+ * @param cfg   [in]  配置
+ * @return int  [out] 成功返回 0，失败返回 -1
+ */
+int sd_sim_setup (const struct sd_sim_config* cfg)
+{
+    sd_sim_teardown();
+    memset(&sim, 0, sizeof(sim));
+    sim.cfg = *cfg;
+    sim.rng = cfg->seed != 0 ? cfg->seed : 1;
+    sim.hz  = cfg->low_hz;
+    if(sim.cfg.ncr_bytes == 0 || sim.cfg.ncr_bytes > 8)
+        sim.cfg.ncr_bytes = 1;
+
+    if(cfg->image_path != NULL)
+        sim.fd = open(cfg->image_path, O_RDWR | O_CREAT, 0644);
+    else
+    {
+        char path[] = "/tmp/sd_sim_XXXXXX";
+        sim.fd = mkstemp(path);
+        if(sim.fd >= 0)
+            unlink(path);
+    }
+    if(sim.fd < 0 || ftruncate(sim.fd, (off_t) cfg->capacity) != 0)
+        return -1;
+
+    _sim_intf.set_clock   = (cfg->clk_src_hz != 0) ? _set_clock : NULL;
+    _sim_intf.rx_fill     = (cfg->bulk & SD_SIM_BULK_RX_FILL) ? _rx_fill : NULL;
+    _sim_intf.duplex      = (cfg->bulk & SD_SIM_BULK_DUPLEX) ? _duplex : NULL;
+    _sim_intf.xfer_start  = (cfg->bulk & SD_SIM_BULK_DMA) ? _xfer_start : NULL;
+    _sim_intf.xfer_poll   = (cfg->bulk & SD_SIM_BULK_DMA) ? _xfer_poll : NULL;
+    _sim_intf.dma_align   = cfg->dma_align;
+    _sim_intf.dma_min_len = cfg->dma_min_len;
+
+    sim.is_setup = true;
+    return 0;
+}
+
+/**
+ * @brief 释放仿真卡
+ */
+void sd_sim_teardown (void)
+{
+    if(sim.is_setup && sim.fd >= 0)
+        close(sim.fd);
+    sim.is_setup = false;
+}
+
+/**
+ * @brief 获取仿真总线统计
+ * @param stats [out] 统计信息
+ */
+void sd_sim_get_stats (struct sd_sim_stats* stats)
+{
+    *stats = sim.stats;
+}
+
+/**
+ * @brief 清零仿真总线统计
+ */
+void sd_sim_reset_stats (void)
+{
+    memset(&sim.stats, 0, sizeof(sim.stats));
+}
+
+/**
+ * @brief 推进仿真时钟，模拟主机在两次访问之间的空闲时间
+ * @param us    [in]  推进的时间，单位：微秒
+ */
+void sd_sim_advance_us (uint64_t us)
+{
+    sim.now_ps += _us_to_ps(us);
+}
+
+/**
+ * @brief 获取仿真时间
+ * @return uint64_t [out] 仿真时间，单位：微秒
+ */
+uint64_t sd_sim_now_us (void)
+{
+    return sim.now_ps / 1000000ULL;
+}
+
+/**
+ * @brief 获取当前 SPI 时钟频率
+ * @return uint32_t [out] 频率，单位：Hz
+ */
+uint32_t sd_sim_get_hz (void)
+{
+    return sim.hz;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file host_sim_port.h
+ * @author SouthernSandbox (https://github.com/SouthernSandbox)
+ * @brief Linux 主机端 SPI 模式 SD 卡仿真移植接口
+ * @version 0.1
+ * @date 2025-08-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#ifndef HOST_SIM_PORT_H
+#define HOST_SIM_PORT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sd_def.h"
+
+/**
+ * @brief 仿真卡配置
+ * @note 所有时间参数均基于仿真时钟（由 SPI 时钟频率和 delay_us() 推进），与主机真实时间无关，因此结果可复现。
+ */
+struct sd_sim_config
+{
+    enum sd_type    type;               // 卡类型：SDSC_V1 / SDSC_V2 / SDHC / SDXC
+    uint64_t        capacity;           // 容量（字节）
+    const char*     image_path;         // 稀疏镜像文件路径，NULL 则使用临时文件
+
+    uint32_t        low_hz;             // 低速时钟（Hz）
+    uint32_t        high_hz;            // 高速时钟（Hz）
+    uint32_t        reliable_hz;        // 可靠时钟上限，超过后按 fast_err_ppm 注入 CRC 错误（0 表示不限制）
+    uint32_t        clk_src_hz;         // 提供 set_clock() 时的时钟源（Hz），实际时钟为其 2~256 的 2 的幂分频（0 表示不提供，只有 low_hz/high_hz）
+
+    uint32_t        ncr_bytes;          // 命令到响应的间隔字节数（1~8）
+    uint32_t        nac_us;             // 读访问时间（命令到数据令牌）
+    uint32_t        init_us;            // ACMD41 初始化完成所需时间
+    uint32_t        prog_us;            // 单块编程时间
+    uint32_t        stop_us;            // 多块写停止令牌后的收尾时间
+    uint32_t        rmw_us;             // 每次写操作（CMD24 或一次 CMD25）涉及的每个擦除单元的读改写时间，ACMD23 预擦除覆盖的块不计
+    uint32_t        rmw_unit;           // 读改写的擦除单元大小（块），0 表示按 64 块
+    uint32_t        erase_us;           // 单次擦除的基本时间
+    uint32_t        erase_us_per_mb;    // 每 MB 擦除时间
+    uint32_t        gc_every;           // 每写入多少块触发一次垃圾回收停顿（0 关闭）
+    uint32_t        gc_us;              // 垃圾回收停顿时间
+    uint32_t        crc_err_ppm;        // 数据块传输错误注入率（百万分之一）
+    uint32_t        fast_err_ppm;       // 超过 reliable_hz 时的数据块传输错误率（百万分之一）
+    uint32_t        seed;               // 伪随机种子
+    uint32_t        call_ns;            // 每次调用端口数据传输接口的固定开销（纳秒），模拟函数调用、外设启动、RTOS 锁等
+
+    uint32_t        bulk;               // 端口提供的批量传输能力：SD_SIM_BULK_XXX 的按位组合
+    uint16_t        dma_align;          // 异步传输的对齐要求（字节）
+    uint16_t        dma_min_len;        // 使用异步传输的最小长度
+    uint32_t        dma_polls;          // 异步传输启动后，查询多少次才完成
+};
+
+#define SD_SIM_BULK_RX_FILL     (1 << 0)    // 提供 rx_fill()
+#define SD_SIM_BULK_DUPLEX      (1 << 1)    // 提供 duplex()
+#define SD_SIM_BULK_DMA         (1 << 2)    // 提供 xfer_start()/xfer_poll()
+
+/**
+ * @brief 仿真总线统计
+ */
+struct sd_sim_stats
+{
+    uint64_t bytes;             // 片选有效期间的总线字节数
+    uint64_t idle_bytes;        // 片选无效期间的总线字节数
+    uint64_t xfer_calls;        // transfer() 及批量传输接口的调用次数
+    uint64_t dma_starts;        // xfer_start() 调用次数
+    uint64_t ctrl_calls;        // control() 调用次数
+    uint64_t cmds;              // 卡接收的命令数
+    uint64_t crc_errs;          // 注入的数据错误次数
+    uint64_t busy_us;           // 卡处于忙状态的总时间
+};
+
+void     sd_sim_config_default  (struct sd_sim_config* cfg, enum sd_type type);
+int      sd_sim_setup           (const struct sd_sim_config* cfg);
+void     sd_sim_teardown        (void);
+void     sd_sim_get_stats       (struct sd_sim_stats* stats);
+void     sd_sim_reset_stats     (void);
+uint64_t sd_sim_now_us          (void);
+void     sd_sim_advance_us      (uint64_t us);
+uint32_t sd_sim_get_hz          (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // HOST_SIM_PORT_H
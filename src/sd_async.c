@@ -0,0 +1,768 @@
+/**
+ * @file sd_async.c
+ * @author SouthernSandbox (https://github.com/SouthernSandbox)
+ * @brief 非阻塞的异步请求接口，将读、写、擦除拆分为耗时有界的步骤，由用户在主循环中驱动
+ * @version 0.1
+ * @date 2025-08-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "sd_spi_driver.h"
+#include "sd_private.h"
+
+#define SD_TRACE_FILE_ID    1           // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
+/**
+ * @brief 异步请求状态机的状态
+ */
+enum sd_async_state
+{
+    Sd_Async_Idle,          // 空闲
+    Sd_Async_Wait_Ready,    // 等待卡退出上一次推迟的写入编程忙状态
+    Sd_Async_Send_Cmd,      // 发送读/写/擦除命令并检查 R1 响应
+    Sd_Async_Rd_Token,      // 等待数据令牌
+    Sd_Async_Rd_Data,       // 接收一段数据
+    Sd_Async_Rd_Stop,       // 发送 CMD12 结束多块读取
+    Sd_Async_Wr_Data,       // 发送一段数据
+    Sd_Async_Wr_Busy,       // 等待当前数据块编程完成
+    Sd_Async_Wr_Stop,       // 发送停止令牌结束多块写入
+    Sd_Async_Busy,          // 等待最终的忙状态结束（CMD12、停止令牌、CMD38 之后）
+    Sd_Async_Done,          // 执行完毕，等待收尾
+};
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 进入一个需要等待卡的状态，并记录起始时间
+ * @param card          [in]  SD卡对象
+ * @param state         [in]  新状态
+ * @param timeout_us    [in]  该状态的超时时间，单位：微秒
+ */
+static void _enter_wait(struct sd_card *card, enum sd_async_state state, uint32_t timeout_us)
+{
+    card->async.state = state;
+    card->async.t_start = sd_spi_hw_now_us(card);
+    card->async.timeout_us = timeout_us;
+}
+
+/**
+ * @brief 轮询总线，至多读取 SD_SPI_POLL_FAST_COUNT 个字节（按 SD_SPI_XFER_SCAN_CHUNK 分块读取）
+ * @param card              [in]  SD卡对象
+ * @param until_ready       [in]  true：等待 0xFF（退出忙状态）；false：等待非 0xFF 的字节（数据令牌）
+ * @param byte              [out] 最后读到的字节
+ * @return enum sd_error    [out] 错误码，条件满足返回 Sd_Err_OK，尚未满足返回 Sd_Err_No_Ready，等待超时返回 Sd_Err_Timeout
+ */
+static enum sd_error _poll_bus(struct sd_card *card, bool until_ready, uint8_t *byte)
+{
+    enum sd_error err = Sd_Err_OK;
+    uint32_t polls = 0;
+
+    *byte = until_ready ? 0x00 : 0xFF;
+    if ((err = sd_spi_hw_scan(card, until_ready, SD_SPI_POLL_FAST_COUNT, byte, &polls)) != Sd_Err_OK)
+        return err;
+
+#if (SD_SPI_STATS_ENABLE == 1)
+    stats_begin(card);
+    if (!until_ready)
+        card->stats.token_waits += polls;
+    else
+    {
+        card->stats.busy_waits += polls;
+        if (*byte == 0xFF)
+            card->stats.busy_us += (uint32_t)(sd_spi_hw_now_us(card) - card->async.t_start);
+    }
+    stats_end(card);
+#else
+    (void) polls;
+#endif
+
+#if (SD_SPI_LATENCY_ENABLE == 1)
+    /** 记录等待阶段的耗时，多块读取结束（CMD12）后的忙状态不属于写入忙 **/
+    if ((*byte == 0xFF) == until_ready)
+    {
+        if (!until_ready)
+            sd_lat_record(card, Sd_Lat_Token_Wait, card->async.t_start);
+        else if (card->async.req->op == Sd_Req_Op_Erase && card->async.state == Sd_Async_Busy)
+            sd_lat_record(card, Sd_Lat_Erase, card->async.t_start);
+        else if (card->async.req->op == Sd_Req_Op_Write || card->async.state == Sd_Async_Wait_Ready)
+            sd_lat_record(card, Sd_Lat_Write_Busy, card->async.t_start);
+    }
+#endif
+
+    if ((*byte == 0xFF) == until_ready)
+        return Sd_Err_OK;
+
+    if ((uint32_t)(sd_spi_hw_now_us(card) - card->async.t_start) > card->async.timeout_us)
+        return Sd_Err_Timeout;
+    return Sd_Err_No_Ready;
+}
+
+/**
+ * @brief 发送 R1 响应的命令，并检查响应
+ * @param card              [in]  SD卡对象
+ * @param cmd               [in]  命令索引
+ * @param arg               [in]  命令参数
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _send_cmd(struct sd_card *card, enum sd_cmd_index cmd, uint32_t arg)
+{
+    enum sd_error err = Sd_Err_OK;
+    struct sd_cmd_req req =
+    {
+        .cmd = cmd, .arg = arg, .crc = SD_CMD_CRC_AUTO,
+        .resp_type = Sd_Resp_Type_R1, .retry = 5
+    };
+
+    struct sd_resp_res resp = {0};
+    if ((err = sd_card_send_cmd_req(card, &req, &resp)) != Sd_Err_OK)
+        return err;
+
+    if (resp.buf[0] != SD_FR_NONE)
+    {
+        trace_e(card, "CMD%d error: 0x%02X", (cmd & ~0x40) & 0x3F, resp.buf[0]);
+        return Sd_Err_Response;
+    }
+
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 记录错误，保留第一次出现的错误
+ * @param card  [in]  SD卡对象
+ * @param err   [in]  错误码
+ */
+static void _set_error(struct sd_card *card, enum sd_error err)
+{
+    if (card->async.err == Sd_Err_OK)
+        card->async.err = err;
+}
+
+#if (SD_SPI_CRC_ENABLE == 1)
+/**
+ * @brief 当前块出现CRC错误，判断是否重传该块
+ * @param card      [in]  SD卡对象
+ * @return true     [out] 重传该块，已完成的块不受影响
+ * @return false    [out] 该块的重传次数已用完
+ */
+static bool _retry_block(struct sd_card *card)
+{
+    struct sd_async *ctx = &card->async;
+
+    if (ctx->crc_errs < UINT8_MAX)
+        ctx->crc_errs++;
+    if (ctx->retries >= SD_SPI_CRC_RETRY)
+        return false;
+
+    ctx->retries++;
+    ctx->is_resume = true;
+    trace_w(card, "CRC error at lba[%d], retry %d", ctx->arg, ctx->retries);
+    return true;
+}
+#endif
+
+/**
+ * @brief 收发块内的一段数据
+ * @note 端口支持异步传输（xfer_start/xfer_poll）且满足对齐要求时，一次启动块内剩余的全部数据后返回 Sd_Err_No_Ready，
+ *       之后每次推进查询一次，完成后返回 Sd_Err_OK；否则同步收发不超过 SD_SPI_ASYNC_CHUNK_SIZE 字节。
+ * @param card              [in]  SD卡对象
+ * @param ptr               [in]  块内当前位置（用户缓冲区）
+ * @param n                 [in]  块内剩余的字节数；[out] 本次完成的字节数
+ * @param is_write          [in]  true：发送；false：接收
+ * @return enum sd_error    [out] 错误码，异步传输仍在进行时返回 Sd_Err_No_Ready
+ */
+static enum sd_error _xfer_chunk(struct sd_card *card, uint8_t *ptr, uint32_t *n, bool is_write)
+{
+    struct sd_async *ctx = &card->async;
+    enum sd_error err = Sd_Err_OK;
+
+    /** 1. 查询已启动的异步传输 **/
+    if (ctx->dma_len != 0)
+    {
+        if ((err = sd_spi_hw_xfer_poll(card)) == Sd_Err_No_Ready)
+            return err;
+        *n = ctx->dma_len;
+        ctx->dma_len = 0;
+        return err;
+    }
+
+    /** 2. 启动异步传输 **/
+    if (sd_spi_hw_can_start(card, ptr, *n))
+    {
+        if ((err = sd_spi_hw_xfer_start(card, is_write ? ptr : NULL, is_write ? NULL : ptr, *n)) != Sd_Err_OK)
+            return err;
+        ctx->dma_len = *n;
+        return Sd_Err_No_Ready;
+    }
+
+    /** 3. 同步收发一段数据 **/
+    if (*n > SD_SPI_ASYNC_CHUNK_SIZE)
+        *n = SD_SPI_ASYNC_CHUNK_SIZE;
+    return is_write ? sd_spi_hw_write_bytes(card, ptr, *n) : sd_spi_hw_read_bytes(card, ptr, *n);
+}
+
+/**
+ * @brief 步骤：等待卡退出上一次推迟的写入编程忙状态
+ * @param card  [in]  SD卡对象
+ */
+static void _step_wait_ready(struct sd_card *card)
+{
+    enum sd_error err = Sd_Err_OK;
+    uint8_t byte;
+
+    if ((err = _poll_bus(card, true, &byte)) == Sd_Err_No_Ready)
+        return;
+
+    card->is_busy_pending = false;
+    if (err != Sd_Err_OK)
+    {
+        trace_w(card, "Deferred write busy timeout");
+        _set_error(card, err);
+        card->async.state = Sd_Async_Done;
+        return;
+    }
+
+    card->async.state = Sd_Async_Send_Cmd;
+}
+
+/**
+ * @brief 步骤：发送读/写/擦除命令
+ * @note 单块模式下每个块都会回到此步骤发送 CMD17/CMD24；擦除在此步骤连续发送 CMD32、CMD33、CMD38。
+ * @param card  [in]  SD卡对象
+ */
+static void _step_send_cmd(struct sd_card *card)
+{
+    struct sd_async *ctx = &card->async;
+    enum sd_error err = Sd_Err_OK;
+
+    switch (ctx->req->op)
+    {
+    case Sd_Req_Op_Read:
+        if ((err = _send_cmd(card, ctx->is_multi ? Sd_Cmd18_Rd_Multi : Sd_Cmd17_Rd_Single, ctx->arg)) == Sd_Err_OK)
+            _enter_wait(card, Sd_Async_Rd_Token, SD_SPI_READ_TIMEOUT_US);
+        break;
+
+    case Sd_Req_Op_Write:
+        /** 预擦除仅是提示，失败时不影响后续写入 **/
+        if (ctx->is_multi && (ctx->req->opts & SD_WR_OPT_PRE_ERASE) &&
+            _send_cmd(card, Sd_Cmd55_App_Cmd, 0) == Sd_Err_OK)
+            _send_cmd(card, Sd_Acmd23_Set_Wr_Blk_Erase, (ctx->count - ctx->req->done_blocks) & 0x7FFFFF);
+
+        if ((err = _send_cmd(card, ctx->is_multi ? Sd_Cmd25_Wr_Multi_Blk : Sd_Cmd24_Wr_Single_Blk, ctx->arg)) == Sd_Err_OK)
+        {
+            ctx->offset = 0;
+            ctx->state = Sd_Async_Wr_Data;
+        }
+        break;
+
+    case Sd_Req_Op_Erase:
+        if ((err = _send_cmd(card, Sd_Cmd32_Erase_Start, ctx->arg)) == Sd_Err_OK &&
+            (err = _send_cmd(card, Sd_Cmd33_Erase_End, ctx->arg + (ctx->count - 1) * sd_card_lba_step(card))) == Sd_Err_OK &&
+            (err = _send_cmd(card, Sd_Cmd38_Erase, 0)) == Sd_Err_OK)
+            _enter_wait(card, Sd_Async_Busy, SD_SPI_ERASE_TIMEOUT_US);
+        break;
+    }
+
+    if (err != Sd_Err_OK)
+    {
+        _set_error(card, err);
+        ctx->state = Sd_Async_Done;
+    }
+}
+
+/**
+ * @brief 步骤：等待数据令牌
+ * @param card  [in]  SD卡对象
+ */
+static void _step_rd_token(struct sd_card *card)
+{
+    struct sd_async *ctx = &card->async;
+    enum sd_error err = Sd_Err_OK;
+    uint8_t token;
+
+    if ((err = _poll_bus(card, false, &token)) == Sd_Err_No_Ready)
+        return;
+
+    if (err == Sd_Err_OK && token != 0xFE)
+    {
+        trace_e(card, "Data error token: 0x%02X", token);
+        err = Sd_Err_Response;
+    }
+
+    if (err != Sd_Err_OK)
+    {
+        trace_e(card, "Read lba[%d] failed, code: 0x%02x", ctx->arg, err);
+        _set_error(card, err);
+        ctx->state = ctx->is_multi ? Sd_Async_Rd_Stop : Sd_Async_Done;
+        return;
+    }
+
+    ctx->offset = 0;
+    ctx->crc = 0;
+    ctx->state = Sd_Async_Rd_Data;
+}
+
+/**
+ * @brief 步骤：接收一段数据，块结束时读取 CRC，开启CRC校验时比对，否则丢弃
+ * @param card  [in]  SD卡对象
+ */
+static void _step_rd_data(struct sd_card *card)
+{
+    struct sd_async *ctx = &card->async;
+    struct sd_request *req = ctx->req;
+    enum sd_error err = Sd_Err_OK;
+    uint32_t block_size = card->info.block_size;
+    uint32_t n = block_size - ctx->offset;
+
+    /** 1. 接收一段数据 **/
+    uint8_t *ptr = (uint8_t *)req->buf + req->done_blocks * block_size + ctx->offset;
+    if ((err = _xfer_chunk(card, ptr, &n, false)) == Sd_Err_No_Ready)
+        return;
+    if (err != Sd_Err_OK)
+        goto _FAILED_;
+#if (SD_SPI_CRC_ENABLE == 1)
+    ctx->crc = sd_crc16(ctx->crc, ptr, n);
+#endif
+    if ((ctx->offset += n) < block_size)
+        return;
+
+    /** 2. 块接收完毕，读取CRC **/
+    {
+        uint8_t crc[2];
+        if ((err = sd_spi_hw_read_bytes(card, crc, sizeof(crc))) != Sd_Err_OK)
+            goto _FAILED_;
+
+#if (SD_SPI_CRC_ENABLE == 1)
+        if ((((uint16_t) crc[0] << 8) | crc[1]) != ctx->crc)
+        {
+            err = Sd_Err_Crc;
+            if (!_retry_block(card))
+                goto _FAILED_;
+
+            /** 单块模式重新发送 CMD17；多块模式先结束本次读取，再从该块重新开始 **/
+            if (ctx->is_multi)
+                ctx->state = Sd_Async_Rd_Stop;
+            else
+            {
+                ctx->is_resume = false;
+                ctx->state = Sd_Async_Send_Cmd;
+            }
+            return;
+        }
+        ctx->retries = 0;
+#endif
+    }
+
+    /** 3. 进入下一个块或结束传输 **/
+    req->done_blocks++;
+    ctx->arg += sd_card_lba_step(card);
+    if (req->done_blocks == ctx->count)
+        ctx->state = ctx->is_multi ? Sd_Async_Rd_Stop : Sd_Async_Done;
+    else if (ctx->is_multi)
+        _enter_wait(card, Sd_Async_Rd_Token, SD_SPI_READ_TIMEOUT_US);
+    else
+        ctx->state = Sd_Async_Send_Cmd;
+    return;
+
+_FAILED_:;
+    _set_error(card, err);
+    ctx->state = ctx->is_multi ? Sd_Async_Rd_Stop : Sd_Async_Done;
+}
+
+/**
+ * @brief 步骤：发送 CMD12 结束多块读取
+ * @param card  [in]  SD卡对象
+ */
+static void _step_rd_stop(struct sd_card *card)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    if ((err = _send_cmd(card, Sd_Cmd12_Stop_Xfer, 0)) != Sd_Err_OK)
+    {
+        trace_e(card, "CMD12 failed, code: 0x%02x", err);
+        _set_error(card, err);
+        card->async.state = Sd_Async_Done;
+        return;
+    }
+
+    _enter_wait(card, Sd_Async_Busy, SD_SPI_BUSY_TIMEOUT_US);
+}
+
+/**
+ * @brief 步骤：发送一段数据，块起始时发送数据令牌，块结束时发送CRC（未开启CRC校验时为虚拟CRC）并检查数据响应
+ * @param card  [in]  SD卡对象
+ */
+static void _step_wr_data(struct sd_card *card)
+{
+    struct sd_async *ctx = &card->async;
+    struct sd_request *req = ctx->req;
+    enum sd_error err = Sd_Err_OK;
+    uint32_t block_size = card->info.block_size;
+    uint32_t n = block_size - ctx->offset;
+
+    /** 1. 块起始时发送数据令牌，单块写为 0xFE，多块写为 0xFC **/
+    if (ctx->offset == 0 && ctx->dma_len == 0)
+    {
+        if ((err = sd_spi_hw_write_byte(card, ctx->is_multi ? 0xFC : 0xFE)) != Sd_Err_OK)
+            goto _FAILED_;
+        ctx->crc = 0;
+    }
+
+    /** 2. 发送一段数据 **/
+    uint8_t *ptr = (uint8_t *)req->buf + req->done_blocks * block_size + ctx->offset;
+    if ((err = _xfer_chunk(card, ptr, &n, true)) == Sd_Err_No_Ready)
+        return;
+    if (err != Sd_Err_OK)
+        goto _FAILED_;
+#if (SD_SPI_CRC_ENABLE == 1)
+    ctx->crc = sd_crc16(ctx->crc, ptr, n);
+#endif
+    if ((ctx->offset += n) < block_size)
+        return;
+
+    /** 3. 块发送完毕，发送CRC并检查数据响应令牌 **/
+    {
+#if (SD_SPI_CRC_ENABLE == 1)
+        uint8_t crc[2] = {(uint8_t) (ctx->crc >> 8), (uint8_t) ctx->crc};
+#else
+        uint8_t crc[2] = {0xFF, 0xFF};
+#endif
+        uint8_t data_resp;
+        if ((err = sd_spi_hw_write_bytes(card, crc, sizeof(crc))) != Sd_Err_OK ||
+            (err = sd_spi_hw_read_byte(card, &data_resp)) != Sd_Err_OK)
+            goto _FAILED_;
+
+#if (SD_SPI_CRC_ENABLE == 1)
+        /** 卡因CRC错误拒绝了该块：等待卡就绪后重传该块 **/
+        if ((data_resp & 0x1F) == 0x0B && _retry_block(card))
+        {
+            _enter_wait(card, Sd_Async_Wr_Busy, SD_SPI_WRITE_TIMEOUT_US);
+            return;
+        }
+#endif
+        if ((data_resp & 0x1F) != 0x05)
+        {
+            trace_e(card, "Data response error: 0x%02X", data_resp);
+            err = ((data_resp & 0x1F) == 0x0B) ? Sd_Err_Crc : Sd_Err_Response;
+            goto _FAILED_;
+        }
+    }
+
+    /** 4. 单块模式下的最后一块允许推迟编程忙等待，其余情况进入忙等待 **/
+    if (!ctx->is_multi && req->done_blocks + 1 == ctx->count && (req->opts & SD_WR_OPT_DEFER_BUSY))
+    {
+        card->is_busy_pending = true;
+        req->done_blocks++;
+        ctx->state = Sd_Async_Done;
+    }
+    else
+        _enter_wait(card, Sd_Async_Wr_Busy, SD_SPI_WRITE_TIMEOUT_US);
+    return;
+
+_FAILED_:;
+    trace_e(card, "Write lba[%d] failed, code: 0x%02x", ctx->arg, err);
+    _set_error(card, err);
+    if (ctx->is_multi)
+        _enter_wait(card, Sd_Async_Wr_Busy, SD_SPI_WRITE_TIMEOUT_US);   // 出错时卡可能仍处于忙状态，需先等待其就绪再发送停止令牌
+    else
+        ctx->state = Sd_Async_Done;
+}
+
+/**
+ * @brief 步骤：等待当前数据块编程完成
+ * @param card  [in]  SD卡对象
+ */
+static void _step_wr_busy(struct sd_card *card)
+{
+    struct sd_async *ctx = &card->async;
+    struct sd_request *req = ctx->req;
+    enum sd_error err = Sd_Err_OK;
+    uint8_t byte;
+
+    if ((err = _poll_bus(card, true, &byte)) == Sd_Err_No_Ready)
+        return;
+
+    if (err != Sd_Err_OK)
+    {
+        trace_w(card, "Write lba[%d] busy timeout", ctx->arg);
+        _set_error(card, err);
+    }
+    else if (ctx->is_resume)
+    {
+        /** 该块被卡拒绝，不计入已完成的块 **/
+    }
+    else if (ctx->err == Sd_Err_OK)
+    {
+        /** 编程完成，该块已写入卡中 **/
+        req->done_blocks++;
+        ctx->arg += sd_card_lba_step(card);
+        ctx->retries = 0;
+    }
+
+    if (ctx->err != Sd_Err_OK || req->done_blocks == ctx->count)
+        ctx->state = ctx->is_multi ? Sd_Async_Wr_Stop : Sd_Async_Done;
+    else if (ctx->is_resume && ctx->is_multi)
+        ctx->state = Sd_Async_Wr_Stop;      // 结束本次多块写入，之后从被拒绝的块重新开始
+    else
+    {
+        ctx->is_resume = false;
+        ctx->offset = 0;
+        ctx->state = ctx->is_multi ? Sd_Async_Wr_Data : Sd_Async_Send_Cmd;
+    }
+}
+
+/**
+ * @brief 步骤：发送停止令牌结束多块写入
+ * @param card  [in]  SD卡对象
+ */
+static void _step_wr_stop(struct sd_card *card)
+{
+    struct sd_async *ctx = &card->async;
+    enum sd_error err = Sd_Err_OK;
+    uint8_t nbr;
+
+    /** 发送停止令牌，并跳过一个字节 **/
+    if ((err = sd_spi_hw_write_byte(card, 0xFD)) != Sd_Err_OK ||
+        (err = sd_spi_hw_read_byte(card, &nbr)) != Sd_Err_OK)
+    {
+        trace_e(card, "CMD25 stop failed, code: 0x%02x", err);
+        _set_error(card, err);
+        ctx->state = Sd_Async_Done;
+        return;
+    }
+
+    if (ctx->err == Sd_Err_OK && !ctx->is_resume && (ctx->req->opts & SD_WR_OPT_DEFER_BUSY))
+    {
+        card->is_busy_pending = true;
+        ctx->state = Sd_Async_Done;
+    }
+    else
+        _enter_wait(card, Sd_Async_Busy, SD_SPI_WRITE_TIMEOUT_US);
+}
+
+/**
+ * @brief 步骤：等待最终的忙状态结束
+ * @param card  [in]  SD卡对象
+ */
+static void _step_busy(struct sd_card *card)
+{
+    struct sd_async *ctx = &card->async;
+    enum sd_error err = Sd_Err_OK;
+    uint8_t byte;
+
+    if ((err = _poll_bus(card, true, &byte)) == Sd_Err_No_Ready)
+        return;
+
+    if (err != Sd_Err_OK)
+    {
+        trace_w(card, "Busy timeout");
+        _set_error(card, err);
+    }
+    else if (ctx->req->op == Sd_Req_Op_Erase && ctx->err == Sd_Err_OK)
+        ctx->req->done_blocks = ctx->count;
+
+    /** 因CRC错误结束的多块传输，从出错的块重新开始 **/
+    if (ctx->is_resume && ctx->err == Sd_Err_OK)
+    {
+        ctx->is_resume = false;
+        ctx->state = Sd_Async_Send_Cmd;
+        return;
+    }
+
+    ctx->state = Sd_Async_Done;
+}
+
+/**
+ * @brief 执行状态机的一个步骤
+ * @param card  [in]  SD卡对象
+ */
+static void _async_step(struct sd_card *card)
+{
+    switch ((enum sd_async_state) card->async.state)
+    {
+    case Sd_Async_Wait_Ready:   _step_wait_ready(card); break;
+    case Sd_Async_Send_Cmd:     _step_send_cmd(card);   break;
+    case Sd_Async_Rd_Token:     _step_rd_token(card);   break;
+    case Sd_Async_Rd_Data:      _step_rd_data(card);    break;
+    case Sd_Async_Rd_Stop:      _step_rd_stop(card);    break;
+    case Sd_Async_Wr_Data:      _step_wr_data(card);    break;
+    case Sd_Async_Wr_Busy:      _step_wr_busy(card);    break;
+    case Sd_Async_Wr_Stop:      _step_wr_stop(card);    break;
+    case Sd_Async_Busy:         _step_busy(card);       break;
+    default:                    card->async.state = Sd_Async_Done; break;
+    }
+}
+
+/**
+ * @brief 结束当前请求：取消选择卡，填写结果并调用完成回调
+ * @note 回调被调用前请求已从卡上移除，因此允许在回调中提交新的请求。
+ * @param card              [in]  SD卡对象
+ * @return enum sd_error    [out] 请求的执行结果
+ */
+static enum sd_error _async_finish(struct sd_card *card)
+{
+    struct sd_request *req = card->async.req;
+    enum sd_error result = card->async.err;
+
+    sd_spi_hw_deselect_card(card);
+
+    req->result = result;
+    card->xfer_blocks = req->done_blocks;
+
+#if (SD_SPI_CRC_ENABLE == 1)
+    if (req->op != Sd_Req_Op_Erase)
+        sd_clock_account(card, req->done_blocks, card->async.crc_errs);
+#endif
+
+#if (SD_SPI_STATS_ENABLE == 1)
+    stats_begin(card);
+    if (req->op == Sd_Req_Op_Read)
+        card->stats.bytes_read += (uint64_t) req->done_blocks * card->info.block_size;
+    else if (req->op == Sd_Req_Op_Write)
+        card->stats.bytes_written += (uint64_t) req->done_blocks * card->info.block_size;
+    if (result != Sd_Err_OK)
+        card->stats.errors[result]++;
+    stats_end(card);
+#endif
+    card->async.req = NULL;
+    card->async.state = Sd_Async_Idle;
+
+    if (req->callback != NULL)
+        req->callback(card, req);
+
+    return result;
+}
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 提交异步请求
+ * @note 提交成功后卡保持选中，直到请求完成。期间 sd_spi_driver.h 中的阻塞接口会返回 Sd_Err_No_Ready。
+ *       请求不会在本函数中执行，需要用户反复调用 sd_card_poll() 推进。
+ * @param card              [in]  SD卡对象
+ * @param req               [in]  请求，需填写 op、addr、buf、len、opts、callback 字段
+ * @return enum sd_error    [out] 错误码，未实现 now_us() 时返回 Sd_Err_Unsupported，已有请求在执行时返回 Sd_Err_No_Ready
+ */
+enum sd_error sd_card_submit(struct sd_card *card, struct sd_request *req)
+{
+    if (card == NULL || req == NULL)
+        return Sd_Err_Param;
+    if (!card->is_inited)
+        return Sd_Err_Not_Inited;
+    if (card->spi_if == NULL || card->spi_if->now_us == NULL)
+        return Sd_Err_Unsupported;
+    if (card->async.req != NULL)
+        return Sd_Err_No_Ready;
+
+    enum sd_error err = Sd_Err_OK;
+    struct sd_async *ctx = &card->async;
+    uint32_t block_size = card->info.block_size;
+
+    /** 1. 检查参数并计算块数 **/
+    switch (req->op)
+    {
+    case Sd_Req_Op_Read:
+    case Sd_Req_Op_Write:
+        if (req->buf == NULL || req->len == 0 || req->len % block_size != 0)
+            return Sd_Err_Param;
+        ctx->count = req->len / block_size;
+        break;
+
+    case Sd_Req_Op_Erase:
+        if (req->len == 0)
+            return Sd_Err_Param;
+        ctx->count = (uint32_t) ((uint64_t) card->info.erase_sector_size * req->len / block_size);
+        break;
+
+    default:
+        return Sd_Err_Param;
+    }
+
+#if (SD_SPI_CACHE_ENABLE == 1)
+    /** 异步请求直接访问卡：读取前先写回缓存中的脏块，写入和擦除则丢弃缓存中被覆盖的块 **/
+    if (card->is_selected)
+        return Sd_Err_No_Ready;
+    if ((err = sd_cache_evict_range(card, (uint32_t) (req->addr / block_size), ctx->count, req->op == Sd_Req_Op_Read)) != Sd_Err_OK)
+        return err;
+#endif
+#if (SD_SPI_RAHEAD_ENABLE == 1)
+    /** 写入和擦除使预读缓冲区中被覆盖的块失效 **/
+    if (req->op != Sd_Req_Op_Read)
+        sd_rahead_invalidate(card, (uint32_t) (req->addr / block_size), ctx->count);
+#endif
+#if (SD_SPI_WCOMB_ENABLE == 1)
+    /** 异步请求直接访问卡，先写回写合并缓冲区 **/
+    if ((err = sd_wcomb_flush(card, true)) != Sd_Err_OK)
+        return err;
+#endif
+
+    /** 2. 选择卡，整个请求期间保持选中 **/
+    if ((err = sd_spi_hw_select_card(card)) != Sd_Err_OK)
+        return err;
+
+    /** 3. 初始化执行上下文 **/
+    req->result = Sd_Err_No_Ready;
+    req->done_blocks = 0;
+    card->xfer_blocks = 0;
+
+    ctx->req = req;
+    ctx->err = Sd_Err_OK;
+    ctx->retries = 0;
+    ctx->crc_errs = 0;
+    ctx->is_resume = false;
+    ctx->offset = 0;
+    ctx->dma_len = 0;
+    ctx->arg = (uint32_t) (req->addr / block_size) * sd_card_lba_step(card);
+    ctx->is_multi = (SD_SPI_MULTI_BLOCK_ENABLE == 1) && !card->is_single_block && req->op != Sd_Req_Op_Erase && ctx->count > 1;
+
+    if (card->is_busy_pending)
+        _enter_wait(card, Sd_Async_Wait_Ready, SD_SPI_WRITE_TIMEOUT_US);
+    else
+        ctx->state = Sd_Async_Send_Cmd;
+
+    trace_d(card, "submit: op=%d, arg=0x%x, count=%d", req->op, ctx->arg, ctx->count);
+
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 推进异步请求
+ * @note 每次调用最多执行 SD_SPI_ASYNC_SLICE_US 的时间片，超出量不超过一个步骤的耗时（发送一条命令，
+ *       或收发 SD_SPI_ASYNC_CHUNK_SIZE 字节，或轮询 SD_SPI_POLL_FAST_COUNT 字节）。
+ *       端口的异步传输（如 DMA）启动后立即返回，传输期间 CPU 不参与数据搬运。
+ *       请求完成时先调用完成回调，再返回执行结果。
+ * @param card              [in]  SD卡对象
+ * @return enum sd_error    [out] 请求仍在执行返回 Sd_Err_No_Ready；请求在本次调用中完成则返回其执行结果；没有请求时返回 Sd_Err_OK
+ */
+enum sd_error sd_card_poll(struct sd_card *card)
+{
+    if (card == NULL)
+        return Sd_Err_Param;
+    if (card->async.req == NULL)
+        return Sd_Err_OK;
+
+    uint32_t t0 = sd_spi_hw_now_us(card);
+
+    do
+    {
+        _async_step(card);
+    } while (card->async.state != Sd_Async_Done && card->async.dma_len == 0 &&
+             (uint32_t)(sd_spi_hw_now_us(card) - t0) < SD_SPI_ASYNC_SLICE_US);
+
+    if (card->async.state != Sd_Async_Done)
+        return Sd_Err_No_Ready;
+
+    return _async_finish(card);
+}
\ No newline at end of file
@@ -0,0 +1,307 @@
+/**
+ * @file sd_bench.c
+ * @author SouthernSandbox (https://github.com/SouthernSandbox)
+ * @brief 片上基准测试：在卡的临时区域上测试顺序/随机读写、写入延迟分布与擦除耗时，并通过调试接口打印报告
+ * @version 0.1
+ * @date 2025-08-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "sd_spi_driver.h"
+#include "sd_private.h"
+#include "string.h"
+
+#define SD_TRACE_FILE_ID    12          // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
+#if (SD_SPI_BENCH_ENABLE == 1)
+
+#if (SD_SPI_BENCH_MAX_BLOCKS < 8)
+    #error "SD_SPI_BENCH_MAX_BLOCKS must be at least 8"
+#endif
+
+#define BENCH_BLOCK_SIZE    512         // 测试使用的块大小
+#define BENCH_DEF_OPS       64          // 默认的每个负载的操作次数
+#define BENCH_ERASE_OPS     8           // 擦除负载的最大操作次数，擦除一个扇区可能需要数百毫秒
+
+/**
+ * @brief 报告输出，不受追踪开关和追踪等级影响
+ */
+#define bench_print(_card, _fmt, ...)                                                   \
+        do {                                                                            \
+            if ((_card)->debug_if != NULL && (_card)->debug_if->print != NULL)          \
+                (_card)->debug_if->print(_card, _fmt "\r\n", ##__VA_ARGS__);            \
+        } while (0)
+
+/**
+ * @brief 负载定义
+ */
+struct bench_case
+{
+    const char*     name;           // 名称
+    uint32_t        blocks;         // 每次操作的块数
+    bool            is_write;       // 是否写入
+    bool            is_rand;        // 是否随机访问
+};
+
+static const struct bench_case cases[Sd_Bench_Case_Num] =
+{
+    [Sd_Bench_Seq_Read_1]       = {"seq_read_1",    1,                          false,  false},
+    [Sd_Bench_Seq_Read_8]       = {"seq_read_8",    8,                          false,  false},
+    [Sd_Bench_Seq_Read_Max]     = {"seq_read_max",  SD_SPI_BENCH_MAX_BLOCKS,    false,  false},
+    [Sd_Bench_Rand_Read_1]      = {"rand_read_1",   1,                          false,  true},
+    [Sd_Bench_Rand_Read_8]      = {"rand_read_8",   8,                          false,  true},
+    [Sd_Bench_Seq_Write_1]      = {"seq_write_1",   1,                          true,   false},
+    [Sd_Bench_Seq_Write_8]      = {"seq_write_8",   8,                          true,   false},
+    [Sd_Bench_Seq_Write_Max]    = {"seq_write_max", SD_SPI_BENCH_MAX_BLOCKS,    true,   false},
+    [Sd_Bench_Rand_Write_1]     = {"rand_write_1",  1,                          true,   true},
+    [Sd_Bench_Rand_Write_8]     = {"rand_write_8",  8,                          true,   true},
+    [Sd_Bench_Erase]            = {"erase",         0,                          true,   false},
+};
+
+static uint8_t buffer[SD_SPI_BENCH_MAX_BLOCKS * BENCH_BLOCK_SIZE];      // 测试缓冲区
+static uint32_t rng;                                                    // 随机访问的伪随机数状态
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 伪随机数（xorshift32），每个负载从相同的种子开始，保证不同卡、不同端口的访问序列相同
+ * @return uint32_t     [out] 随机数
+ */
+static uint32_t _rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/**
+ * @brief 记录一次操作的耗时
+ * @param hist          [in]  延迟直方图
+ * @param us            [in]  耗时，单位：微秒
+ */
+static void _hist_add(struct sd_lat_hist *hist, uint32_t us)
+{
+    hist->buckets[sd_lat_bucket(us)]++;
+    hist->count++;
+    hist->total_us += us;
+    if (us > hist->max_us)
+        hist->max_us = us;
+}
+
+/**
+ * @brief 执行一个读写负载
+ * @param card          [in]  SD卡对象
+ * @param cfg           [in]  测试配置
+ * @param bc            [in]  负载定义
+ * @param res           [out] 结果
+ * @param hist          [out] 延迟直方图
+ */
+static void _run_rw(struct sd_card *card, const struct sd_bench_config *cfg, const struct bench_case *bc,
+                    struct sd_bench_result *res, struct sd_lat_hist *hist)
+{
+    uint32_t span = cfg->blocks / bc->blocks;           // 临时区域可容纳的请求个数
+    uint32_t len = bc->blocks * BENCH_BLOCK_SIZE;
+    uint32_t t_start = sd_spi_hw_now_us(card);
+    uint32_t ops = (cfg->ops != 0) ? cfg->ops : BENCH_DEF_OPS;
+
+    rng = 0x9E3779B9;
+    for (uint32_t i = 0; i < ops; i++)
+    {
+        uint32_t blk = cfg->start_blk + (bc->is_rand ? _rand() % span : i % span) * bc->blocks;
+        uint64_t addr = (uint64_t) blk * BENCH_BLOCK_SIZE;
+        uint32_t t0 = sd_spi_hw_now_us(card);
+        enum sd_error err;
+
+        if (bc->is_write)
+        {
+            buffer[0] = (uint8_t) i;
+            err = sd_card_write(card, addr, buffer, len);
+        }
+        else
+            err = sd_card_read(card, addr, buffer, len);
+
+        if (err != Sd_Err_OK)
+        {
+            res->errors++;
+            continue;
+        }
+        _hist_add(hist, sd_spi_hw_now_us(card) - t0);
+        res->ops++;
+    }
+
+    /** 推迟的写入计入总耗时 **/
+    if (bc->is_write && sd_card_sync(card) != Sd_Err_OK)
+        res->errors++;
+
+    uint32_t total_us = sd_spi_hw_now_us(card) - t_start;
+    if (total_us == 0)
+        total_us = 1;
+    res->kb_s = (uint32_t) ((uint64_t) res->ops * len * 1000000 / 1024 / total_us);
+    res->iops = (uint32_t) ((uint64_t) res->ops * 1000000 / total_us);
+}
+
+/**
+ * @brief 执行擦除负载：依次擦除临时区域中完整的擦除扇区，临时区域中没有完整的擦除扇区时不测试
+ * @param card          [in]  SD卡对象
+ * @param cfg           [in]  测试配置
+ * @param res           [out] 结果
+ * @param hist          [out] 延迟直方图
+ */
+static void _run_erase(struct sd_card *card, const struct sd_bench_config *cfg,
+                       struct sd_bench_result *res, struct sd_lat_hist *hist)
+{
+    uint64_t sector = sd_card_get_erase_size(card) / BENCH_BLOCK_SIZE;   // 擦除扇区的块数
+    uint64_t first = 0, end = (uint64_t) cfg->start_blk + cfg->blocks;
+    uint32_t ops = (cfg->ops != 0 && cfg->ops < BENCH_ERASE_OPS) ? cfg->ops : BENCH_ERASE_OPS;
+    uint32_t t_start = 0;
+
+    if (sector == 0)
+        return;
+    first = (cfg->start_blk + sector - 1) / sector * sector;
+    if (first + sector > end)
+        return;
+
+    t_start = sd_spi_hw_now_us(card);
+    for (uint32_t i = 0; i < ops; i++)
+    {
+        uint64_t blk = first + (i % ((end - first) / sector)) * sector;
+        uint32_t t0 = sd_spi_hw_now_us(card);
+
+        if (sd_card_erase_sector(card, blk * BENCH_BLOCK_SIZE, 1) != Sd_Err_OK)
+        {
+            res->errors++;
+            continue;
+        }
+        _hist_add(hist, sd_spi_hw_now_us(card) - t0);
+        res->ops++;
+    }
+
+    uint32_t total_us = sd_spi_hw_now_us(card) - t_start;
+    if (total_us == 0)
+        total_us = 1;
+    res->kb_s = (uint32_t) ((uint64_t) res->ops * sector * BENCH_BLOCK_SIZE * 1000000 / 1024 / total_us);
+    res->iops = (uint32_t) ((uint64_t) res->ops * 1000000 / total_us);
+}
+
+/**
+ * @brief 打印延迟分布中非空的桶
+ * @param card          [in]  SD卡对象
+ * @param name          [in]  负载名称
+ * @param hist          [in]  延迟直方图
+ */
+static void _print_hist(struct sd_card *card, const char *name, const struct sd_lat_hist *hist)
+{
+    if (hist->count == 0)
+        return;
+
+    bench_print(card, "%s latency distribution:", name);
+    for (uint8_t i = 0; i < SD_LAT_BUCKETS; i++)
+    {
+        if (hist->buckets[i] == 0)
+            continue;
+        if (i == SD_LAT_BUCKETS - 1)
+            bench_print(card, "  >= %10u us  %u", (unsigned) ((uint32_t) 1 << (i - 1)), (unsigned) hist->buckets[i]);
+        else
+            bench_print(card, "  <  %10u us  %u", (unsigned) ((uint32_t) 1 << i), (unsigned) hist->buckets[i]);
+    }
+}
+
+#endif  // SD_SPI_BENCH_ENABLE
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 在卡的临时区域上运行基准测试，并通过调试接口打印报告
+ * @note 依次测试顺序读（1 块、8 块、SD_SPI_BENCH_MAX_BLOCKS 块）、随机读（1 块、8 块），cfg->write 为 true 时再测试
+ *       相同长度的顺序写、随机写，以及擦除临时区域中完整的擦除扇区（最多 8 次）。只通过库的公开接口访问卡，
+ *       与端口实现无关，不同平台、不同卡的结果可以直接比较。写入测试会破坏临时区域中的数据，请使用未被文件系统占用的区域。
+ *       需要实现 now_us()，卡需已初始化。
+ * @param card              [in]  SD卡对象
+ * @param cfg               [in]  测试配置
+ * @param report            [out] 测试报告，可为 NULL
+ * @return enum sd_error    [out] 错误码，未开启 SD_SPI_BENCH_ENABLE 或未实现 now_us() 时返回 Sd_Err_Unsupported
+ */
+enum sd_error sd_card_bench(struct sd_card *card, const struct sd_bench_config *cfg, struct sd_bench_report *report)
+{
+    if (card == NULL || cfg == NULL)
+        return Sd_Err_Param;
+
+#if (SD_SPI_BENCH_ENABLE == 1)
+    static struct sd_bench_report local;
+    struct sd_lat_hist hist;
+
+    /** 1. 检查参数 **/
+    if (card->spi_if == NULL || card->spi_if->now_us == NULL)
+        return Sd_Err_Unsupported;
+    if (!card->is_inited)
+        return Sd_Err_Not_Inited;
+    if (card->info.block_size != BENCH_BLOCK_SIZE)
+        return Sd_Err_Unsupported;
+    if (cfg->blocks < SD_SPI_BENCH_MAX_BLOCKS || (uint64_t) cfg->start_blk + cfg->blocks > card->info.block_count)
+        return Sd_Err_Param;
+
+    if (report == NULL)
+        report = &local;
+    memset(report, 0, sizeof(*report));
+    for (uint32_t i = 0; i < sizeof(buffer); i++)
+        buffer[i] = (uint8_t) (i * 7 + 1);
+
+    bench_print(card, "sd bench: %s, %s, %u MB, blocks %u..%u, %u ops",
+                card->name, sd_get_capacity_class_name(card->info.type), (unsigned) (sd_card_get_capacity(card) >> 20),
+                (unsigned) cfg->start_blk, (unsigned) (cfg->start_blk + cfg->blocks - 1),
+                (unsigned) ((cfg->ops != 0) ? cfg->ops : BENCH_DEF_OPS));
+    bench_print(card, "%-14s %8s %7s %9s %9s %9s %5s", "case", "KB/s", "IOPS", "p50 us", "p99 us", "max us", "err");
+
+    /** 2. 依次运行各负载并打印结果 **/
+    for (uint8_t c = 0; c < Sd_Bench_Case_Num; c++)
+    {
+        const struct bench_case *bc = &cases[c];
+        struct sd_bench_result *res = &report->result[c];
+
+        if (bc->is_write && !cfg->write)
+            continue;
+
+        memset(&hist, 0, sizeof(hist));
+        if (c == Sd_Bench_Erase)
+            _run_erase(card, cfg, res, &hist);
+        else
+            _run_rw(card, cfg, bc, res, &hist);
+
+        if (hist.count != 0)
+        {
+            res->p50_us = sd_lat_percentile(&hist, 500);
+            res->p99_us = sd_lat_percentile(&hist, 990);
+            res->max_us = hist.max_us;
+        }
+        if (c == Sd_Bench_Rand_Write_8)
+            report->write_hist = hist;
+
+        if (res->ops == 0 && res->errors == 0)
+            bench_print(card, "%-14s skipped", bc->name);
+        else
+            bench_print(card, "%-14s %8u %7u %9u %9u %9u %5u", bc->name, (unsigned) res->kb_s, (unsigned) res->iops,
+                        (unsigned) res->p50_us, (unsigned) res->p99_us, (unsigned) res->max_us, (unsigned) res->errors);
+    }
+
+    /** 3. 打印写入延迟分布 **/
+    _print_hist(card, cases[Sd_Bench_Rand_Write_8].name, &report->write_hist);
+    return Sd_Err_OK;
+#else
+    (void) report;
+    return Sd_Err_Unsupported;
+#endif
+}
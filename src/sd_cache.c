@@ -0,0 +1,390 @@
+/**
+ * @file sd_cache.c
+ * @author SouthernSandbox (https://github.com/SouthernSandbox)
+ * @brief 块缓存：位于读写接口与卡之间的组相联写回缓存
+ * @version 0.1
+ * @date 2025-08-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "sd_spi_driver.h"
+#include "sd_private.h"
+#include "string.h"
+
+#define SD_TRACE_FILE_ID    2           // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
+#if (SD_SPI_CACHE_ENABLE == 1)
+
+#define CACHE_LINE_COUNT    (SD_SPI_CACHE_SETS * SD_SPI_CACHE_WAYS)
+
+/**
+ * @brief 缓存行
+ */
+struct cache_line
+{
+    uint8_t             data[SD_SPI_CACHE_BLOCK_SIZE];  // 块数据
+    struct sd_card*     card;                           // 所属的卡，NULL 表示该行无效
+    uint32_t            blk;                            // 块号
+    uint32_t            stamp;                          // 最近一次访问的时间戳，用于组内 LRU 替换
+    bool                is_dirty;                       // 是否被修改且尚未写回卡
+};
+
+static struct cache_line lines[CACHE_LINE_COUNT];      // 缓存行，每 SD_SPI_CACHE_WAYS 行为一组
+static struct sd_cache_stats stats;                     // 统计信息
+static uint32_t tick;                                   // 访问计数，作为 LRU 时间戳
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 查找缓存行
+ * @param card                  [in]  SD卡对象
+ * @param blk                   [in]  块号
+ * @return struct cache_line*   [out] 命中的缓存行，未命中返回 NULL
+ */
+static struct cache_line* _lookup(struct sd_card *card, uint32_t blk)
+{
+    struct cache_line *set = &lines[(blk % SD_SPI_CACHE_SETS) * SD_SPI_CACHE_WAYS];
+
+    for (uint32_t i = 0; i < SD_SPI_CACHE_WAYS; i++)
+        if (set[i].card == card && set[i].blk == blk)
+            return &set[i];
+    return NULL;
+}
+
+/**
+ * @brief 将一个脏缓存行写回卡
+ * @param line              [in]  缓存行
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _write_back(struct cache_line *line)
+{
+    enum sd_error err = Sd_Err_OK;
+    struct sd_iovec seg = {.buf = line->data, .len = SD_SPI_CACHE_BLOCK_SIZE};
+    struct sd_iov_cursor cur = {.iov = &seg, .idx = 0, .off = 0};
+
+    if ((err = sd_card_rw_blocks(line->card, line->blk, 1, &cur, true, SD_SPI_WRITE_DEFAULT_OPTS)) != Sd_Err_OK)
+        return err;
+
+    line->is_dirty = false;
+    stats.write_backs++;
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 为块分配缓存行：优先使用组内的空行，否则替换组内最久未访问的行（脏行先写回）
+ * @param card              [in]  SD卡对象
+ * @param blk               [in]  块号
+ * @param line              [out] 分配到的缓存行，数据内容未定义
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _alloc(struct sd_card *card, uint32_t blk, struct cache_line **line)
+{
+    enum sd_error err = Sd_Err_OK;
+    struct cache_line *set = &lines[(blk % SD_SPI_CACHE_SETS) * SD_SPI_CACHE_WAYS];
+    struct cache_line *victim = &set[0];
+
+    /** 1. 选择空行或最久未访问的行 **/
+    for (uint32_t i = 0; i < SD_SPI_CACHE_WAYS; i++)
+    {
+        if (set[i].card == NULL)
+        {
+            victim = &set[i];
+            break;
+        }
+        if ((uint32_t)(tick - set[i].stamp) > (uint32_t)(tick - victim->stamp))
+            victim = &set[i];
+    }
+
+    /** 2. 替换有效行，脏行需要先写回 **/
+    if (victim->card != NULL)
+    {
+        if (victim->is_dirty && (err = _write_back(victim)) != Sd_Err_OK)
+        {
+            trace_e(victim->card, "Cache write back blk[%d] failed, code: 0x%02x", victim->blk, err);
+            return err;
+        }
+        stats.evictions++;
+    }
+
+    victim->card = card;
+    victim->blk = blk;
+    victim->is_dirty = false;
+    *line = victim;
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 经过缓存读取块：命中时从缓存拷贝，未命中时先将块读入缓存
+ * @param card              [in]  SD卡对象
+ * @param blk               [in]  起始块号
+ * @param count             [in]  块数量
+ * @param cur               [out] 数据段游标
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _read_cached(struct sd_card *card, uint32_t blk, uint32_t count, struct sd_iov_cursor *cur)
+{
+    enum sd_error err = Sd_Err_OK;
+    uint32_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        struct cache_line *line = _lookup(card, blk + i);
+
+        if (line != NULL)
+            stats.hits++;
+        else
+        {
+            stats.misses++;
+            if ((err = _alloc(card, blk + i, &line)) != Sd_Err_OK)
+                break;
+
+            struct sd_iovec seg = {.buf = line->data, .len = SD_SPI_CACHE_BLOCK_SIZE};
+            struct sd_iov_cursor fill = {.iov = &seg, .idx = 0, .off = 0};
+            if ((err = sd_card_rw_blocks(card, blk + i, 1, &fill, false, SD_WR_OPT_NONE)) != Sd_Err_OK)
+            {
+                line->card = NULL;
+                break;
+            }
+        }
+
+        line->stamp = ++tick;
+        sd_iov_copy(cur, line->data, SD_SPI_CACHE_BLOCK_SIZE, true);
+    }
+
+    card->xfer_blocks = i;
+    return err;
+}
+
+/**
+ * @brief 经过缓存写入块：数据只写入缓存并标记为脏，由替换或 sd_card_sync() 写回卡
+ * @note 整块覆盖写入，未命中时无需先从卡读取。
+ * @param card              [in]  SD卡对象
+ * @param blk               [in]  起始块号
+ * @param count             [in]  块数量
+ * @param cur               [in]  数据段游标
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _write_cached(struct sd_card *card, uint32_t blk, uint32_t count, struct sd_iov_cursor *cur)
+{
+    enum sd_error err = Sd_Err_OK;
+    uint32_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        struct cache_line *line = _lookup(card, blk + i);
+
+        if (line != NULL)
+            stats.hits++;
+        else
+        {
+            stats.misses++;
+            if ((err = _alloc(card, blk + i, &line)) != Sd_Err_OK)
+                break;
+        }
+
+        sd_iov_copy(cur, line->data, SD_SPI_CACHE_BLOCK_SIZE, false);
+        line->is_dirty = true;
+        line->stamp = ++tick;
+    }
+
+    card->xfer_blocks = i;
+    return err;
+}
+
+/**
+ * @brief 直接访问卡读写块，并与缓存保持一致
+ * @note 读取后，用缓存中较新的脏块覆盖读到的数据；写入后，用新数据更新缓存中对应的行并标记为干净。
+ * @param card              [in]  SD卡对象
+ * @param blk               [in]  起始块号
+ * @param count             [in]  块数量
+ * @param cur               [in]  数据段游标
+ * @param is_write          [in]  true：写入；false：读取
+ * @param opts              [in]  写入选项
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _rw_bypass(struct sd_card *card, uint32_t blk, uint32_t count, struct sd_iov_cursor *cur, bool is_write, uint32_t opts)
+{
+    enum sd_error err = Sd_Err_OK;
+    struct sd_iov_cursor start = *cur;
+    uint32_t done;
+
+    stats.bypasses++;
+    err = sd_card_rw_blocks(card, blk, count, cur, is_write, opts);
+    done = card->xfer_blocks;
+
+    for (uint32_t i = 0; i < CACHE_LINE_COUNT; i++)
+    {
+        struct cache_line *line = &lines[i];
+        if (line->card != card || (uint32_t)(line->blk - blk) >= done)
+            continue;
+
+        struct sd_iov_cursor pos = start;
+        sd_iov_copy(&pos, NULL, (line->blk - blk) * SD_SPI_CACHE_BLOCK_SIZE, false);
+        if (is_write)
+        {
+            sd_iov_copy(&pos, line->data, SD_SPI_CACHE_BLOCK_SIZE, false);
+            line->is_dirty = false;
+        }
+        else if (line->is_dirty)
+            sd_iov_copy(&pos, line->data, SD_SPI_CACHE_BLOCK_SIZE, true);
+    }
+
+    card->xfer_blocks = done;
+    return err;
+}
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 经过块缓存读写一段连续的块
+ * @note 块数不超过 SD_SPI_CACHE_MAX_XFER_BLOCKS 的读写经过缓存（写入时 opts 不生效），其余直接访问卡。
+ *       执行后 card->xfer_blocks 为已完成的块数。
+ * @param card              [in]  SD卡对象
+ * @param blk               [in]  起始块号
+ * @param count             [in]  块数量
+ * @param cur               [in]  数据段游标（总长度至少 count 个块大小）
+ * @param is_write          [in]  true：写入；false：读取
+ * @param opts              [in]  写入选项，SD_WR_OPT_XXX 的按位组合，仅写入时有效
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_cache_rw_blocks(struct sd_card *card, uint32_t blk, uint32_t count, struct sd_iov_cursor *cur, bool is_write, uint32_t opts)
+{
+    if (card->info.block_size != SD_SPI_CACHE_BLOCK_SIZE)
+        return sd_card_rw_blocks(card, blk, count, cur, is_write, opts);
+    if (count > SD_SPI_CACHE_MAX_XFER_BLOCKS)
+        return _rw_bypass(card, blk, count, cur, is_write, opts);
+    if (card->is_selected)
+        return Sd_Err_No_Ready;     // 异步请求正在执行，不能访问卡，也不能修改缓存
+
+    return is_write ? _write_cached(card, blk, count, cur) : _read_cached(card, blk, count, cur);
+}
+
+/**
+ * @brief 将卡的所有脏缓存行写回卡
+ * @note 块号连续的脏行合并为一次多块写入。
+ * @param card              [in]  SD卡对象
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_cache_flush(struct sd_card *card)
+{
+    enum sd_error err = Sd_Err_OK;
+    struct cache_line *run[CACHE_LINE_COUNT];
+    struct sd_iovec iov[CACHE_LINE_COUNT];
+
+    while (1)
+    {
+        struct cache_line *first = NULL;
+        uint32_t n = 0;
+
+        /** 1. 找到块号最小的脏行 **/
+        for (uint32_t i = 0; i < CACHE_LINE_COUNT; i++)
+            if (lines[i].card == card && lines[i].is_dirty && (first == NULL || lines[i].blk < first->blk))
+                first = &lines[i];
+        if (first == NULL)
+            return Sd_Err_OK;
+
+        /** 2. 收集从该行开始块号连续的脏行 **/
+        for (struct cache_line *line = first; line != NULL && line->is_dirty && n < CACHE_LINE_COUNT; line = _lookup(card, first->blk + n))
+        {
+            run[n] = line;
+            iov[n].buf = line->data;
+            iov[n].len = SD_SPI_CACHE_BLOCK_SIZE;
+            n++;
+        }
+
+        /** 3. 一次写回 **/
+        struct sd_iov_cursor cur = {.iov = iov, .idx = 0, .off = 0};
+        err = sd_card_rw_blocks(card, first->blk, n, &cur, true, SD_SPI_WRITE_DEFAULT_OPTS);
+        for (uint32_t i = 0; i < card->xfer_blocks; i++)
+            run[i]->is_dirty = false;
+        stats.write_backs += card->xfer_blocks;
+
+        if (err != Sd_Err_OK)
+        {
+            trace_e(card, "Cache flush blk[%d] failed, code: 0x%02x", first->blk + card->xfer_blocks, err);
+            return err;
+        }
+    }
+}
+
+/**
+ * @brief 使卡的一段块在缓存中失效
+ * @param card              [in]  SD卡对象
+ * @param blk               [in]  起始块号
+ * @param count             [in]  块数量
+ * @param write_back        [in]  true：脏行先写回卡；false：直接丢弃（如这些块即将被擦除或覆盖，或卡已更换）
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_cache_evict_range(struct sd_card *card, uint32_t blk, uint32_t count, bool write_back)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    for (uint32_t i = 0; i < CACHE_LINE_COUNT; i++)
+    {
+        struct cache_line *line = &lines[i];
+        if (line->card != card || (uint32_t)(line->blk - blk) >= count)
+            continue;
+
+        if (write_back && line->is_dirty && (err = _write_back(line)) != Sd_Err_OK)
+            return err;
+        line->card = NULL;
+    }
+
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 获取卡尚未写回的脏缓存行数
+ * @param card              [in]  SD卡对象
+ * @return uint32_t         [out] 脏缓存行数
+ */
+uint32_t sd_cache_dirty_count(struct sd_card *card)
+{
+    uint32_t n = 0;
+
+    for (uint32_t i = 0; i < CACHE_LINE_COUNT; i++)
+        if (lines[i].card == card && lines[i].is_dirty)
+            n++;
+    return n;
+}
+
+#endif  // SD_SPI_CACHE_ENABLE
+
+/**
+ * @brief 获取块缓存统计信息
+ * @note 块缓存未开启时统计信息全部为 0。
+ * @param out       [out] 统计信息
+ */
+void sd_cache_get_stats(struct sd_cache_stats *out)
+{
+    if (out == NULL)
+        return;
+#if (SD_SPI_CACHE_ENABLE == 1)
+    *out = stats;
+#else
+    memset(out, 0, sizeof(*out));
+#endif
+}
+
+/**
+ * @brief 清零块缓存统计信息
+ */
+void sd_cache_reset_stats(void)
+{
+#if (SD_SPI_CACHE_ENABLE == 1)
+    memset(&stats, 0, sizeof(stats));
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,377 @@
+/**
+ * @file sd_capture.c
+ * @author SouthernSandbox (https://github.com/SouthernSandbox)
+ * @brief 总线抓取：包装卡的 SPI 接口，将每次端口调用记录到内存中的二进制日志
+ * @version 0.1
+ * @date 2025-08-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "sd_spi_driver.h"
+#include "sd_private.h"
+#include "string.h"
+
+#define SD_TRACE_FILE_ID    13          // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
+#if (SD_SPI_CAPTURE_ENABLE == 1)
+
+#if (SD_SPI_CAPTURE_BUF_SIZE & (SD_SPI_CAPTURE_BUF_SIZE - 1)) != 0
+    #error "SD_SPI_CAPTURE_BUF_SIZE must be a power of 2"
+#endif
+
+/**
+ * @brief 抓取状态
+ */
+struct capture
+{
+    struct sd_card*             card;           // 正在抓取的卡，NULL 表示未抓取
+    struct sd_spi_interface*    inner;          // 被包装的原始接口
+    struct sd_spi_interface     shim;           // 包装后的接口
+    void*                       pend_rx;        // 进行中的异步传输的接收缓冲区
+    uint32_t                    pend_len;       // 进行中的异步传输的长度
+    uint32_t                    dropped;        // 尚未报告的丢失记录数
+};
+
+static struct capture cap;                                      // 抓取状态
+static uint8_t log_buf[SD_SPI_CAPTURE_BUF_SIZE];                // 日志缓冲区
+static volatile uint32_t head;                                  // 写入位置（写入方）
+static volatile uint32_t tail;                                  // 读取位置（读取方）
+static volatile uint32_t lost_total;                            // 累计丢弃的记录数（写入方）
+static uint32_t lost_seen;                                      // 已报告的丢弃记录数（读取方）
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 获取时间戳
+ * @param card          [in]  SD卡对象
+ * @return uint32_t     [out] 时间戳，未实现 now_us() 时为 0
+ */
+static uint32_t _now(struct sd_card *card)
+{
+    return (cap.inner->now_us != NULL) ? cap.inner->now_us(card) : 0;
+}
+
+/**
+ * @brief 计算一个方向记录的字节数
+ * @param data          [in]  数据，NULL 表示不记录
+ * @param len           [in]  传输的字节数
+ * @return uint32_t     [out] 记录的字节数
+ */
+static uint32_t _stored(const void *data, uint32_t len)
+{
+    if (data == NULL)
+        return 0;
+#if (SD_SPI_CAPTURE_MAX_PAYLOAD != 0)
+    if (len > SD_SPI_CAPTURE_MAX_PAYLOAD)
+        return SD_SPI_CAPTURE_MAX_PAYLOAD;
+#endif
+    return len;
+}
+
+/**
+ * @brief 向日志缓冲区的指定位置拷贝数据，超出末尾的部分回绕到开头
+ * @param pos           [in]  位置（未取模）
+ * @param data          [in]  数据
+ * @param len           [in]  长度
+ */
+static void _copy_in(uint32_t pos, const void *data, uint32_t len)
+{
+    uint32_t off = pos & (SD_SPI_CAPTURE_BUF_SIZE - 1);
+    uint32_t first = SD_SPI_CAPTURE_BUF_SIZE - off;
+
+    if (first > len)
+        first = len;
+    memcpy(&log_buf[off], data, first);
+    memcpy(log_buf, (const uint8_t *) data + first, len - first);
+}
+
+/**
+ * @brief 为一条记录预留空间并写入发送的数据
+ * @note 发送的数据须在调用端口之前记录，duplex() 等接口的接收缓冲区可能与发送缓冲区相同。
+ * @param tx            [in]  发送的数据，NULL 表示发送 0xFF
+ * @param tx_len        [in]  发送的字节数
+ * @param rx            [in]  接收缓冲区，NULL 表示不记录
+ * @param rx_len        [in]  接收的字节数
+ * @return bool         [out] 空间不足时返回 false，本条记录被丢弃
+ */
+static bool _reserve(const void *tx, uint32_t tx_len, const void *rx, uint32_t rx_len)
+{
+    uint32_t need = sizeof(struct sd_capture_rec) + _stored(tx, tx_len) + _stored(rx, rx_len);
+
+    if (SD_SPI_CAPTURE_BUF_SIZE - (head - tail) < need)
+    {
+        cap.dropped++;
+        return false;
+    }
+
+    _copy_in(head + sizeof(struct sd_capture_rec), tx, _stored(tx, tx_len));
+    return true;
+}
+
+/**
+ * @brief 写入接收的数据和记录头，完成一条记录
+ * @param card          [in]  SD卡对象
+ * @param type          [in]  类型，SD_CAPTURE_XXX
+ * @param ctrl          [in]  control() 的控制操作
+ * @param ret           [in]  返回值
+ * @param ts            [in]  调用开始时的时间戳
+ * @param tx            [in]  发送的数据，NULL 表示发送 0xFF
+ * @param tx_len        [in]  发送的字节数
+ * @param rx            [in]  接收的数据，NULL 表示未记录
+ * @param rx_len        [in]  接收的字节数
+ */
+static void _commit(struct sd_card *card, uint8_t type, uint8_t ctrl, int ret, uint32_t ts, const void *tx, uint32_t tx_len, const void *rx, uint32_t rx_len)
+{
+    struct sd_capture_rec rec =
+    {
+        .ts_us  = ts,
+        .tx_len = tx_len,
+        .rx_len = rx_len,
+        .limit  = SD_SPI_CAPTURE_MAX_PAYLOAD,
+        .type   = type,
+        .flags  = 0,
+        .ret    = (int8_t) ret,
+        .ctrl   = ctrl,
+    };
+    uint32_t ntx = _stored(tx, tx_len), nrx = _stored(rx, rx_len);
+    uint32_t dur = _now(card) - ts;
+
+    rec.dur_us = (dur > UINT16_MAX) ? UINT16_MAX : (uint16_t) dur;
+    if (tx != NULL)
+        rec.flags |= SD_CAPTURE_F_TX;
+    if (rx != NULL)
+        rec.flags |= SD_CAPTURE_F_RX;
+    if (cap.dropped != 0)
+    {
+        rec.flags |= SD_CAPTURE_F_GAP;
+        lost_total += cap.dropped;
+        cap.dropped = 0;
+    }
+
+    _copy_in(head + sizeof(rec) + ntx, rx, nrx);
+    _copy_in(head, &rec, sizeof(rec));
+    sd_barrier();
+    head += sizeof(rec) + ntx + nrx;
+}
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 包装的 control()
+ */
+static int _control(struct sd_card *card, enum sd_user_ctrl ctrl)
+{
+    uint32_t ts = _now(card);
+    int ret = cap.inner->control(card, ctrl);
+
+    if (_reserve(NULL, 0, NULL, 0))
+        _commit(card, SD_CAPTURE_CONTROL, (uint8_t) ctrl, ret, ts, NULL, 0, NULL, 0);
+    return ret;
+}
+
+/**
+ * @brief 包装的 transfer()
+ */
+static int _transfer(struct sd_card *card, struct sd_spi_buf *tx, struct sd_spi_buf *rx)
+{
+    const void *txd = (tx != NULL) ? tx->data : NULL;
+    uint32_t tx_len = (tx != NULL) ? (uint32_t) tx->size : 0;
+    uint32_t rx_len = (rx != NULL) ? (uint32_t) rx->size : 0;
+    uint32_t ts = _now(card);
+    bool ok = _reserve(txd, tx_len, (rx != NULL) ? rx->data : NULL, rx_len);
+    int ret = cap.inner->transfer(card, tx, rx);
+
+    if (ok)
+        _commit(card, SD_CAPTURE_TRANSFER, 0, ret, ts, txd, tx_len, (rx != NULL) ? rx->data : NULL, rx_len);
+    return ret;
+}
+
+/**
+ * @brief 包装的 rx_fill()
+ */
+static int _rx_fill(struct sd_card *card, void *rx, size_t len)
+{
+    uint32_t ts = _now(card);
+    bool ok = _reserve(NULL, 0, rx, (uint32_t) len);
+    int ret = cap.inner->rx_fill(card, rx, len);
+
+    if (ok)
+        _commit(card, SD_CAPTURE_RX_FILL, 0, ret, ts, NULL, 0, rx, (uint32_t) len);
+    return ret;
+}
+
+/**
+ * @brief 包装的 duplex()
+ */
+static int _duplex(struct sd_card *card, const void *tx, void *rx, size_t len)
+{
+    uint32_t ts = _now(card);
+    bool ok = _reserve(tx, (uint32_t) len, rx, (rx != NULL) ? (uint32_t) len : 0);
+    int ret = cap.inner->duplex(card, tx, rx, len);
+
+    if (ok)
+        _commit(card, SD_CAPTURE_DUPLEX, 0, ret, ts, tx, (uint32_t) len, rx, (rx != NULL) ? (uint32_t) len : 0);
+    return ret;
+}
+
+/**
+ * @brief 包装的 xfer_start()
+ */
+static int _xfer_start(struct sd_card *card, const void *tx, void *rx, size_t len)
+{
+    uint32_t ts = _now(card);
+    bool ok = _reserve(tx, (uint32_t) len, NULL, 0);
+    int ret = cap.inner->xfer_start(card, tx, rx, len);
+
+    if (ok)
+        _commit(card, SD_CAPTURE_XFER_START, 0, ret, ts, tx, (uint32_t) len, NULL, 0);
+    cap.pend_rx = rx;
+    cap.pend_len = (uint32_t) len;
+    return ret;
+}
+
+/**
+ * @brief 包装的 xfer_poll()，只记录完成或失败，不记录进行中的查询
+ */
+static int _xfer_poll(struct sd_card *card)
+{
+    uint32_t ts = _now(card);
+    int ret = cap.inner->xfer_poll(card);
+    uint32_t rx_len = (cap.pend_rx != NULL) ? cap.pend_len : 0;
+
+    if (ret != 1 && _reserve(NULL, 0, cap.pend_rx, rx_len))
+        _commit(card, SD_CAPTURE_XFER_DONE, 0, ret, ts, NULL, 0, cap.pend_rx, rx_len);
+    return ret;
+}
+
+#endif  // SD_SPI_CAPTURE_ENABLE
+
+/**
+ * @brief 开始抓取一张卡的总线活动
+ * @note 以包装接口替换 card->spi_if，之后的每次端口调用都记录到日志中，日志在开始时清空。同一时间只能抓取一张卡。
+ *       应在该卡没有进行中的读写时调用，可在 sd_card_init() 之前调用以抓取初始化过程。
+ * @param card              [in]  SD卡对象
+ * @return enum sd_error    [out] 错误码，正在抓取其他卡时返回 Sd_Err_Failed，未开启 SD_SPI_CAPTURE_ENABLE 时返回 Sd_Err_Unsupported
+ */
+enum sd_error sd_capture_start(struct sd_card *card)
+{
+    if (card == NULL || card->spi_if == NULL)
+        return Sd_Err_Param;
+
+#if (SD_SPI_CAPTURE_ENABLE == 1)
+    struct sd_spi_interface *inner = card->spi_if;
+
+    if (cap.card != NULL)
+        return (cap.card == card) ? Sd_Err_OK : Sd_Err_Failed;
+
+    /** 1. 清空日志 **/
+    head = 0;
+    tail = 0;
+    lost_total = 0;
+    lost_seen = 0;
+    memset(&cap, 0, sizeof(cap));
+
+    /** 2. 复制原始接口，替换其中已实现的数据传输和控制接口，保持端口能力不变 **/
+    cap.inner = inner;
+    cap.shim = *inner;
+    cap.shim.control    = (inner->control    != NULL) ? _control    : NULL;
+    cap.shim.transfer   = (inner->transfer   != NULL) ? _transfer   : NULL;
+    cap.shim.rx_fill    = (inner->rx_fill    != NULL) ? _rx_fill    : NULL;
+    cap.shim.duplex     = (inner->duplex     != NULL) ? _duplex     : NULL;
+    cap.shim.xfer_start = (inner->xfer_start != NULL) ? _xfer_start : NULL;
+    cap.shim.xfer_poll  = (inner->xfer_poll  != NULL) ? _xfer_poll  : NULL;
+
+    cap.card = card;
+    card->spi_if = &cap.shim;
+    trace_i(card, "bus capture started");
+    return Sd_Err_OK;
+#else
+    return Sd_Err_Unsupported;
+#endif
+}
+
+/**
+ * @brief 停止抓取，恢复卡的原始接口
+ * @note 日志保留，可继续读出。
+ * @param card              [in]  SD卡对象
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_capture_stop(struct sd_card *card)
+{
+    if (card == NULL)
+        return Sd_Err_Param;
+
+#if (SD_SPI_CAPTURE_ENABLE == 1)
+    if (cap.card != card)
+        return Sd_Err_Param;
+
+    card->spi_if = cap.inner;
+    cap.card = NULL;
+    trace_i(card, "bus capture stopped");
+    return Sd_Err_OK;
+#else
+    return Sd_Err_Unsupported;
+#endif
+}
+
+/**
+ * @brief 读出抓取日志
+ * @note 按写入顺序取出上次读取之后的日志字节（struct sd_capture_rec 及其数据，小端字节序），可在抓取过程中由另一个线程持续读出，
+ *       腾出的空间用于之后的记录。多次读出的字节首尾相接即为完整的日志，由 tools/sd_capture_decode.py 解码。
+ *       只允许一个读取方。
+ * @param buf               [out] 数据缓冲区
+ * @param max               [in]  最多读取的字节数
+ * @param lost              [out] 自上次读取以来因缓冲区满而丢弃的记录数，可为 NULL
+ * @return uint32_t         [out] 读取的字节数，未开启 SD_SPI_CAPTURE_ENABLE 时为 0
+ */
+uint32_t sd_capture_read(void *buf, uint32_t max, uint32_t *lost)
+{
+    uint32_t n = 0;
+
+    if (lost != NULL)
+        *lost = 0;
+    if (buf == NULL)
+        return 0;
+
+#if (SD_SPI_CAPTURE_ENABLE == 1)
+    uint32_t off = tail & (SD_SPI_CAPTURE_BUF_SIZE - 1);
+    uint32_t first = 0;
+
+    n = head - tail;
+    if (n > max)
+        n = max;
+    sd_barrier();
+
+    first = SD_SPI_CAPTURE_BUF_SIZE - off;
+    if (first > n)
+        first = n;
+    memcpy(buf, &log_buf[off], first);
+    memcpy((uint8_t *) buf + first, log_buf, n - first);
+
+    sd_barrier();
+    tail += n;
+    if (lost != NULL)
+    {
+        uint32_t total = lost_total + cap.dropped;
+        *lost = total - lost_seen;
+        lost_seen = total;
+    }
+#else
+    (void) max;
+#endif
+
+    return n;
+}
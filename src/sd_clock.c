@@ -0,0 +1,330 @@
+/**
+ * @file sd_clock.c
+ * @author SouthernSandbox (https://github.com/SouthernSandbox)
+ * @brief SPI 时钟管理：按 TRAN_SPEED 设置时钟、训练可靠的最高时钟、CRC 错误率过高时自动降速
+ * @version 0.1
+ * @date 2025-08-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "sd_spi_driver.h"
+#include "sd_private.h"
+#include "string.h"
+
+#define SD_TRACE_FILE_ID    14          // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
+#define CLOCK_STEP_DOWN(hz)     ((hz) / 4 * 3)      // 训练和运行时降速每次降低到的时钟
+
+#if (SD_SPI_CLOCK_TRAIN_ENABLE == 1)
+static uint8_t ref_buf[SD_SPI_CLOCK_TRAIN_BUF_SIZE];      // 低速读取的训练块数据
+static uint8_t train_buf[SD_SPI_CLOCK_TRAIN_BUF_SIZE];    // 待检验时钟下读取的训练块数据
+#endif
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 设置时钟并记录实际的时钟
+ * @param card      [in]  SD卡对象
+ * @param hz        [in]  请求的时钟（Hz）
+ * @return uint32_t [out] 实际的时钟（Hz），端口未实现 set_clock() 或设置失败时返回 0
+ */
+static uint32_t _apply(struct sd_card* card, uint32_t hz)
+{
+    card->clock.hz = sd_spi_hw_set_clock(card, hz);
+    trace_d(card, "SPI clock: request %d Hz, got %d Hz", hz, card->clock.hz);
+    return card->clock.hz;
+}
+
+/**
+ * @brief 获取数据传输阶段允许的最高时钟
+ * @param card      [in]  SD卡对象
+ * @return uint32_t [out] TRAN_SPEED 与 SD_SPI_CLOCK_MAX_HZ 中的较小者（Hz）
+ */
+static uint32_t _ceiling(struct sd_card* card)
+{
+    if (card->info.max_hz != 0 && card->info.max_hz < SD_SPI_CLOCK_MAX_HZ)
+        return card->info.max_hz;
+    return SD_SPI_CLOCK_MAX_HZ;
+}
+
+/**
+ * @brief 清空运行时降速的统计窗口
+ * @param card      [in]  SD卡对象
+ */
+static void _reset_window(struct sd_card* card)
+{
+    card->clock.win_blocks = 0;
+    card->clock.win_errs = 0;
+}
+
+#if (SD_SPI_CLOCK_TRAIN_ENABLE == 1)
+/**
+ * @brief 读取训练块
+ * @param card              [in]  SD卡对象
+ * @param buf               [out] 数据缓冲区
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _read_train_block(struct sd_card* card, uint8_t* buf)
+{
+    struct sd_iovec seg = {.buf = buf, .len = card->info.block_size};
+    struct sd_iov_cursor cur = {.iov = &seg, .idx = 0, .off = 0};
+    return sd_card_rw_blocks_direct(card, SD_SPI_CLOCK_TRAIN_BLOCK, 1, &cur, false, 0);
+}
+
+/**
+ * @brief 检验当前时钟是否可靠
+ * @note 连续读取训练块 SD_SPI_CLOCK_TRAIN_ROUNDS 次，每次都读取成功、没有出现 CRC 错误（含重传后成功的）
+ *       且数据与低速读取的参考数据一致时认为可靠。
+ * @param card      [in]  SD卡对象
+ * @return true     [out] 可靠
+ * @return false    [out] 不可靠
+ */
+static bool _probe(struct sd_card* card)
+{
+    for (uint32_t i = 0; i < SD_SPI_CLOCK_TRAIN_ROUNDS; i++)
+    {
+        uint32_t crc_errs = card->clock.crc_errs;
+        if (_read_train_block(card, train_buf) != Sd_Err_OK || card->clock.crc_errs != crc_errs)
+            return false;
+        if (memcmp(train_buf, ref_buf, card->info.block_size) != 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 训练时钟：从最高时钟开始逐级降低，找出能可靠读取训练块的最高时钟
+ * @note 完成后 card->clock.max_hz 为训练结果，运行时降速不会超过该值。
+ * @param card              [in]  SD卡对象
+ * @return enum sd_error    [out] 错误码，低速下也无法可靠读取时返回 Sd_Err_Failed
+ */
+static enum sd_error _train(struct sd_card* card)
+{
+    enum sd_error err = Sd_Err_OK;
+    uint32_t hz = _ceiling(card);
+
+    if (card->info.block_size > sizeof(ref_buf))
+    {
+        trace_w(card, "clock training skipped: block size %d B", card->info.block_size);
+        return Sd_Err_Unsupported;
+    }
+
+    card->clock.is_training = true;
+
+    /** 1. 以识别阶段的时钟读取参考数据 **/
+    if (_apply(card, SD_SPI_CLOCK_INIT_HZ) == 0)
+        err = Sd_Err_IO;
+    else
+        err = _read_train_block(card, ref_buf);
+
+    /** 2. 从最高时钟开始检验，不可靠则降为实际时钟的 3/4，最低降至识别阶段的时钟 **/
+    while (err == Sd_Err_OK)
+    {
+        uint32_t got = _apply(card, hz);
+        if (got == 0)
+        {
+            err = Sd_Err_IO;
+            break;
+        }
+        if (_probe(card))
+            break;
+
+        trace_i(card, "clock training: %d Hz unreliable", got);
+        if (got <= SD_SPI_CLOCK_INIT_HZ)
+        {
+            err = Sd_Err_Failed;
+            break;
+        }
+        hz = CLOCK_STEP_DOWN(got);
+        if (hz < SD_SPI_CLOCK_INIT_HZ)
+            hz = SD_SPI_CLOCK_INIT_HZ;
+    }
+
+    card->clock.is_training = false;
+    _reset_window(card);
+
+    if (err != Sd_Err_OK)
+    {
+        trace_e(card, "clock training failed: %d", err);
+        return err;
+    }
+
+    card->clock.max_hz = card->clock.hz;
+    trace_i(card, "clock training: %d Hz", card->clock.hz);
+    return Sd_Err_OK;
+}
+#endif
+
+#if (SD_SPI_CLOCK_FALLBACK_ERRORS != 0)
+/**
+ * @brief 运行时降低一级时钟
+ * @param card      [in]  SD卡对象
+ */
+static void _step_down(struct sd_card* card)
+{
+    uint32_t hz = CLOCK_STEP_DOWN(card->clock.hz);
+    uint32_t old = card->clock.hz;
+
+    if (card->clock.hz <= SD_SPI_CLOCK_INIT_HZ)
+        return;
+    if (hz < SD_SPI_CLOCK_INIT_HZ)
+        hz = SD_SPI_CLOCK_INIT_HZ;
+
+    /** 端口设置失败时恢复原来的时钟 **/
+    if (_apply(card, hz) == 0)
+    {
+        _apply(card, old);
+        return;
+    }
+
+    card->clock.max_hz = card->clock.hz;
+    stats_add(card, clock_drops, 1);
+    trace_w(card, "%d CRC errors in %d blocks, SPI clock lowered to %d Hz", card->clock.win_errs, card->clock.win_blocks, card->clock.hz);
+}
+#endif
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 设置识别阶段的时钟
+ * @note 端口未实现 set_clock() 时通过 control() 切换为低速。
+ * @param card  [in]  SD卡对象
+ */
+void sd_clock_set_identify(struct sd_card* card)
+{
+    card->clock.max_hz = SD_SPI_CLOCK_INIT_HZ;
+    card->clock.is_training = false;
+    _reset_window(card);
+
+    if (_apply(card, SD_SPI_CLOCK_INIT_HZ) == 0)
+        sd_spi_hw_set_speed(card, Sd_User_Ctrl_Set_Low_Speed);
+}
+
+/**
+ * @brief 设置默认速度模式的时钟（ACMD41 完成后调用）
+ * @note 卡完成初始化（退出识别状态）后即可使用默认速度模式的时钟（不超过 25MHz），读取 OCR/CSD 不必等到解析 TRAN_SPEED 之后。
+ *       端口未实现 set_clock() 时通过 control() 切换为高速。
+ * @param card  [in]  SD卡对象
+ */
+void sd_clock_set_default(struct sd_card* card)
+{
+    uint32_t hz = (SD_SPI_CLOCK_MAX_HZ < SD_DEFAULT_SPEED_MAX_HZ) ? SD_SPI_CLOCK_MAX_HZ : SD_DEFAULT_SPEED_MAX_HZ;
+
+    if (_apply(card, hz) == 0)
+        sd_spi_hw_set_speed(card, Sd_User_Ctrl_Set_High_Speed);
+}
+
+/**
+ * @brief 设置数据传输阶段的时钟（需在识别卡之后调用）
+ * @note 时钟取 TRAN_SPEED 与 SD_SPI_CLOCK_MAX_HZ 中的较小者，开启训练时进一步找出可靠的最高时钟。
+ *       端口未实现 set_clock() 时通过 control() 切换为高速。
+ * @param card              [in]  SD卡对象
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_clock_set_transfer(struct sd_card* card)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    card->clock.max_hz = _ceiling(card);
+    _reset_window(card);
+
+    if (_apply(card, card->clock.max_hz) == 0)
+    {
+        sd_spi_hw_set_speed(card, Sd_User_Ctrl_Set_High_Speed);
+        return Sd_Err_OK;
+    }
+
+#if (SD_SPI_CLOCK_TRAIN_ENABLE == 1)
+    /** 块大小超出训练缓冲区时不训练，保持最高时钟 **/
+    if ((err = _train(card)) == Sd_Err_Unsupported)
+    {
+        _apply(card, card->clock.max_hz);
+        err = Sd_Err_OK;
+    }
+#endif
+
+    return err;
+}
+
+/**
+ * @brief 统计一次读写的 CRC 错误，统计窗口内错误次数达到阈值时降低一级时钟
+ * @note 需在取消选择卡之后调用。
+ * @param card      [in]  SD卡对象
+ * @param blocks    [in]  已完成的块数
+ * @param crc_errs  [in]  出现的 CRC 错误次数（含重传后成功的）
+ */
+void sd_clock_account(struct sd_card* card, uint32_t blocks, uint32_t crc_errs)
+{
+    card->clock.crc_errs += crc_errs;
+
+#if (SD_SPI_CLOCK_FALLBACK_ERRORS != 0)
+    if (card->clock.hz == 0 || card->clock.is_training)
+        return;
+
+    card->clock.win_blocks += blocks;
+    card->clock.win_errs += crc_errs;
+    if (card->clock.win_errs >= SD_SPI_CLOCK_FALLBACK_ERRORS)
+    {
+        _step_down(card);
+        _reset_window(card);
+    }
+    else if (card->clock.win_blocks >= SD_SPI_CLOCK_FALLBACK_WINDOW)
+        _reset_window(card);
+#else
+    (void) blocks;
+#endif
+}
+
+/**
+ * @brief 获取当前 SPI 时钟
+ * @param card      [in]  SD卡对象
+ * @return uint32_t [out] 当前时钟（Hz），端口未实现 set_clock() 时返回 0
+ */
+uint32_t sd_card_get_clock(struct sd_card* card)
+{
+    if (card == NULL)
+        return 0;
+    return card->clock.hz;
+}
+
+/**
+ * @brief 重新训练时钟
+ * @note 从 TRAN_SPEED 与 SD_SPI_CLOCK_MAX_HZ 中的较小者开始重新检验，可用于运行时降速后（如温度恢复）重新提高时钟。
+ *       训练只读取 SD_SPI_CLOCK_TRAIN_BLOCK，不经过缓存。
+ * @param card              [in]  SD卡对象
+ * @return enum sd_error    [out] 错误码，未开启 SD_SPI_CLOCK_TRAIN_ENABLE 或端口未实现 set_clock() 时返回 Sd_Err_Unsupported
+ */
+enum sd_error sd_card_train_clock(struct sd_card* card)
+{
+    if (card == NULL)
+        return Sd_Err_Param;
+    if (!card->is_inited)
+        return Sd_Err_Not_Inited;
+    if (card->async.req != NULL || card->is_selected)
+        return Sd_Err_No_Ready;
+
+#if (SD_SPI_CLOCK_TRAIN_ENABLE == 1)
+    if (card->clock.hz == 0)
+        return Sd_Err_Unsupported;
+
+    enum sd_error err = _train(card);
+    if (err != Sd_Err_OK)
+        _apply(card, card->clock.max_hz);
+    return err;
+#else
+    return Sd_Err_Unsupported;
+#endif
+}
@@ -12,6 +12,8 @@
 #include "sd_private.h"
 #include "string.h"
 
+#define SD_TRACE_FILE_ID    3           // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
 /**
  * @brief 管理器
  */
@@ -25,6 +27,7 @@ static struct manager mgr =
 {
     .card_count = (uint16_t) COUNT_OF(arr_cards),
 };
+static uint8_t bounce_buf[SD_SPI_BOUNCE_BUF_SIZE];          // 非对齐读写共用的中转缓冲区
 
 
 
@@ -62,36 +65,170 @@ static enum sd_error _card_power_off (struct sd_card* card)
     return sd_card_into_idle(card);
 }
 
+#if (SD_SPI_CRC_ENABLE == 1)
 /**
- * @brief 将用户请求转换为内部块操作参数
+ * @brief 打开卡的CRC校验（CMD59）
+ * @note 卡复位（CMD0）后CRC校验默认关闭，因此每次初始化都需要重新打开。
  * @param card              [in]  SD卡对象
- * @param request           [in]  用户请求（字节地址和长度）
- * @param operation         [out] 内部操作参数（块地址和块数）
  * @return enum sd_error    [out] 错误码
  */
-static void _conv_req_to_lba(struct sd_card *card, struct sd_lba_req* req, struct sd_lba_oparg* oparg)
+static enum sd_error _card_crc_on (struct sd_card* card)
 {
-    /** 计算块数 **/
-    oparg->lba_count = req->len / card->info.block_size;
+    enum sd_error err = Sd_Err_OK;
+    struct sd_cmd_req req =
+    {
+        .cmd = Sd_Cmd59_Crc_On_Off, .arg = 1, .crc = SD_CMD_CRC_CMD59_ON,
+        .resp_type = Sd_Resp_Type_R1, .retry = 5
+    };
+    struct sd_resp_res resp = {0};
 
-    /** 根据卡类型计算块地址 **/
-    if (card->info.type == Sd_Type_SDHC || card->info.type == Sd_Type_SDXC)
-        oparg->lba_addr = (uint32_t) (req->offset / card->info.block_size);       // SDHC/SDXC使用块地址
-    else
-        oparg->lba_addr = (uint32_t) req->offset;                                 // SDSC使用字节地址
+    if((err = sd_spi_hw_select_card(card)) != Sd_Err_OK)
+        return err;
+
+    if((err = sd_card_send_cmd_req(card, &req, &resp)) == Sd_Err_OK && resp.buf[0] != SD_FR_NONE)
+    {
+        trace_e(card, "CMD59 error: 0x%02X", resp.buf[0]);
+        err = Sd_Err_Response;
+    }
+
+    sd_spi_hw_deselect_card(card);
+
+    return err;
+}
+#endif
+
+/**
+ * @brief 统计数据段的总长度，并检查数据段是否有效
+ * @param iov               [in]  数据段数组
+ * @param iovcnt            [in]  数据段数量
+ * @param total             [out] 总长度（字节）
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _iov_total(const struct sd_iovec *iov, uint32_t iovcnt, uint32_t *total)
+{
+    uint64_t sum = 0;
+
+    for (uint32_t i = 0; i < iovcnt; i++)
+    {
+        if (iov[i].buf == NULL && iov[i].len != 0)
+            return Sd_Err_Param;
+        sum += iov[i].len;
+    }
+
+    if (sum == 0 || sum > UINT32_MAX)
+        return Sd_Err_Param;
+
+    *total = (uint32_t) sum;
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 按数据段游标收发数据，跨越数据段边界时拆分为多次传输，不经过中间缓冲区
+ * @param card              [in]  SD卡对象
+ * @param cur               [in]  数据段游标，传输后前移 len 字节
+ * @param len               [in]  传输长度（字节）
+ * @param is_write          [in]  true：发送；false：接收
+ * @param crc               [out] 不为 NULL 时，在原值的基础上累计传输数据的 CRC16
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _iov_xfer(struct sd_card *card, struct sd_iov_cursor *cur, uint32_t len, bool is_write, uint16_t *crc)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    while (len != 0)
+    {
+        const struct sd_iovec *seg = &cur->iov[cur->idx];
+        uint32_t n = seg->len - cur->off;
+
+        if (n > len)
+            n = len;
+        if (n != 0)
+        {
+            uint8_t *ptr = (uint8_t *) seg->buf + cur->off;
+            if ((err = is_write ? sd_spi_hw_bulk_write(card, ptr, n) : sd_spi_hw_bulk_read(card, ptr, n)) != Sd_Err_OK)
+                return err;
+            if (crc != NULL)
+                *crc = sd_crc16(*crc, ptr, n);
+            cur->off += n;
+            len -= n;
+        }
+
+        /** 当前数据段已用完，切换到下一个数据段 **/
+        if (cur->off == seg->len)
+        {
+            cur->idx++;
+            cur->off = 0;
+        }
+    }
+
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 接收一个数据包：等待数据令牌，读取数据和CRC
+ * @param card              [in]  SD卡对象
+ * @param cur               [out] 数据段游标，接收的数据依次写入数据段
+ * @param len               [in]  数据长度（数据块为块大小，ACMD22 等为更短的数据）
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _read_data_packet(struct sd_card *card, struct sd_iov_cursor *cur, uint32_t len)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    /** 1. 等待数据令牌 (0xFE) **/
+    {
+        uint8_t token;
+        if ((err = sd_card_wait_token(card, &token, SD_SPI_READ_TIMEOUT_US)) != Sd_Err_OK)
+        {
+            trace_w(card, "Data token timeout");
+            return err;
+        }
+
+        if (token != 0xFE)
+        {
+            trace_e(card, "Data error token: 0x%02X", token);
+            return Sd_Err_Response;
+        }
+    }
 
-    trace_d(card, "req: offset=0x%lx, len=%d, blk_size=%d", req->offset, req->len, card->info.block_size); 
-    trace_d(card, "oparg: lba_addr=0x%x, lba_count=%d", oparg->lba_addr, oparg->lba_count);
+    /** 2. 读取数据和CRC，开启CRC校验时比对CRC，否则丢弃 **/
+    {
+        uint32_t t_lat = lat_begin(card);
+        uint8_t crc[2];
+#if (SD_SPI_CRC_ENABLE == 1)
+        uint16_t calc = 0;
+        if ((err = _iov_xfer(card, cur, len, false, &calc)) != Sd_Err_OK)
+            return err;
+#else
+        if ((err = _iov_xfer(card, cur, len, false, NULL)) != Sd_Err_OK)
+            return err;
+#endif
+
+        if ((err = sd_spi_hw_read_bytes(card, crc, sizeof(crc))) != Sd_Err_OK)
+            return err;
+
+#if (SD_SPI_CRC_ENABLE == 1)
+        if ((((uint16_t) crc[0] << 8) | crc[1]) != calc)
+        {
+            trace_w(card, "Data CRC mismatch: 0x%04X != 0x%04X", ((uint16_t) crc[0] << 8) | crc[1], calc);
+            return Sd_Err_Crc;
+        }
+#endif
+        if (len == card->info.block_size)
+            lat_record(card, Sd_Lat_Block_Xfer, t_lat);
+    }
+
+    return Sd_Err_OK;
 }
 
 /**
  * @brief 读取单个数据块
  * @param card              [in]  SD卡对象
  * @param lba               [in]  逻辑块地址
- * @param buf               [out] 数据缓冲区（至少512字节）
+ * @param cur               [out] 数据段游标
  * @return enum sd_error    [out] 错误码
  */
-static enum sd_error _read_single_block(struct sd_card *card, uint32_t lba, uint8_t *buf)
+static enum sd_error _read_single_block(struct sd_card *card, uint32_t lba, struct sd_iov_cursor *cur)
 {
     enum sd_error err = Sd_Err_OK;
 
@@ -99,7 +236,7 @@ static enum sd_error _read_single_block(struct sd_card *card, uint32_t lba, uint
     {
         struct sd_cmd_req req = 
         {
-            .cmd = Sd_Cmd17_Rd_Single, .arg = lba, .crc = 1,
+            .cmd = Sd_Cmd17_Rd_Single, .arg = lba, .crc = SD_CMD_CRC_AUTO,
             .resp_type = Sd_Resp_Type_R1, .retry = 5
         };
 
@@ -114,131 +251,762 @@ static enum sd_error _read_single_block(struct sd_card *card, uint32_t lba, uint
         }
     }
 
-    /** 2. 等待数据令牌 (0xFE) **/
+    /** 2. 接收数据包 **/
+    return _read_data_packet(card, cur, card->info.block_size);
+}
+
+#if (SD_SPI_MULTI_BLOCK_ENABLE == 1)
+/**
+ * @brief 停止多块传输（CMD12）
+ * @param card              [in]  SD卡对象
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _stop_transmission(struct sd_card *card)
+{
+    enum sd_error err = Sd_Err_OK;
+    struct sd_cmd_req req =
     {
-        uint8_t token;
-        uint8_t timeout = 100;
-        do
+        .cmd = Sd_Cmd12_Stop_Xfer, .arg = 0, .crc = SD_CMD_CRC_CMD12,
+        .resp_type = Sd_Resp_Type_R1b, .retry = 5
+    };
+
+    struct sd_resp_res resp = {0};
+    if ((err = sd_card_send_cmd_req(card, &req, &resp)) != Sd_Err_OK)
+        return err;
+
+    if (resp.buf[0] != SD_FR_NONE)
+    {
+        trace_e(card, "CMD12 error: 0x%02X", resp.buf[0]);
+        return Sd_Err_Response;
+    }
+
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 读取多个连续数据块（CMD18 + CMD12）
+ * @note 一条 CMD18 命令之后，卡连续输出数据包，主机只需逐个等待数据令牌并接收数据，最后通过 CMD12 结束传输。
+ *       相比逐块发送 CMD17，省去了每个块的命令帧与 R1 轮询开销。
+ * @param card              [in]  SD卡对象
+ * @param lba               [in]  起始逻辑块地址
+ * @param count             [in]  块数量
+ * @param cur               [out] 数据段游标（总长度至少 count 个块大小）
+ * @param done              [out] 成功读取的块数
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _read_multi_block(struct sd_card *card, uint32_t lba, uint32_t count, struct sd_iov_cursor *cur, uint32_t *done)
+{
+    enum sd_error err = Sd_Err_OK;
+    enum sd_error stop_err = Sd_Err_OK;
+
+    *done = 0;
+
+    /** 1. 发送CMD18读取多个块，并检查响应 **/
+    {
+        struct sd_cmd_req req = 
         {
-            if ((err = sd_spi_hw_read_byte(card, &token)) != Sd_Err_OK)
-                return err;
-        } while (token != 0xFE && --timeout);
+            .cmd = Sd_Cmd18_Rd_Multi, .arg = lba, .crc = SD_CMD_CRC_AUTO,
+            .resp_type = Sd_Resp_Type_R1, .retry = 5
+        };
+
+        struct sd_resp_res resp = {0};
+        if ((err = sd_card_send_cmd_req(card, &req, &resp)) != Sd_Err_OK)
+            return err;
+
+        if (resp.buf[0] != SD_FR_NONE)
+        {
+            trace_e(card, "CMD18 error: 0x%02X", resp.buf[0]);
+            return Sd_Err_Response;
+        }
+    }
+
+    /** 2. 逐个接收数据包 **/
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if ((err = _read_data_packet(card, cur, card->info.block_size)) != Sd_Err_OK)
+        {
+            trace_e(card, "CMD18 block[%d] failed, code: 0x%02x", i, err);
+            break;
+        }
+        (*done)++;
+    }
+
+    /** 3. 无论是否出错，都需要发送CMD12结束传输 **/
+    if ((stop_err = _stop_transmission(card)) != Sd_Err_OK)
+        trace_e(card, "CMD12 failed, code: 0x%02x", stop_err);
+
+    return (err != Sd_Err_OK) ? err : stop_err;
+}
+#endif
+
+/**
+ * @brief 发送一个数据包：数据令牌、数据块和CRC，并检查数据响应令牌
+ * @note 未开启CRC校验时发送虚拟CRC（卡会忽略）。本函数不等待卡完成编程，调用者需要在之后自行等待忙状态结束。
+ * @param card              [in]  SD卡对象
+ * @param token             [in]  数据令牌，单块写为 0xFE，多块写为 0xFC
+ * @param cur               [in]  数据段游标（剩余长度至少一个块大小）
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _write_data_block(struct sd_card *card, uint8_t token, struct sd_iov_cursor *cur)
+{
+    enum sd_error err = Sd_Err_OK;
+    uint32_t t_lat = lat_begin(card);
 
-        if (timeout == 0)
+    /** 1. 发送数据令牌，写入数据块和CRC **/
+    {
+        uint16_t calc = 0xFFFF;
+        if ((err = sd_spi_hw_write_byte(card, token)) != Sd_Err_OK)
+        {
+            trace_e(card, "Write token(0x%02X) failed", token);
+            return err;
+        }  
+#if (SD_SPI_CRC_ENABLE == 1)
+        calc = 0;
+        err = _iov_xfer(card, cur, card->info.block_size, true, &calc);
+#else
+        err = _iov_xfer(card, cur, card->info.block_size, true, NULL);
+#endif
+        if (err != Sd_Err_OK)
+        {
+            trace_e(card, "Write data error");
+            return err;
+        }
+        uint8_t crc[2] = {(uint8_t) (calc >> 8), (uint8_t) calc};
+        if ((err = sd_spi_hw_write_bytes(card, crc, sizeof(crc))) != Sd_Err_OK)
         {
-            trace_w(card, "Data token timeout for CMD17");
-            return Sd_Err_Timeout;
+            trace_e(card, "Write crc error");
+            return err;
         }
     }
 
-    /** 3. 读取数据 **/
+    /** 2. 检查数据响应令牌 **/
     {
-        /** 读取数据块 **/
-        if ((err = sd_spi_hw_read_bytes(card, buf, card->info.block_size)) != Sd_Err_OK)
+        /** 检查数据响应令牌 **/
+        uint8_t data_resp;
+        if ((err = sd_spi_hw_read_byte(card, &data_resp)) != Sd_Err_OK)
+        {
+            trace_e(card, "Read data resp error");
             return err;
+        }
 
-        /** 读取并丢弃CRC **/
-        uint8_t crc[2];
-        if ((err = sd_spi_hw_read_bytes(card, crc, sizeof(crc))) != Sd_Err_OK)
+        /** 检查响应令牌是否有效：0x05 数据被接受，0x0B 数据CRC错误，0x0D 写入错误 **/
+        if ((data_resp & 0x1F) == 0x0B)
+        {
+            trace_w(card, "Data rejected due to CRC error");
+            return Sd_Err_Crc;
+        }
+        if ((data_resp & 0x1F) != 0x05)
+        {
+            trace_e(card, "Data response error: 0x%02X", data_resp);
+            return Sd_Err_Response;
+        }
+    }
+
+    lat_record(card, Sd_Lat_Block_Xfer, t_lat);
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 写入单个数据块
+ * @param card              [in]  SD卡对象
+ * @param lba               [in]  块地址
+ * @param cur               [in]  数据段游标
+ * @param defer_busy        [in]  是否推迟编程忙等待，见 SD_WR_OPT_DEFER_BUSY
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _write_single_block(struct sd_card *card, uint32_t lba, struct sd_iov_cursor *cur, bool defer_busy)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    /** 1. 发送CMD24写入单个块命令并等待响应 **/
+    {
+        struct sd_cmd_req req = 
+        {
+            .cmd = Sd_Cmd24_Wr_Single_Blk, .arg = lba, .crc = SD_CMD_CRC_AUTO,
+            .resp_type = Sd_Resp_Type_R1, .retry = 5
+        };
+
+        struct sd_resp_res resp = {0};
+        if ((err = sd_card_send_cmd_req(card, &req, &resp)) != Sd_Err_OK)
+        {
+            trace_e(card, "CMD24 send cmd error: 0x%02X", resp.buf[0]);
+            return err;
+        }
+
+        /** 检查响应 **/
+        if (resp.buf[0] != 0x00)
+        {
+            trace_e(card, "CMD24 resp error: 0x%02X", resp.buf[0]);
+            return Sd_Err_Response;
+        }
+    }
+
+    /** 2. 发送数据包并检查数据响应，被拒绝时卡可能短暂处于忙状态，需等待其就绪 **/
+    if ((err = _write_data_block(card, 0xFE, cur)) != Sd_Err_OK)
+    {
+        sd_card_wait_ready(card, SD_SPI_WRITE_TIMEOUT_US);
+        return err;
+    }
+
+    /** 3. 等待卡完成编程（读取忙状态），推迟时仅做标记，由下一条命令或 sd_card_sync() 等待 **/
+    if (defer_busy)
+        card->is_busy_pending = true;
+    else if ((err = sd_card_wait_ready(card, SD_SPI_WRITE_TIMEOUT_US)) != Sd_Err_OK)
+    {
+        trace_w(card, "Write busy timeout");
+        return err;
+    }
+
+    return Sd_Err_OK;
+}
+
+#if (SD_SPI_MULTI_BLOCK_ENABLE == 1)
+/**
+ * @brief 查询最近一次写操作中正确写入的块数（ACMD22）
+ * @param card              [in]  SD卡对象
+ * @param count             [out] 正确写入的块数
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _get_written_blocks(struct sd_card *card, uint32_t *count)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    /** 1. 发送CMD55 + ACMD22 **/
+    {
+        struct sd_cmd_req req_cmd55 = 
+        {
+            .cmd = Sd_Cmd55_App_Cmd, .arg = 0, .crc = SD_CMD_CRC_CMD55,
+            .resp_type = Sd_Resp_Type_R1, .retry = 5
+        };
+        struct sd_resp_res resp_cmd55 = {0};
+        if ((err = sd_card_send_cmd_req(card, &req_cmd55, &resp_cmd55)) != Sd_Err_OK)
+            return err;
+
+        struct sd_cmd_req req_acmd22 = 
+        {
+            .cmd = Sd_Acmd22_Num_Wr_Blocks, .arg = 0, .crc = SD_CMD_CRC_ACMD22,
+            .resp_type = Sd_Resp_Type_R1, .retry = 5
+        };
+        struct sd_resp_res resp_acmd22 = {0};
+        if ((err = sd_card_send_cmd_req(card, &req_acmd22, &resp_acmd22)) != Sd_Err_OK)
+            return err;
+
+        if (resp_acmd22.buf[0] != SD_FR_NONE)
+        {
+            trace_e(card, "ACMD22 error: 0x%02X", resp_acmd22.buf[0]);
+            return Sd_Err_Response;
+        }
+    }
+
+    /** 2. 接收 4 字节的块数（大端） **/
+    {
+        uint8_t num[4];
+        struct sd_iovec seg = {.buf = num, .len = sizeof(num)};
+        struct sd_iov_cursor cur = {.iov = &seg, .idx = 0, .off = 0};
+        if ((err = _read_data_packet(card, &cur, sizeof(num))) != Sd_Err_OK)
+            return err;
+
+        *count = ((uint32_t)num[0] << 24) | ((uint32_t)num[1] << 16) | ((uint32_t)num[2] << 8) | num[3];
+    }
+
+    return Sd_Err_OK;
+}
+#endif
+
+#if (SD_SPI_HIGH_SPEED_ENABLE == 1)
+/**
+ * @brief 发送 CMD6（SWITCH_FUNC）并接收 64 字节的功能状态
+ * @param card              [in]  SD卡对象
+ * @param arg               [in]  命令参数，SD_SWITCH_MODE_XXX 与各功能组功能号的组合
+ * @param crc               [in]  命令帧最后一个字节，SD_CMD_CRC_XXX
+ * @param status            [out] 解析后的功能状态
+ * @return enum sd_error    [out] 错误码，卡不支持 CMD6 时返回 Sd_Err_Unsupported
+ */
+static enum sd_error _switch_func(struct sd_card *card, uint32_t arg, uint8_t crc, struct sd_switch_status *status)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    /** 1. 发送CMD6 **/
+    {
+        struct sd_cmd_req req =
+        {
+            .cmd = Sd_Cmd6_Switch_Func, .arg = arg, .crc = crc,
+            .resp_type = Sd_Resp_Type_R1, .retry = 5
+        };
+        struct sd_resp_res resp = {0};
+        if ((err = sd_card_send_cmd_req(card, &req, &resp)) != Sd_Err_OK)
+            return err;
+
+        if (resp.buf[0] != SD_FR_NONE)
+        {
+            trace_w(card, "CMD6 error: 0x%02X", resp.buf[0]);
+            return (resp.buf[0] & SD_FR_ILLEGAL_COMMAND) ? Sd_Err_Unsupported : Sd_Err_Response;
+        }
+    }
+
+    /** 2. 接收并解析 64 字节的功能状态 **/
+    {
+        uint8_t raw[64];
+        struct sd_iovec seg = {.buf = raw, .len = sizeof(raw)};
+        struct sd_iov_cursor cur = {.iov = &seg, .idx = 0, .off = 0};
+        if ((err = _read_data_packet(card, &cur, sizeof(raw))) != Sd_Err_OK)
+            return err;
+
+        sd_card_parse_switch_status(raw, status);
+    }
+
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 切换至高速模式（CMD6 功能组 1 的功能 1）
+ * @note 先以查询模式确认卡支持高速模式，再以切换模式切换。成功后 TRAN_SPEED 变为 50MHz，info.max_hz 随之提高；
+ *       v1.00 卡（CCC 不含 class 10）不支持 CMD6。
+ * @param card              [in]  SD卡对象
+ * @return enum sd_error    [out] 错误码，卡不支持高速模式时返回 Sd_Err_Unsupported
+ */
+static enum sd_error _card_high_speed(struct sd_card *card)
+{
+    enum sd_error err = Sd_Err_OK;
+    struct sd_switch_status status = {0};
+
+    /** 1. 检查卡是否支持切换功能命令（class 10） **/
+    if ((card->info.ccc & (1 << 10)) == 0)
+        return Sd_Err_Unsupported;
+
+    if ((err = sd_spi_hw_select_card(card)) != Sd_Err_OK)
+        return err;
+
+    /** 2. 查询功能组 1 是否支持高速模式 **/
+    err = _switch_func(card, SD_SWITCH_MODE_CHECK | SD_SWITCH_GROUP1_HIGH_SPEED, SD_CMD_CRC_CMD6_CHECK_HS, &status);
+    if (err == Sd_Err_OK && ((status.support[0] & (1 << 1)) == 0 || status.selected[0] != 1))
+        err = Sd_Err_Unsupported;
+
+    /** 3. 切换至高速模式，功能号仍为 1 表示切换成功 **/
+    if (err == Sd_Err_OK)
+    {
+        err = _switch_func(card, SD_SWITCH_MODE_SWITCH | SD_SWITCH_GROUP1_HIGH_SPEED, SD_CMD_CRC_CMD6_SWITCH_HS, &status);
+        if (err == Sd_Err_OK && status.selected[0] != 1)
+            err = Sd_Err_Failed;
+    }
+
+    sd_spi_hw_deselect_card(card);
+    sd_spi_hw_send_dummy(card, 1);      // 切换在功能状态之后生效，再提供 8 个时钟
+
+    if (err != Sd_Err_OK)
+        return err;
+
+    card->info.is_high_speed = true;
+    card->info.max_hz = SD_HIGH_SPEED_MAX_HZ;
+    trace_i(card, "Switched to high speed mode, max current %d mA", status.max_current);
+    return Sd_Err_OK;
+}
+#endif
+
+#if (SD_SPI_MULTI_BLOCK_ENABLE == 1)
+/**
+ * @brief 设置多块写入的预擦除块数（ACMD23）
+ * @note 在 CMD25 之前告知卡即将写入的块数，卡可以提前擦除对应区域，避免对部分写入的擦除单元执行读-改-写。
+ *       该命令仅是提示，失败时不影响后续写入，因此只记录警告。
+ * @param card              [in]  SD卡对象
+ * @param count             [in]  即将写入的块数
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _set_pre_erase_count(struct sd_card *card, uint32_t count)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    /** 发送CMD55 (应用命令前缀) **/
+    struct sd_cmd_req req_cmd55 = 
+    {
+        .cmd = Sd_Cmd55_App_Cmd, .arg = 0, .crc = SD_CMD_CRC_CMD55,
+        .resp_type = Sd_Resp_Type_R1, .retry = 5
+    };
+    struct sd_resp_res resp_cmd55 = {0};
+    if ((err = sd_card_send_cmd_req(card, &req_cmd55, &resp_cmd55)) != Sd_Err_OK)
+        return err;
+
+    /** CMD55 被拒绝时，下一条命令会被当作普通的 CMD23，不能再发送 **/
+    if (resp_cmd55.buf[0] & ~SD_FR_IN_IDLE_STATE)
+    {
+        trace_w(card, "CMD55 before ACMD23 error: 0x%02X", resp_cmd55.buf[0]);
+        return Sd_Err_Response;
+    }
+
+    /** 发送ACMD23，块数为 23 位 **/
+    struct sd_cmd_req req_acmd23 = 
+    {
+        .cmd = Sd_Acmd23_Set_Wr_Blk_Erase, .arg = count & 0x7FFFFF, .crc = SD_CMD_CRC_AUTO,
+        .resp_type = Sd_Resp_Type_R1, .retry = 5
+    };
+    struct sd_resp_res resp_acmd23 = {0};
+    if ((err = sd_card_send_cmd_req(card, &req_acmd23, &resp_acmd23)) != Sd_Err_OK)
+        return err;
+
+    if (resp_acmd23.buf[0] != SD_FR_NONE)
+    {
+        trace_w(card, "ACMD23 error: 0x%02X", resp_acmd23.buf[0]);
+        return Sd_Err_Response;
+    }
+
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 写入多个连续数据块（CMD25 + Stop Tran 令牌）
+ * @note 一条 CMD25 命令之后，主机以 0xFC 令牌逐块发送数据，每块检查数据响应并等待卡退出忙状态，最后发送 0xFD 停止令牌。
+ *       若中途出错，则通过 ACMD22 查询卡实际写入的块数。
+ * @param card              [in]  SD卡对象
+ * @param lba               [in]  起始块地址
+ * @param count             [in]  块数量
+ * @param cur               [in]  数据段游标（总长度至少 count 个块大小）
+ * @param done              [out] 已写入卡的块数
+ * @param defer_busy        [in]  是否推迟停止令牌之后的编程忙等待，见 SD_WR_OPT_DEFER_BUSY
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _write_multi_block(struct sd_card *card, uint32_t lba, uint32_t count, struct sd_iov_cursor *cur, uint32_t *done, bool defer_busy)
+{
+    enum sd_error err = Sd_Err_OK;
+    enum sd_error stop_err = Sd_Err_OK;
+    uint32_t accepted = 0;
+
+    *done = 0;
+
+    /** 1. 发送CMD25写入多个块命令并等待响应 **/
+    {
+        struct sd_cmd_req req = 
+        {
+            .cmd = Sd_Cmd25_Wr_Multi_Blk, .arg = lba, .crc = SD_CMD_CRC_AUTO,
+            .resp_type = Sd_Resp_Type_R1, .retry = 5
+        };
+
+        struct sd_resp_res resp = {0};
+        if ((err = sd_card_send_cmd_req(card, &req, &resp)) != Sd_Err_OK)
             return err;
+
+        if (resp.buf[0] != SD_FR_NONE)
+        {
+            trace_e(card, "CMD25 resp error: 0x%02X", resp.buf[0]);
+            return Sd_Err_Response;
+        }
+    }
+
+    /** 2. 逐块发送数据包，每块之后等待卡退出忙状态 **/
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if ((err = _write_data_block(card, 0xFC, cur)) != Sd_Err_OK)
+        {
+            trace_e(card, "CMD25 block[%d] failed, code: 0x%02x", i, err);
+            break;
+        }
+        accepted++;
+
+        if ((err = sd_card_wait_ready(card, SD_SPI_WRITE_TIMEOUT_US)) != Sd_Err_OK)
+        {
+            trace_w(card, "CMD25 block[%d] busy timeout", i);
+            break;
+        }
+    }
+
+    /** 3. 发送停止令牌，跳过一个字节后等待卡完成编程（出错时卡可能仍处于忙状态，需先等待其就绪） **/
+    {
+        uint8_t nbr;
+        if (err != Sd_Err_OK)
+            sd_card_wait_ready(card, SD_SPI_WRITE_TIMEOUT_US);
+
+        if ((stop_err = sd_spi_hw_write_byte(card, 0xFD)) == Sd_Err_OK &&
+            (stop_err = sd_spi_hw_read_byte(card, &nbr)) == Sd_Err_OK)
+        {
+            if (defer_busy && err == Sd_Err_OK)
+                card->is_busy_pending = true;
+            else
+                stop_err = sd_card_wait_ready(card, SD_SPI_WRITE_TIMEOUT_US);
+        }
+
+        if (stop_err != Sd_Err_OK)
+            trace_e(card, "CMD25 stop failed, code: 0x%02x", stop_err);
+    }
+
+    /** 4. 统计实际写入的块数：成功时即为全部块，出错时以 ACMD22 的结果为准 **/
+    if (err == Sd_Err_OK && stop_err == Sd_Err_OK)
+        *done = count;
+    else if (_get_written_blocks(card, done) != Sd_Err_OK || *done > accepted)
+        *done = accepted;
+
+    return (err != Sd_Err_OK) ? err : stop_err;
+}
+#endif
+
+/**
+ * @brief 在已选中卡的情况下读写一段连续的块
+ * @param card              [in]  SD卡对象
+ * @param lba               [in]  起始块地址
+ * @param count             [in]  块数量
+ * @param cur               [in]  数据段游标（总长度至少 count 个块大小）
+ * @param is_write          [in]  true：写入；false：读取
+ * @param opts              [in]  写入选项，SD_WR_OPT_XXX 的按位组合，仅写入时有效
+ * @param done              [out] 已完成的块数
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _xfer_blocks(struct sd_card *card, uint32_t lba, uint32_t count, struct sd_iov_cursor *cur, bool is_write, uint32_t opts, uint32_t *done)
+{
+    enum sd_error err = Sd_Err_OK;
+    bool defer_busy = (opts & SD_WR_OPT_DEFER_BUSY) != 0;
+
+    *done = 0;
+
+#if (SD_SPI_MULTI_BLOCK_ENABLE == 1)
+    if (count > 1 && !card->is_single_block)
+    {
+        if (!is_write)
+            err = _read_multi_block(card, lba, count, cur, done);
+        else
+        {
+            if (opts & SD_WR_OPT_PRE_ERASE)
+                _set_pre_erase_count(card, count);
+            err = _write_multi_block(card, lba, count, cur, done, defer_busy);
+        }
+
+        if (err != Sd_Err_OK)
+            trace_e(card, "%c lba[%d] failed, code: 0x%02x, %d blocks done", is_write ? 'W' : 'R',
+                    lba + *done * sd_card_lba_step(card), err, *done);
+    }
+    else
+#endif
+    {
+        for (uint32_t i = 0; i < count; i++, (*done)++)
+        {
+            if (!is_write)
+                err = _read_single_block(card, lba + i * sd_card_lba_step(card), cur);
+            else
+                err = _write_single_block(card, lba + i * sd_card_lba_step(card), cur, defer_busy);
+
+            if (err != Sd_Err_OK)
+            {
+                trace_e(card, "%c lba[%d] failed, code: 0x%02x", is_write ? 'W' : 'R', lba + i * sd_card_lba_step(card), err);
+                break;
+            }
+        }
+    }
+
+    return err;
+}
+
+/**
+ * @brief 直接访问卡读写一段连续的块，整个过程只选中一次卡
+ * @note 开启CRC校验时，某个块出现CRC错误后，从该块开始重新传输剩余的块，已完成的块不会重复传输；
+ *       同一个块最多重传 SD_SPI_CRC_RETRY 次。执行后 card->xfer_blocks 为已完成的块数。
+ * @param card              [in]  SD卡对象
+ * @param blk               [in]  起始块号
+ * @param count             [in]  块数量
+ * @param cur               [in]  数据段游标（总长度至少 count 个块大小）
+ * @param is_write          [in]  true：写入；false：读取
+ * @param opts              [in]  写入选项，SD_WR_OPT_XXX 的按位组合，仅写入时有效
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_card_rw_blocks_direct(struct sd_card *card, uint32_t blk, uint32_t count, struct sd_iov_cursor *cur, bool is_write, uint32_t opts)
+{
+    enum sd_error err = Sd_Err_OK;
+    uint32_t lba = blk * sd_card_lba_step(card);       // SDSC使用字节地址
+#if (SD_SPI_CRC_ENABLE == 1)
+    struct sd_iov_cursor start = *cur;
+    uint32_t crc_blk = UINT32_MAX;
+    uint32_t retries = 0;
+    uint32_t crc_errs = 0;
+#endif
+
+    trace_d(card, "%c: blk=%d, lba_addr=0x%x, lba_count=%d", is_write ? 'W' : 'R', blk, lba, count);
+
+    card->xfer_blocks = 0;
+    if((err = sd_spi_hw_select_card(card)) != Sd_Err_OK)
+        return err;
+
+    while (1)
+    {
+        uint32_t done = 0;
+        err = _xfer_blocks(card, lba + card->xfer_blocks * sd_card_lba_step(card), count - card->xfer_blocks, cur, is_write, opts, &done);
+        card->xfer_blocks += done;
+
+#if (SD_SPI_CRC_ENABLE == 1)
+        /** 出现CRC错误时，游标回到出错块的起始位置，从该块继续传输 **/
+        if (err == Sd_Err_Crc)
+        {
+            crc_errs++;
+            if (crc_blk != card->xfer_blocks)
+            {
+                crc_blk = card->xfer_blocks;
+                retries = 0;
+            }
+            if (retries++ < SD_SPI_CRC_RETRY)
+            {
+                trace_w(card, "CRC error at blk %d, retry %d", blk + crc_blk, retries);
+                *cur = start;
+                sd_iov_copy(cur, NULL, card->xfer_blocks * card->info.block_size, false);
+                continue;
+            }
+        }
+#endif
+        break;
+    }
+
+    sd_spi_hw_deselect_card(card);
+
+#if (SD_SPI_CRC_ENABLE == 1)
+    /** CRC 错误计入时钟统计，错误率过高时降低时钟 **/
+    sd_clock_account(card, card->xfer_blocks, crc_errs);
+#endif
+
+#if (SD_SPI_STATS_ENABLE == 1)
+    stats_begin(card);
+    if (is_write)
+        card->stats.bytes_written += (uint64_t) card->xfer_blocks * card->info.block_size;
+    else
+        card->stats.bytes_read += (uint64_t) card->xfer_blocks * card->info.block_size;
+    if (err != Sd_Err_OK)
+        card->stats.errors[err]++;
+    stats_end(card);
+#endif
+
+    return err;
+}
+
+/**
+ * @brief 读写一段连续的块
+ * @note 不经过块缓存，供公共读写接口和块缓存模块使用。开启预读时，读取经过预读缓冲区，写入使预读缓冲区中重叠的块失效；
+ *       开启写合并时，写入经过写合并缓冲区，读取前写回与之重叠的缓冲数据。
+ *       执行后 card->xfer_blocks 为已完成的块数。
+ * @param card              [in]  SD卡对象
+ * @param blk               [in]  起始块号
+ * @param count             [in]  块数量
+ * @param cur               [in]  数据段游标（总长度至少 count 个块大小）
+ * @param is_write          [in]  true：写入；false：读取
+ * @param opts              [in]  写入选项，SD_WR_OPT_XXX 的按位组合，仅写入时有效
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_card_rw_blocks(struct sd_card *card, uint32_t blk, uint32_t count, struct sd_iov_cursor *cur, bool is_write, uint32_t opts)
+{
+#if (SD_SPI_WCOMB_ENABLE == 1)
+    enum sd_error err = Sd_Err_OK;
+    if (!is_write && (err = sd_wcomb_flush_range(card, blk, count)) != Sd_Err_OK)
+    {
+        card->xfer_blocks = 0;
+        return err;
     }
+#endif
+#if (SD_SPI_RAHEAD_ENABLE == 1)
+    if (!is_write)
+        return sd_rahead_read(card, blk, count, cur);
+    sd_rahead_invalidate(card, blk, count);
+#endif
+#if (SD_SPI_WCOMB_ENABLE == 1)
+    if (is_write)
+        return sd_wcomb_write(card, blk, count, cur, opts);
+#endif
+    return sd_card_rw_blocks_direct(card, blk, count, cur, is_write, opts);
+}
 
-    return Sd_Err_OK;
+/**
+ * @brief 经过块缓存（若开启）读写一段连续的块，供公共读写接口使用
+ * @param card              [in]  SD卡对象
+ * @param blk               [in]  起始块号
+ * @param count             [in]  块数量
+ * @param cur               [in]  数据段游标
+ * @param is_write          [in]  true：写入；false：读取
+ * @param opts              [in]  写入选项，仅写入时有效
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _rw_blocks(struct sd_card *card, uint32_t blk, uint32_t count, struct sd_iov_cursor *cur, bool is_write, uint32_t opts)
+{
+#if (SD_SPI_CACHE_ENABLE == 1)
+    return sd_cache_rw_blocks(card, blk, count, cur, is_write, opts);
+#else
+    return sd_card_rw_blocks(card, blk, count, cur, is_write, opts);
+#endif
 }
 
 /**
- * @brief 写入单个数据块
+ * @brief 经过中转缓冲区读写一个块中的部分数据
+ * @note 写入时先读出整个块，修改后再写回（读-改-写）。
  * @param card              [in]  SD卡对象
- * @param lba               [in]  块地址
- * @param buf               [out] 数据缓冲区（至少512字节）
+ * @param blk               [in]  块号
+ * @param off               [in]  块内偏移（字节）
+ * @param buf               [in]  数据缓冲区
+ * @param len               [in]  读写长度（字节），off + len 不超过块大小
+ * @param is_write          [in]  true：写入；false：读取
  * @return enum sd_error    [out] 错误码
  */
-static enum sd_error _write_single_block(struct sd_card *card, uint32_t lba, const uint8_t *buf)
+static enum sd_error _rw_partial_block(struct sd_card *card, uint32_t blk, uint32_t off, uint8_t *buf, uint32_t len, bool is_write)
 {
     enum sd_error err = Sd_Err_OK;
+    struct sd_iovec seg = {.buf = bounce_buf, .len = card->info.block_size};
+    struct sd_iov_cursor cur = {.iov = &seg, .idx = 0, .off = 0};
 
-    /** 1. 发送CMD24写入单个块命令并等待响应 **/
+    if ((err = _rw_blocks(card, blk, 1, &cur, false, SD_WR_OPT_NONE)) != Sd_Err_OK)
+        return err;
+
+    if (!is_write)
     {
-        struct sd_cmd_req req = 
-        {
-            .cmd = Sd_Cmd24_Wr_Single_Blk, .arg = lba, .crc = 1,
-            .resp_type = Sd_Resp_Type_R1, .retry = 5
-        };
+        memcpy(buf, &bounce_buf[off], len);
+        return Sd_Err_OK;
+    }
 
-        struct sd_resp_res resp = {0};
-        if ((err = sd_card_send_cmd_req(card, &req, &resp)) != Sd_Err_OK)
-        {
-            trace_e(card, "CMD24 send cmd error: 0x%02X", resp.buf[0]);
-            return err;
-        }
+    memcpy(&bounce_buf[off], buf, len);
+    cur.idx = 0;
+    cur.off = 0;
+    return _rw_blocks(card, blk, 1, &cur, true, SD_SPI_WRITE_DEFAULT_OPTS);
+}
 
-        /** 检查响应 **/
-        if (resp.buf[0] != 0x00)
-        {
-            trace_e(card, "CMD24 resp error: 0x%02X", resp.buf[0]);
-            return Sd_Err_Response;
-        }
-    }
+/**
+ * @brief 按任意字节地址和长度读写
+ * @note 块内对齐的中间部分直接读写用户缓冲区，仅头尾不完整的块经过中转缓冲区，因此最多多传输两个块。
+ * @param card              [in]  SD卡对象
+ * @param addr              [in]  字节地址
+ * @param buf               [in]  数据缓冲区
+ * @param len               [in]  读写长度（字节）
+ * @param is_write          [in]  true：写入；false：读取
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _rw_bytes(struct sd_card *card, uint64_t addr, uint8_t *buf, uint32_t len, bool is_write)
+{
+    if(card == NULL || buf == NULL)
+        return Sd_Err_Param;
+    if (!card->is_inited)
+        return Sd_Err_Not_Inited;
+    if (card->info.block_size > SD_SPI_BOUNCE_BUF_SIZE)
+        return Sd_Err_Unsupported;
+
+    enum sd_error err = Sd_Err_OK;
+    uint32_t block_size = card->info.block_size;
+    uint32_t blk = (uint32_t) (addr / block_size);
+    uint32_t off = (uint32_t) (addr % block_size);
 
-    /** 2. 发送数据令牌 (0xFE)，写入数据块和虚拟CRC（通常被忽略） **/
+    /** 1. 头部不完整的块 **/
+    if (off != 0 && len != 0)
     {
-        uint8_t token = 0xFE;
-        if ((err = sd_spi_hw_write_byte(card, token)) != Sd_Err_OK)
-        {
-            trace_e(card, "Write token(0x%02X) failed", token);
-            return err;
-        }  
-        if ((err = sd_spi_hw_write_bytes(card, (void *)buf, card->info.block_size)) != Sd_Err_OK)
-        {
-            trace_e(card, "Write data error");
-            return err;
-        }
-        uint8_t crc[2] = {0xFF, 0xFF};
-        if ((err = sd_spi_hw_write_bytes(card, crc, sizeof(crc))) != Sd_Err_OK)
-        {
-            trace_e(card, "Write crc error");
+        uint32_t n = (len < block_size - off) ? len : block_size - off;
+        if ((err = _rw_partial_block(card, blk, off, buf, n, is_write)) != Sd_Err_OK)
             return err;
-        }
+        buf += n;
+        len -= n;
+        blk++;
     }
 
-    /** 3. 检查数据响应令牌 **/
+    /** 2. 对齐的中间部分直接读写用户缓冲区 **/
+    if (len >= block_size)
     {
-        /** 检查数据响应令牌 **/
-        uint8_t data_resp;
-        if ((err = sd_spi_hw_read_byte(card, &data_resp)) != Sd_Err_OK)
-        {
-            trace_e(card, "Read data resp error");
+        uint32_t count = len / block_size;
+        struct sd_iovec seg = {.buf = buf, .len = count * block_size};
+        struct sd_iov_cursor cur = {.iov = &seg, .idx = 0, .off = 0};
+        if ((err = _rw_blocks(card, blk, count, &cur, is_write, SD_SPI_WRITE_DEFAULT_OPTS)) != Sd_Err_OK)
             return err;
-        }
-
-        /** 检查响应令牌是否有效 **/
-        if ((data_resp & 0x1F) != 0x05)
-        {
-            trace_e(card, "Data response error: 0x%02X", data_resp);
-            return Sd_Err_Response;
-        }
+        buf += count * block_size;
+        len -= count * block_size;
+        blk += count;
     }
 
-    /** 4. 等待卡完成编程（读取忙状态） **/
-    {
-        uint8_t busy;
-        uint32_t timeout = 500; // 500ms超时
-        do
-        {
-            if ((err = sd_spi_hw_read_byte(card, &busy)) != Sd_Err_OK)
-            {
-                trace_e(card, "Read busy error");
-                return err;
-            }
-
-            if (--timeout == 0)
-            {
-                trace_w(card, "Write busy timeout");
-                return Sd_Err_Timeout;
-            }
-            sd_spi_hw_udelay(card, 1000); // 每 1ms 检查一次
-        } while (busy == 0x00);
-    }
+    /** 3. 尾部不完整的块 **/
+    if (len != 0)
+        return _rw_partial_block(card, blk, 0, buf, len, is_write);
 
     return Sd_Err_OK;
 }
@@ -288,6 +1056,8 @@ struct sd_card* sd_card_find (const char* name)
 
 /**
  * @brief 初始化SD卡
+ * @note 卡已初始化时（如读写出错后重新初始化以恢复），先尝试写回缓存中的脏块和写合并缓冲区，这些写入已向调用者返回成功；
+ *       卡已被拔出或写回失败时丢弃这些数据（数据丢失），并打印警告及丢弃的块数。需要确保数据写入的调用者应先调用 sd_card_sync()。
  * @param card           [in]  SD卡对象
  * @return enum sd_error [out] 错误码
  */
@@ -295,34 +1065,93 @@ enum sd_error sd_card_init (struct sd_card* card)
 {   
     if(card == NULL)
         return Sd_Err_Param;
+    if(card->async.req != NULL)
+        return Sd_Err_No_Ready;
 
     enum sd_error err = Sd_Err_OK;
 
+#if (SD_SPI_STATS_ENABLE == 1)
+    /** 卡曾经初始化成功，本次为重新初始化 **/
+    if (card->stats.inits != 0)
+        stats_add(card, reinits, 1);
+#endif
+
+#if (SD_SPI_CACHE_ENABLE == 1)
+    /** 重新初始化前写回脏块 **/
+    if (card->is_inited && !sd_spi_hw_is_card_detached(card) && sd_cache_flush(card) != Sd_Err_OK)
+        trace_w(card, "Cache write-back before re-init failed");
+    uint32_t dirty = sd_cache_dirty_count(card);
+    if (dirty != 0)
+        trace_w(card, "Re-init drops %d dirty cached blocks", dirty);
+#endif
+#if (SD_SPI_WCOMB_ENABLE == 1)
+    if (card->is_inited && !sd_spi_hw_is_card_detached(card) && sd_wcomb_flush(card, true) != Sd_Err_OK)
+        trace_w(card, "Write-combine write-back before re-init failed");
+#endif
+
     /** 卡初始化完成 **/
     card->is_inited = false;
     card->is_selected = false;
     card->is_xfering = false;
+    card->is_busy_pending = false;
+
+#if (SD_SPI_CACHE_ENABLE == 1)
+    /** 丢弃缓存中属于该卡的块，卡可能已被更换（脏块已在上面尽量写回） **/
+    sd_cache_evict_range(card, 0, UINT32_MAX, false);
+#endif
+#if (SD_SPI_RAHEAD_ENABLE == 1)
+    sd_rahead_invalidate(card, 0, UINT32_MAX);
+#endif
+#if (SD_SPI_WCOMB_ENABLE == 1)
+    /** 丢弃未能写回的合并数据 **/
+    sd_wcomb_flush(card, false);
+#endif
 
     /** 硬件接口初始化 **/
+    uint32_t t_lat = lat_begin(card);
     if((err = sd_spi_hw_io_init(card)) != Sd_Err_OK)
         return err;
+    sd_card_init_begin(card);
 
     /** 调整通信速率 **/
-    sd_spi_hw_set_speed(card, Sd_User_Ctrl_Set_Low_Speed);
+    sd_clock_set_identify(card);
 
     /** 卡上电检查，等待卡就绪 **/
     if((err = _card_power_on(card)) != Sd_Err_OK)
         return err;
+    sd_card_init_mark(card, Sd_Init_Phase_Power);
 
     /** 获取卡信息：识别卡类型、容量等 **/
     if((err = sd_card_identify(card)) != Sd_Err_OK)
         return err;
 
-    /** 调整通信速率 **/
-    sd_spi_hw_set_speed(card, Sd_User_Ctrl_Set_High_Speed);
+#if (SD_SPI_CRC_ENABLE == 1)
+    /** 打开CRC校验 **/
+    if((err = _card_crc_on(card)) != Sd_Err_OK)
+        return err;
+#endif
+
+#if (SD_SPI_HIGH_SPEED_ENABLE == 1)
+    /** 切换至高速模式，卡不支持或切换失败时保持默认速度 **/
+    if((err = _card_high_speed(card)) != Sd_Err_OK)
+        trace_i(card, "High speed mode not used: %d", err);
+#endif
+
+    /** 调整通信速率：按 TRAN_SPEED 设置时钟，开启训练时找出可靠的最高时钟 **/
+    if((err = sd_clock_set_transfer(card)) != Sd_Err_OK)
+        return err;
+    sd_card_init_mark(card, Sd_Init_Phase_Setup);
 
     /** 卡初始化完成 **/
     card->is_inited = true;
+    stats_add(card, inits, 1);
+    lat_record(card, Sd_Lat_Init, t_lat);
+    trace_i(card, "init phases: power %d us, idle %d us, if_cond %d us, op_cond %d us",
+            card->init_timing.phase_us[Sd_Init_Phase_Power], card->init_timing.phase_us[Sd_Init_Phase_Idle],
+            card->init_timing.phase_us[Sd_Init_Phase_If_Cond], card->init_timing.phase_us[Sd_Init_Phase_Op_Cond]);
+    trace_i(card, "init phases: registers %d us, setup %d us, total %d us (%d ACMD41 polls)",
+            card->init_timing.phase_us[Sd_Init_Phase_Registers], card->init_timing.phase_us[Sd_Init_Phase_Setup],
+            card->init_timing.total_us, card->init_timing.acmd41_polls);
 
     /** 打印卡识别信息 **/
     sd_card_print_info(card);
@@ -342,6 +1171,20 @@ enum sd_error sd_card_deinit (struct sd_card* card)
 
     enum sd_error err = Sd_Err_OK;
 
+    /** 写回缓存，等待推迟的写入编程完成 **/
+    if((err = sd_card_sync(card)) != Sd_Err_OK)
+        return err;
+
+#if (SD_SPI_CACHE_ENABLE == 1)
+    sd_cache_evict_range(card, 0, UINT32_MAX, false);
+#endif
+#if (SD_SPI_RAHEAD_ENABLE == 1)
+    sd_rahead_invalidate(card, 0, UINT32_MAX);
+#endif
+#if (SD_SPI_WCOMB_ENABLE == 1)
+    sd_wcomb_flush(card, false);
+#endif
+
     /** 卡去初始化 **/
     if((err = _card_power_off(card)) != Sd_Err_OK)
         return err;
@@ -366,41 +1209,64 @@ enum sd_error sd_card_deinit (struct sd_card* card)
  */
 enum sd_error sd_card_read(struct sd_card *card, const uint64_t addr, uint8_t *buf, const uint32_t len)
 {
-    if(card == NULL || buf == NULL || len == 0)
+    if(buf == NULL)
+        return Sd_Err_Param;
+
+    struct sd_iovec seg = {.buf = buf, .len = len};
+    return sd_card_readv(card, addr, &seg, 1);
+}
+
+/**
+ * @brief 分散读取：将SD指定地址的一段连续块依次读入多个数据段
+ * @note 数据段依次拼接后的总长度必须是块大小的倍数，单个数据段的长度则没有限制（允许为0）。
+ *       整个读取过程只选中一次卡，数据直接写入各数据段，不经过中间缓冲区。
+ * @param card              [in]  SD卡对象
+ * @param addr              [in]  字节地址（必须是块大小的倍数）
+ * @param iov               [in]  数据段数组
+ * @param iovcnt            [in]  数据段数量
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_card_readv(struct sd_card *card, const uint64_t addr, const struct sd_iovec *iov, const uint32_t iovcnt)
+{
+    if(card == NULL || iov == NULL || iovcnt == 0)
         return Sd_Err_Param;
     if (!card->is_inited)
         return Sd_Err_Not_Inited;
-    if (len % card->info.block_size != 0)
-        return Sd_Err_Param;
 
     enum sd_error err = Sd_Err_OK;
+    uint32_t len = 0;
 
-    /** 计算要操作的块地址和块数 **/
-    struct sd_lba_req user_req = {.offset = addr, .len = len};
-    struct sd_lba_oparg oparg = {0};
-    _conv_req_to_lba(card, &user_req, &oparg);                      // SDSC使用字节地址
-
-    /** 执行读块操作 **/
-    if((err = sd_spi_hw_select_card(card)) != Sd_Err_OK)
+    if ((err = _iov_total(iov, iovcnt, &len)) != Sd_Err_OK)
         return err;
+    if (len % card->info.block_size != 0)
+        return Sd_Err_Param;
 
-    for (uint32_t i = 0; i < oparg.lba_count; i++)
-        if ((err = _read_single_block( card, 
-                                       oparg.lba_addr + i, 
-                                       buf + (i * card->info.block_size))) != Sd_Err_OK)
-        {
-            trace_e(card, "Read lba[%d] failed, code: 0x%02x", oparg.lba_addr + i, err);
-            break;
-        }
-            
-    sd_spi_hw_deselect_card(card);
+    /** 计算要操作的块号和块数，经过块缓存或直接访问卡 **/
+    struct sd_iov_cursor cur = {.iov = iov, .idx = 0, .off = 0};
+    uint32_t blk = (uint32_t) (addr / card->info.block_size);
 
-    return err;
+    return _rw_blocks(card, blk, len / card->info.block_size, &cur, false, SD_WR_OPT_NONE);
+}
+
+/**
+ * @brief 读取SD任意字节地址的数据
+ * @note 地址和长度不需要对齐到块大小。块内对齐的部分直接读入 buf，仅头尾不完整的块经过库内部的中转缓冲区。
+ * @param card              [in]  SD卡对象
+ * @param addr              [in]  字节地址
+ * @param buf               [out] 数据缓冲区
+ * @param len               [in]  读取长度（字节）
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_card_pread(struct sd_card *card, const uint64_t addr, uint8_t *buf, const uint32_t len)
+{
+    return _rw_bytes(card, addr, buf, len, false);
 }
 
 /**
  * @brief 写入SD指定地址的数据
  * @note 一般来说，SD卡写入数据时不需要用户显式擦除，擦除过程通常由卡内的控制器自动处理。
+ *       写入失败时，可通过 sd_card_get_xfer_blocks() 获取已经写入卡中的块数。
+ *       本函数使用 SD_SPI_WRITE_DEFAULT_OPTS 作为写入选项，如需单独指定，请使用 sd_card_write_ex()。
  * @param card              [in]  SD卡对象
  * @param addr              [in]  字节地址（必须是块大小的倍数）
  * @param buf               [in]  数据缓冲区
@@ -409,32 +1275,120 @@ enum sd_error sd_card_read(struct sd_card *card, const uint64_t addr, uint8_t *b
  */
 enum sd_error sd_card_write(struct sd_card *card, const uint64_t addr, const uint8_t *buf, const uint32_t len)
 {
-    if(card == NULL || buf == NULL || len == 0)
+    return sd_card_write_ex(card, addr, buf, len, SD_SPI_WRITE_DEFAULT_OPTS);
+}
+
+/**
+ * @brief 按指定选项写入SD指定地址的数据
+ * @param card              [in]  SD卡对象
+ * @param addr              [in]  字节地址（必须是块大小的倍数）
+ * @param buf               [in]  数据缓冲区
+ * @param len               [in]  写入长度（必须是块大小的倍数）
+ * @param opts              [in]  写入选项，SD_WR_OPT_XXX 的按位组合
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_card_write_ex(struct sd_card *card, const uint64_t addr, const uint8_t *buf, const uint32_t len, const uint32_t opts)
+{
+    if(buf == NULL)
+        return Sd_Err_Param;
+
+    struct sd_iovec seg = {.buf = (void *) buf, .len = len};
+    return sd_card_writev_ex(card, addr, &seg, 1, opts);
+}
+
+/**
+ * @brief 聚集写入：将多个数据段依次写入SD指定地址的一段连续块
+ * @note 使用 SD_SPI_WRITE_DEFAULT_OPTS 作为写入选项，数据段的要求见 sd_card_readv()。
+ * @param card              [in]  SD卡对象
+ * @param addr              [in]  字节地址（必须是块大小的倍数）
+ * @param iov               [in]  数据段数组
+ * @param iovcnt            [in]  数据段数量
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_card_writev(struct sd_card *card, const uint64_t addr, const struct sd_iovec *iov, const uint32_t iovcnt)
+{
+    return sd_card_writev_ex(card, addr, iov, iovcnt, SD_SPI_WRITE_DEFAULT_OPTS);
+}
+
+/**
+ * @brief 按指定选项聚集写入
+ * @param card              [in]  SD卡对象
+ * @param addr              [in]  字节地址（必须是块大小的倍数）
+ * @param iov               [in]  数据段数组
+ * @param iovcnt            [in]  数据段数量
+ * @param opts              [in]  写入选项，SD_WR_OPT_XXX 的按位组合
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_card_writev_ex(struct sd_card *card, const uint64_t addr, const struct sd_iovec *iov, const uint32_t iovcnt, const uint32_t opts)
+{
+    if(card == NULL || iov == NULL || iovcnt == 0)
         return Sd_Err_Param;
     if (!card->is_inited)
         return Sd_Err_Not_Inited;
+
+    enum sd_error err = Sd_Err_OK;
+    uint32_t len = 0;
+
+    if ((err = _iov_total(iov, iovcnt, &len)) != Sd_Err_OK)
+        return err;
     if (len % card->info.block_size != 0)
         return Sd_Err_Param;
 
+    /** 计算要操作的块号和块数，经过块缓存或直接访问卡 **/
+    struct sd_iov_cursor cur = {.iov = iov, .idx = 0, .off = 0};
+    uint32_t blk = (uint32_t) (addr / card->info.block_size);
+
+    return _rw_blocks(card, blk, len / card->info.block_size, &cur, true, opts);
+}
+
+/**
+ * @brief 写入SD任意字节地址的数据
+ * @note 地址和长度不需要对齐到块大小。头尾不完整的块在库内部的中转缓冲区中读-改-写，因此最多额外读取两个块；
+ *       块内对齐的部分直接从 buf 写入。使用 SD_SPI_WRITE_DEFAULT_OPTS 作为写入选项。
+ * @param card              [in]  SD卡对象
+ * @param addr              [in]  字节地址
+ * @param buf               [in]  数据缓冲区
+ * @param len               [in]  写入长度（字节）
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_card_pwrite(struct sd_card *card, const uint64_t addr, const uint8_t *buf, const uint32_t len)
+{
+    return _rw_bytes(card, addr, (uint8_t *) buf, len, true);
+}
+
+/**
+ * @brief 同步：将块缓存中的脏块写回卡，并等待卡完成所有推迟的写入编程
+ * @note 使用 SD_WR_OPT_DEFER_BUSY 写入后，写函数在卡接受数据后即返回，卡可能仍在内部编程；开启块缓存后，写入的数据可能仍暂存在缓存中。
+ *       调用本函数可确保此前写入的数据已经完成编程，例如在掉电、拔卡前或 FATFS 的 CTRL_SYNC 中调用。
+ * @param card              [in]  SD卡对象
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_card_sync(struct sd_card *card)
+{
+    if(card == NULL)
+        return Sd_Err_Param;
+
     enum sd_error err = Sd_Err_OK;
 
-    /** 计算要操作的块地址和块数 **/
-    struct sd_lba_req user_req = {.offset = addr, .len = len};
-    struct sd_lba_oparg oparg = {0};
-    _conv_req_to_lba(card, &user_req, &oparg);
+#if (SD_SPI_CACHE_ENABLE == 1)
+    if (card->is_inited && (err = sd_cache_flush(card)) != Sd_Err_OK)
+        return err;
+#endif
+#if (SD_SPI_WCOMB_ENABLE == 1)
+    if (card->is_inited && (err = sd_wcomb_flush(card, true)) != Sd_Err_OK)
+        return err;
+#endif
+
+    if (!card->is_busy_pending)
+        return Sd_Err_OK;
 
-    /** 执行写块操作 **/
     if((err = sd_spi_hw_select_card(card)) != Sd_Err_OK)
         return err;
 
-    for (uint32_t i = 0; i < oparg.lba_count; i++)
-        if ((err = _write_single_block( card, 
-                                        oparg.lba_addr + i, 
-                                        buf + (i * card->info.block_size))) != Sd_Err_OK)
-        {
-            trace_e(card, "Write lba[%d] failed, code: 0x%02x", oparg.lba_addr + i, err);
-            break;
-        }
+    card->is_busy_pending = false;
+    if((err = sd_card_wait_ready(card, SD_SPI_WRITE_TIMEOUT_US)) != Sd_Err_OK)
+        trace_w(card, "Sync busy timeout");
+
     sd_spi_hw_deselect_card(card);
 
     return err;
@@ -454,6 +1408,8 @@ enum sd_error sd_card_erase_sector(struct sd_card *card, const uint64_t addr, co
         return Sd_Err_Param;
     if (!card->is_inited)
         return Sd_Err_Not_Inited;
+    if(card->async.req != NULL)
+        return Sd_Err_No_Ready;
 
     enum sd_error err = Sd_Err_OK;
     
@@ -483,6 +1439,21 @@ enum sd_error sd_card_erase_sector(struct sd_card *card, const uint64_t addr, co
         }
     }
 
+#if (SD_SPI_CACHE_ENABLE == 1)
+    /** 被擦除的块在缓存中的内容已无效 **/
+    sd_cache_evict_range(card, (uint32_t) (addr / card->info.block_size),
+                         (uint32_t) ((uint64_t) card->info.erase_sector_size * count / card->info.block_size), false);
+#endif
+#if (SD_SPI_RAHEAD_ENABLE == 1)
+    sd_rahead_invalidate(card, (uint32_t) (addr / card->info.block_size),
+                         (uint32_t) ((uint64_t) card->info.erase_sector_size * count / card->info.block_size));
+#endif
+#if (SD_SPI_WCOMB_ENABLE == 1)
+    /** 先写回合并缓冲区，保证擦除发生在之前的写入之后 **/
+    if ((err = sd_wcomb_flush(card, true)) != Sd_Err_OK)
+        return err;
+#endif
+
     /** 选择卡 **/
     if((err = sd_spi_hw_select_card(card)) != Sd_Err_OK)
         return err;
@@ -491,7 +1462,7 @@ enum sd_error sd_card_erase_sector(struct sd_card *card, const uint64_t addr, co
     {
         struct sd_cmd_req req_start =
         {
-            .cmd = Sd_Cmd32_Erase_Start, .arg = start_block, .crc = 1,
+            .cmd = Sd_Cmd32_Erase_Start, .arg = start_block, .crc = SD_CMD_CRC_AUTO,
             .resp_type = Sd_Resp_Type_R1, .retry = 5
         };
         struct sd_resp_res resp = {0};
@@ -509,7 +1480,7 @@ enum sd_error sd_card_erase_sector(struct sd_card *card, const uint64_t addr, co
     {
         struct sd_cmd_req req_end =
         {
-            .cmd = Sd_Cmd33_Erase_End, .arg = end_block, .crc = 1,
+            .cmd = Sd_Cmd33_Erase_End, .arg = end_block, .crc = SD_CMD_CRC_AUTO,
             .resp_type = Sd_Resp_Type_R1, .retry = 5
         };
         struct sd_resp_res resp = {0};
@@ -523,11 +1494,12 @@ enum sd_error sd_card_erase_sector(struct sd_card *card, const uint64_t addr, co
         }
     }
 
-    /** 4. 执行擦除操作 (CMD38) **/
+    /** 4. 执行擦除操作 (CMD38)，等待卡退出忙状态 **/
     {
+        uint32_t t_lat = lat_begin(card);
         struct sd_cmd_req req_erase =
         {
-            .cmd = Sd_Cmd38_Erase, .arg = 0, .crc = 1,
+            .cmd = Sd_Cmd38_Erase, .arg = 0, .crc = SD_CMD_CRC_CMD38,
             .resp_type = Sd_Resp_Type_R1b, .retry = 5
         };
         struct sd_resp_res resp = {0};
@@ -539,10 +1511,13 @@ enum sd_error sd_card_erase_sector(struct sd_card *card, const uint64_t addr, co
             err = Sd_Err_Failed;
             goto _END_;
         }
+        lat_record(card, Sd_Lat_Erase, t_lat);
     }
 
 _END_:;
     sd_spi_hw_deselect_card(card);
+    if (err != Sd_Err_OK)
+        stats_add(card, errors[err], 1);
 
     return err;
 }
@@ -638,6 +1613,10 @@ bool sd_card_is_inserted (struct sd_card* card)
     if(card == NULL)
         return false;
 
+    /** 异步请求正在执行，卡处于选中状态，不能发送CMD0复查 **/
+    if(card->async.req != NULL)
+        return true;
+
     /** 硬件检查 **/
     if(sd_spi_hw_is_card_detached(card) == false)
         return true;
@@ -650,6 +1629,157 @@ bool sd_card_is_inserted (struct sd_card* card)
     return false;
 }
 
+/**
+ * @brief 获取最近一次读写操作成功完成的块数
+ * @note 读写全部成功时等于请求的块数；出错时为出错前已完成的块数，多块写入时以卡报告的已写入块数（ACMD22）为准。
+ * @param card       [in]  SD卡对象
+ * @return uint32_t  [out] 块数
+ */
+uint32_t sd_card_get_xfer_blocks (struct sd_card* card)
+{
+    if(card == NULL)
+        return 0;
+    return card->xfer_blocks;
+}
+
+/**
+ * @brief 获取累计调用端口数据传输接口（transfer()/rx_fill()/duplex()/xfer_start()）的次数
+ * @note 调用某个接口前先用 sd_card_reset_port_calls() 清零，返回后读取，即为该接口产生的端口调用次数。
+ * @param card       [in]  SD卡对象
+ * @return uint32_t  [out] 调用次数
+ */
+uint32_t sd_card_get_port_calls (struct sd_card* card)
+{
+    if(card == NULL)
+        return 0;
+    return card->port_calls;
+}
+
+/**
+ * @brief 清零端口调用次数
+ * @param card       [in]  SD卡对象
+ */
+void sd_card_reset_port_calls (struct sd_card* card)
+{
+    if(card != NULL)
+        card->port_calls = 0;
+}
+
+/**
+ * @brief 获取累计的总线开销
+ * @note 用法与 sd_card_get_port_calls() 相同：调用 sd_card_init()/sd_card_read()/sd_card_write()/sd_card_erase_sector() 等接口前
+ *       先用 sd_card_reset_bus_cost() 清零，返回后读取，即为该接口的总线开销。多出一个虚拟字节或一次 R1 轮询都会反映在结果中，
+ *       可用于发现热路径上的性能退化（见 tools/host_bench.c 的 -a 选项）。
+ * @param card       [in]  SD卡对象
+ * @param cost       [out] 总线开销
+ */
+void sd_card_get_bus_cost (struct sd_card* card, struct sd_bus_cost* cost)
+{
+    if(cost == NULL)
+        return;
+    if(card == NULL)
+    {
+        memset(cost, 0, sizeof(*cost));
+        return;
+    }
+
+    cost->calls = card->port_calls;
+    cost->bytes = card->port_bytes;
+    cost->clocks = (uint64_t) card->port_bytes * 8;
+}
+
+/**
+ * @brief 清零总线开销（同时清零端口调用次数）
+ * @param card       [in]  SD卡对象
+ */
+void sd_card_reset_bus_cost (struct sd_card* card)
+{
+    if(card == NULL)
+        return;
+    card->port_calls = 0;
+    card->port_bytes = 0;
+}
+
+/**
+ * @brief 获取最近一次初始化的阶段耗时
+ * @note 初始化失败时也可调用，已完成阶段的耗时保留，可据此判断卡在哪个阶段超时。
+ * @param card              [in]  SD卡对象
+ * @param timing            [out] 阶段耗时
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_card_get_init_timing (struct sd_card* card, struct sd_init_timing* timing)
+{
+    if(card == NULL || timing == NULL)
+        return Sd_Err_Param;
+
+    *timing = card->init_timing;
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 获取卡的统计信息快照
+ * @note 可在其他线程中调用。统计信息在更新过程中被读取时会重新读取，几次重试后仍未得到完整的快照则返回 Sd_Err_No_Ready，稍后再试即可。
+ *       统计信息未开启时快照全部为 0。
+ * @param card              [in]  SD卡对象
+ * @param stats             [out] 统计信息
+ * @return enum sd_error    [out] 错误码，统计信息未开启时返回 Sd_Err_Unsupported
+ */
+enum sd_error sd_card_get_stats (struct sd_card* card, struct sd_card_stats* stats)
+{
+    if(card == NULL || stats == NULL)
+        return Sd_Err_Param;
+
+#if (SD_SPI_STATS_ENABLE == 1)
+    for(uint8_t i = 0; i < 4; i++)
+    {
+        uint32_t seq = card->stats_seq;
+        if(seq & 1)
+            continue;           // 正在更新
+
+        sd_barrier();
+        *stats = card->stats;
+        sd_barrier();
+        if(card->stats_seq == seq)
+            return Sd_Err_OK;
+    }
+    return Sd_Err_No_Ready;
+#else
+    memset(stats, 0, sizeof(*stats));
+    return Sd_Err_Unsupported;
+#endif
+}
+
+/**
+ * @brief 清零卡的统计信息
+ * @note 应在访问该卡的线程中调用，或与该卡的读写互斥。
+ * @param card              [in]  SD卡对象
+ */
+void sd_card_reset_stats (struct sd_card* card)
+{
+    if(card == NULL)
+        return;
+
+#if (SD_SPI_STATS_ENABLE == 1)
+    stats_begin(card);
+    memset(&card->stats, 0, sizeof(card->stats));
+    stats_end(card);
+#endif
+}
+
+/**
+ * @brief 运行时开关多块传输
+ * @note 关闭后多块读写逐块使用 CMD17/CMD24（同步和异步接口均是），用于在同一程序中比较两种方式的总线开销与吞吐量（见 tools/host_bench.c）。
+ *       未开启 SD_SPI_MULTI_BLOCK_ENABLE 时始终逐块传输。默认开启，重新初始化不会改变该设置。
+ * @param card      [in]  SD卡对象
+ * @param enable    [in]  true：多块读写使用 CMD18/CMD25；false：逐块使用 CMD17/CMD24
+ */
+void sd_card_set_multi_block (struct sd_card* card, bool enable)
+{
+    if(card == NULL)
+        return;
+    card->is_single_block = !enable;
+}
+
 /**
  * @brief 设置用户数据
  * @param card  [in]  SD卡对象
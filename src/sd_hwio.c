@@ -10,6 +10,84 @@
  */
 #include "sd_spi_driver.h"
 #include "sd_private.h"
+#include "string.h"
+
+#define SD_TRACE_FILE_ID    5           // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
+
+/**
+ * @brief 调用端口接口接收数据，期间发送 0xFF
+ * @param card            [in]  SD卡对象
+ * @param buf             [out] 数据缓冲区
+ * @param len             [in]  接收长度
+ * @return enum sd_error  [out] 错误码
+ */
+static enum sd_error _port_read(struct sd_card* card, void* buf, uint32_t len)
+{
+    int ret = 0;
+
+    card->port_calls++;
+    card->port_bytes += len;
+    card->is_xfering = true;
+    if(card->spi_if->rx_fill != NULL)
+        ret = card->spi_if->rx_fill(card, buf, len);
+    else if(card->spi_if->duplex != NULL)
+    {
+        /** 以缓冲区自身作为发送数据：先填充 0xFF，接收的数据原位覆盖 **/
+        memset(buf, 0xFF, len);
+        ret = card->spi_if->duplex(card, buf, buf, len);
+    }
+    else
+    {
+        struct sd_spi_buf rx = 
+        {
+            .data = buf,
+            .size = len,
+            .used = 0,
+        };
+        card->spi_if->transfer(card, NULL, &rx);
+    }
+    card->is_xfering = false;
+
+    return (ret == 0) ? Sd_Err_OK : Sd_Err_IO;
+}
+
+/**
+ * @brief 从预读字节中取出数据
+ * @param card            [in]  SD卡对象
+ * @param buf             [out] 数据缓冲区
+ * @param len             [in]  期望取出的字节数
+ * @return uint32_t       [out] 实际取出的字节数
+ */
+static uint32_t _ahead_take(struct sd_card* card, uint8_t* buf, uint32_t len)
+{
+    struct sd_rx_ahead* ahead = &card->ahead;
+    uint32_t n = (uint32_t) (ahead->len - ahead->pos);
+
+    if(n > len)
+        n = len;
+    memcpy(buf, &ahead->buf[ahead->pos], n);
+    ahead->pos += n;
+    return n;
+}
+
+/**
+ * @brief 丢弃预读字节
+ * @note 发送数据或取消选择卡时调用，多读出的字节只可能是卡空闲时输出的 0xFF。
+ * @param card            [in]  SD卡对象
+ */
+static void _ahead_drop(struct sd_card* card)
+{
+    card->ahead.pos = 0;
+    card->ahead.len = 0;
+}
+
+
+
+
+
+
+
 
 
 /**
@@ -51,6 +129,8 @@ enum sd_error sd_spi_hw_select_card (struct sd_card* card)
 {
     if(card->spi_if== NULL || card->spi_if->control == NULL)
         return Sd_Err_IO;
+    if(card->is_selected)
+        return Sd_Err_No_Ready;     // 卡已被选中，如异步请求正在执行
     if(card->spi_if->control(card, Sd_User_Ctrl_Take_Bus) != 0)
         return Sd_Err_Timeout;
 
@@ -73,6 +153,7 @@ enum sd_error sd_spi_hw_deselect_card (struct sd_card* card)
     card->spi_if->control(card, Sd_User_Ctrl_Deselect_Card);
     card->spi_if->control(card, Sd_User_Ctrl_Release_Bus);
     card->is_selected = false;
+    _ahead_drop(card);
 
     return Sd_Err_OK;
 }
@@ -90,6 +171,7 @@ enum sd_error sd_spi_hw_read_byte(struct sd_card* card, void* buf)
 
 /**
  * @brief 硬件 SPI 读取多字节数据
+ * @note 优先取用批量传输多读出的字节，其余部分再从总线读取。
  * @param card            [in]  SD卡对象
  * @param buf             [in]  数据缓冲区
  * @param len             [in]  期望读取的字节数
@@ -100,18 +182,11 @@ enum sd_error sd_spi_hw_read_bytes(struct sd_card* card, void* buf, uint32_t len
     if(card->spi_if== NULL || card->spi_if->transfer == NULL)
         return Sd_Err_IO;
 
-    struct sd_spi_buf rx = 
-    {
-        .data = buf,
-        .size = len,
-        .used = 0,
-    };
-
-    card->is_xfering = true;
-    card->spi_if->transfer(card, NULL, &rx);
-    card->is_xfering = false;
+    uint32_t n = _ahead_take(card, buf, len);
+    if(n == len)
+        return Sd_Err_OK;
 
-    return Sd_Err_OK;
+    return _port_read(card, (uint8_t*) buf + n, len - n);
 }
 
 /**
@@ -144,6 +219,9 @@ enum sd_error sd_spi_hw_write_bytes(struct sd_card* card, void* buf, uint32_t le
        .used = 0,
     };
 
+    _ahead_drop(card);
+    card->port_calls++;
+    card->port_bytes += len;
     card->is_xfering = true;
     card->spi_if->transfer(card, &tx, NULL);
     card->is_xfering = false;
@@ -151,6 +229,217 @@ enum sd_error sd_spi_hw_write_bytes(struct sd_card* card, void* buf, uint32_t le
     return Sd_Err_OK;
 }
 
+/**
+ * @brief 硬件 SPI 在一次端口调用中写出数据并紧接着读取若干字节，读取的字节作为预读字节供之后的读取取用
+ * @note 用于命令帧与响应窗口的合并收发。端口实现了 duplex() 时以全双工方式收发，否则通过一次 transfer() 先发后收。
+ * @param card            [in]  SD卡对象
+ * @param tx              [in]  发送数据（不超过 16 字节）
+ * @param tx_len          [in]  发送长度
+ * @param rx_len          [in]  紧接着读取的字节数，不超过 SD_RX_AHEAD_SIZE，0 表示只发送
+ * @return enum sd_error  [out] 错误码
+ */
+enum sd_error sd_spi_hw_write_read(struct sd_card* card, const void* tx, uint32_t tx_len, uint32_t rx_len)
+{
+    struct sd_rx_ahead* ahead = &card->ahead;
+    int ret = 0;
+
+    if(card->spi_if== NULL || card->spi_if->transfer == NULL)
+        return Sd_Err_IO;
+    if(tx_len > 16 || rx_len > SD_RX_AHEAD_SIZE)
+        return Sd_Err_Param;
+    if(rx_len == 0)
+        return sd_spi_hw_write_bytes(card, (void*) tx, tx_len);
+
+    _ahead_drop(card);
+    card->port_calls++;
+    card->port_bytes += tx_len + rx_len;
+    card->is_xfering = true;
+    if(card->spi_if->duplex != NULL)
+    {
+        uint8_t buf[16 + SD_RX_AHEAD_SIZE];
+        memcpy(buf, tx, tx_len);
+        memset(&buf[tx_len], 0xFF, rx_len);
+        ret = card->spi_if->duplex(card, buf, buf, tx_len + rx_len);
+        memcpy(ahead->buf, &buf[tx_len], rx_len);
+    }
+    else
+    {
+        struct sd_spi_buf txb = {.data = (void*) tx, .size = tx_len, .used = 0};
+        struct sd_spi_buf rxb = {.data = ahead->buf, .size = rx_len, .used = 0};
+        card->spi_if->transfer(card, &txb, &rxb);
+    }
+    card->is_xfering = false;
+    ahead->len = (uint8_t) rx_len;
+
+    return (ret == 0) ? Sd_Err_OK : Sd_Err_IO;
+}
+
+/**
+ * @brief 硬件 SPI 扫描总线，直到读到满足条件的字节或读满 max 个字节
+ * @note 每次从总线读取 SD_SPI_XFER_SCAN_CHUNK 个字节并在其中查找，满足条件的字节之后的字节留作预读字节。
+ * @param card            [in]  SD卡对象
+ * @param until_ff        [in]  true：查找 0xFF（如退出忙状态）；false：查找非 0xFF 的字节（如响应、令牌）
+ * @param max             [in]  最多读取的字节数
+ * @param byte            [out] 满足条件的字节；未找到时为最后读到的字节，max 为 0 时不修改
+ * @param scanned         [out] 查询的字节数（含满足条件的字节），可为 NULL
+ * @return enum sd_error  [out] 错误码，是否找到由调用者根据 byte 判断
+ */
+enum sd_error sd_spi_hw_scan(struct sd_card* card, bool until_ff, uint32_t max, uint8_t* byte, uint32_t* scanned)
+{
+    struct sd_rx_ahead* ahead = &card->ahead;
+    enum sd_error err = Sd_Err_OK;
+    uint32_t count = 0;
+
+    if(card->spi_if== NULL || card->spi_if->transfer == NULL)
+        return Sd_Err_IO;
+
+    while(max != 0)
+    {
+        /** 1. 预读字节已用完，从总线读取下一段 **/
+        if(ahead->pos == ahead->len)
+        {
+            uint32_t n = (max < SD_SPI_XFER_SCAN_CHUNK) ? max : SD_SPI_XFER_SCAN_CHUNK;
+            _ahead_drop(card);
+            if((err = _port_read(card, ahead->buf, n)) != Sd_Err_OK)
+                return err;
+            ahead->len = (uint8_t) n;
+        }
+
+        /** 2. 在预读字节中查找 **/
+        while(ahead->pos < ahead->len && max != 0)
+        {
+            *byte = ahead->buf[ahead->pos++];
+            max--;
+            count++;
+            if((*byte == 0xFF) == until_ff)
+                max = 0;
+        }
+    }
+
+    if(scanned != NULL)
+        *scanned = count;
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 判断一段传输能否使用端口的异步传输（xfer_start/xfer_poll）
+ * @param card            [in]  SD卡对象
+ * @param buf             [in]  数据缓冲区
+ * @param len             [in]  传输长度
+ * @return true           [out] 可以使用
+ * @return false          [out] 端口未实现，长度、对齐不满足要求，或尚有未取用的预读字节
+ */
+bool sd_spi_hw_can_start(struct sd_card* card, const void* buf, uint32_t len)
+{
+    struct sd_spi_interface* spi_if = card->spi_if;
+
+    if(spi_if == NULL || spi_if->xfer_start == NULL || spi_if->xfer_poll == NULL)
+        return false;
+    if(len == 0 || len < spi_if->dma_min_len || card->ahead.pos != card->ahead.len)
+        return false;
+    if(spi_if->dma_align > 1 && (((uintptr_t) buf | len) & (spi_if->dma_align - 1)) != 0)
+        return false;
+    return true;
+}
+
+/**
+ * @brief 启动端口的异步传输，之后通过 sd_spi_hw_xfer_poll() 查询完成
+ * @param card            [in]  SD卡对象
+ * @param tx              [in]  发送缓冲区，NULL 表示发送 0xFF
+ * @param rx              [out] 接收缓冲区，NULL 表示丢弃接收的数据
+ * @param len             [in]  传输长度
+ * @return enum sd_error  [out] 错误码
+ */
+enum sd_error sd_spi_hw_xfer_start(struct sd_card* card, const void* tx, void* rx, uint32_t len)
+{
+    _ahead_drop(card);
+    card->port_calls++;
+    card->port_bytes += len;
+    card->is_xfering = true;
+    if(card->spi_if->xfer_start(card, tx, rx, len) != 0)
+    {
+        card->is_xfering = false;
+        return Sd_Err_IO;
+    }
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 查询端口的异步传输
+ * @param card            [in]  SD卡对象
+ * @return enum sd_error  [out] 错误码，传输仍在进行时返回 Sd_Err_No_Ready
+ */
+enum sd_error sd_spi_hw_xfer_poll(struct sd_card* card)
+{
+    int ret = card->spi_if->xfer_poll(card);
+
+    if(ret == 1)
+        return Sd_Err_No_Ready;
+    card->is_xfering = false;
+    return (ret == 0) ? Sd_Err_OK : Sd_Err_IO;
+}
+
+/**
+ * @brief 硬件 SPI 批量读取数据块，满足条件时使用端口的异步传输（如 DMA）并等待完成
+ * @param card            [in]  SD卡对象
+ * @param buf             [out] 数据缓冲区（通常为用户缓冲区）
+ * @param len             [in]  期望读取的字节数
+ * @return enum sd_error  [out] 错误码
+ */
+enum sd_error sd_spi_hw_bulk_read(struct sd_card* card, void* buf, uint32_t len)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    if(card->spi_if== NULL || card->spi_if->transfer == NULL)
+        return Sd_Err_IO;
+
+    /** 1. 先取用预读字节 **/
+    uint8_t* ptr = buf;
+    uint32_t n = _ahead_take(card, ptr, len);
+    if(n == len)
+        return Sd_Err_OK;
+    ptr += n;
+    len -= n;
+
+    /** 2. 取用预读字节后地址可能不再对齐：头部同步读取到对齐地址为止，中间对齐的部分使用异步传输，尾部同步读取 **/
+    uint32_t align = (card->spi_if->dma_align > 1) ? card->spi_if->dma_align : 1;
+    uint32_t head = (uint32_t) (-(uintptr_t) ptr) & (align - 1);
+    uint32_t body = (len > head) ? ((len - head) & ~(align - 1)) : 0;
+
+    if(body == 0 || !sd_spi_hw_can_start(card, ptr + head, body))
+        return _port_read(card, ptr, len);
+
+    if(head != 0 && (err = _port_read(card, ptr, head)) != Sd_Err_OK)
+        return err;
+    if((err = sd_spi_hw_xfer_start(card, NULL, ptr + head, body)) != Sd_Err_OK)
+        return err;
+    while((err = sd_spi_hw_xfer_poll(card)) == Sd_Err_No_Ready);
+    if(err != Sd_Err_OK || head + body == len)
+        return err;
+    return _port_read(card, ptr + head + body, len - head - body);
+}
+
+/**
+ * @brief 硬件 SPI 批量写入数据块，满足条件时使用端口的异步传输（如 DMA）并等待完成
+ * @param card            [in]  SD卡对象
+ * @param buf             [in]  数据缓冲区（通常为用户缓冲区）
+ * @param len             [in]  期望写出的字节数
+ * @return enum sd_error  [out] 错误码
+ */
+enum sd_error sd_spi_hw_bulk_write(struct sd_card* card, const void* buf, uint32_t len)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    _ahead_drop(card);
+    if(!sd_spi_hw_can_start(card, buf, len))
+        return sd_spi_hw_write_bytes(card, (void*) buf, len);
+
+    if((err = sd_spi_hw_xfer_start(card, buf, NULL, len)) != Sd_Err_OK)
+        return err;
+    while((err = sd_spi_hw_xfer_poll(card)) == Sd_Err_No_Ready);
+    return err;
+}
+
 /**
  * @brief 硬件 SPI 延时
  * @param card [in]  SD卡对象
@@ -163,6 +452,18 @@ void sd_spi_hw_udelay (struct sd_card* card, uint32_t us)
     card->spi_if->delay_us(card, us);
 }
 
+/**
+ * @brief 获取微秒时间戳
+ * @param card          [in]  SD卡对象
+ * @return uint32_t     [out] 时间戳，单位：微秒，用户未实现 now_us() 时返回 0
+ */
+uint32_t sd_spi_hw_now_us (struct sd_card* card)
+{
+    if(card->spi_if== NULL || card->spi_if->now_us == NULL)
+        return 0;
+    return card->spi_if->now_us(card);
+}
+
 /**
  * @brief 硬件 SPI 发送多次 dummy 数据
  * @param card              [in]  SD卡对象
@@ -171,10 +472,21 @@ void sd_spi_hw_udelay (struct sd_card* card, uint32_t us)
  */
 enum sd_error sd_spi_hw_send_dummy (struct sd_card* card, uint8_t count)
 {
+    static const uint8_t dummy[16] =
+    {
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    };
     enum sd_error err = Sd_Err_OK;
-    while(count--)
-        if((err = sd_spi_hw_write_byte(card, 0xFF)) != Sd_Err_OK)
+
+    /** 以整段缓冲区发送，每 16 个字节只调用一次端口 **/
+    while(count != 0)
+    {
+        uint8_t n = (count < sizeof(dummy)) ? count : sizeof(dummy);
+        if((err = sd_spi_hw_write_bytes(card, (void*) dummy, n)) != Sd_Err_OK)
             return err;
+        count -= n;
+    }
     return Sd_Err_OK;
 }
 
@@ -190,6 +502,19 @@ void sd_spi_hw_set_speed (struct sd_card* card, enum sd_user_ctrl speed)
     card->spi_if->control(card, speed);
 }
 
+/**
+ * @brief 硬件 SPI 按频率设置时钟
+ * @param card      [in]  SD卡对象
+ * @param hz        [in]  请求的时钟（Hz）
+ * @return uint32_t [out] 实际的时钟（Hz），端口未实现 set_clock() 或设置失败时返回 0
+ */
+uint32_t sd_spi_hw_set_clock (struct sd_card* card, uint32_t hz)
+{
+    if(card->spi_if == NULL || card->spi_if->set_clock == NULL)
+        return 0;
+    return card->spi_if->set_clock(card, hz);
+}
+
 /**
  * @brief 硬件检查卡是否已拔出
  * @param card   [in]  SD卡对象
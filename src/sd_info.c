@@ -11,10 +11,28 @@
 #include "sd_spi_driver.h"
 #include "sd_private.h"
 
+#define SD_TRACE_FILE_ID    6           // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
 
 
 
 
+/**
+ * @brief 将 CSD 中的 TRAN_SPEED 字段换算为时钟频率
+ * @note 位 2:0 为速率单位（100kbit/s、1Mbit/s、10Mbit/s、100Mbit/s），位 6:3 为倍数（1.0~8.0）。
+ * @param tran_speed    [in]  TRAN_SPEED 字段（CSD 第 3 字节）
+ * @return uint32_t     [out] 时钟频率（Hz），字段无效时返回 0
+ */
+static uint32_t _tran_speed_hz(uint8_t tran_speed)
+{
+    static const uint8_t mult_x10[16] = {0, 10, 12, 13, 15, 20, 25, 30, 35, 40, 45, 50, 55, 60, 70, 80};
+    static const uint32_t unit_div10[4] = {10000, 100000, 1000000, 10000000};
+
+    if((tran_speed & 0x07) > 3)
+        return 0;
+    return mult_x10[(tran_speed >> 3) & 0x0F] * unit_div10[tran_speed & 0x07];
+}
+
 /**
  * @brief 解析V2卡的CSD寄存器（用于SDHC/SDXC卡）
  * @param card            [in]  SD卡对象
@@ -41,6 +59,8 @@ static enum sd_error _parse_csd_v2(struct sd_card* card, uint8_t csd[16], struct
     info->block_size            = 512;
     info->capacity              = (uint64_t)info->block_count * info->block_size;
     info->erase_sector_size     = 1 << (erase_sector_size + 1);
+    info->max_hz                = _tran_speed_hz(csd[3]);
+    info->ccc                   = ((uint16_t) csd[4] << 4) | (csd[5] >> 4);
     
     return Sd_Err_OK;
 }
@@ -77,76 +97,99 @@ static enum sd_error _parse_csd_v1(struct sd_card* card, uint8_t csd[16], struct
     info->block_count           = block_count;
     info->capacity              = (uint64_t)block_size * block_count;
     info->erase_sector_size     = 1 << (erase_sector_size + 1);      
+    info->max_hz                = _tran_speed_hz(csd[3]);
+    info->ccc                   = ((uint16_t) csd[4] << 4) | (csd[5] >> 4);
     
     return Sd_Err_OK;
 }
 
 /**
- * @brief 检查卡是否可能是 v2.00 版本
+ * @brief 循环发送 CMD55+ACMD41，直到卡完成初始化（退出空闲状态）
+ * @note 轮询间隔从 SD_SPI_INIT_POLL_MIN_US 开始每次翻倍，不超过 SD_SPI_INIT_POLL_MAX_US；从初始化开始计时，
+ *       超出 SD_SPI_INIT_TIMEOUT_US 前仍未完成则返回超时。完成后（开启 SD_SPI_INIT_EARLY_CLOCK 时）立即切换到默认速度模式的时钟。
  * @param card            [in]  SD卡对象
+ * @param arg             [in]  ACMD41 参数（v2 卡设置 HCS 位）
+ * @param crc             [in]  ACMD41 命令帧最后一个字节，SD_CMD_CRC_XXX
  * @return enum sd_error  [out] 错误码
  */
-static enum sd_error _check_card_maybe_v2(struct sd_card* card)
+static enum sd_error _wait_op_cond(struct sd_card* card, uint32_t arg, uint8_t crc)
 {
     enum sd_error err = Sd_Err_OK;
-    uint8_t timeout = 0xff; 
+    uint32_t interval = SD_SPI_INIT_POLL_MIN_US;
 
-    /** 1. 发送 CMD55+ACMD41，开始SD卡初始化并检查SD卡是否初始化完成 **/
+    while (1)
     {
-        do
+        // 发送CMD55 (应用命令前缀)
+        struct sd_resp_res resp_cmd55 = {0};
+        struct sd_cmd_req req_cmd55 = 
         {
-            // 发送CMD55 (应用命令前缀)
-            struct sd_resp_res resp_cmd55 = {0};
-            struct sd_cmd_req req_cmd55 = 
-            {
-                .cmd = Sd_Cmd55_App_Cmd, .arg = 0, .crc = 1,
-                .resp_type = Sd_Resp_Type_R1, .retry = 5
-            };
-            if ((err = sd_card_send_cmd_req(card, &req_cmd55, &resp_cmd55)) != Sd_Err_OK)
-                return err;
-
-            // 检查 CMD55 响应是否有效
-            if (resp_cmd55.buf[0] != SD_FR_IN_IDLE_STATE)
-            { 
-                trace_i(card, "CMD55 failed, resp is 0x%02X", resp_cmd55.buf[0]);
-                return Sd_Err_Unsupported;
-            }
-
-            // 发送 ACMD41 (初始化卡)
-            struct sd_resp_res resp_acmd41 = {0};
-            struct sd_cmd_req req_acmd41 = 
-            {
-                .cmd = Sd_Acmd41_Op_Cond,
-                .arg = 0x40000000, // 设置HCS位(bit30)表示支持高容量卡
-                .crc = 1,
-                .resp_type = Sd_Resp_Type_R1,
-                .retry = 5
-            };
-            if ((err = sd_card_send_cmd_req(card, &req_acmd41, &resp_acmd41)) != Sd_Err_OK)
-                return err;
+            .cmd = Sd_Cmd55_App_Cmd, .arg = 0, .crc = SD_CMD_CRC_CMD55,
+            .resp_type = Sd_Resp_Type_R1, .retry = 5
+        };
+        if ((err = sd_card_send_cmd_req(card, &req_cmd55, &resp_cmd55)) != Sd_Err_OK)
+            return err;
 
-            // 检查 ACMD41 响应：当bit0为0时表示初始化完成
-            if ((resp_acmd41.buf[0] & SD_FR_IN_IDLE_STATE) == 0)
-                break; // 初始化完成，退出循环
+        // 检查 CMD55 响应是否有效
+        if (resp_cmd55.buf[0] != SD_FR_IN_IDLE_STATE)
+        { 
+            trace_i(card, "CMD55 failed, resp is 0x%02X", resp_cmd55.buf[0]);
+            return Sd_Err_Unsupported;
+        }
 
-            // 延时等待
-            sd_spi_hw_udelay(card, 1000);
+        // 发送 ACMD41 (初始化卡)
+        struct sd_resp_res resp_acmd41 = {0};
+        struct sd_cmd_req req_acmd41 = 
+        {
+            .cmd = Sd_Acmd41_Op_Cond, .arg = arg, .crc = crc,
+            .resp_type = Sd_Resp_Type_R1, .retry = 5
+        };
+        if ((err = sd_card_send_cmd_req(card, &req_acmd41, &resp_acmd41)) != Sd_Err_OK)
+            return err;
+        card->init_timing.acmd41_polls++;
 
-        } while (--timeout);
+        // 检查 ACMD41 响应：当bit0为0时表示初始化完成
+        if ((resp_acmd41.buf[0] & SD_FR_IN_IDLE_STATE) == 0)
+            break;
 
-        if (timeout == 0)
+        // 退避等待，超出时间预算则放弃
+        if (sd_card_init_elapsed(card) + interval > SD_SPI_INIT_TIMEOUT_US)
         {
-            trace_w(card, "ACMD41 init timeout");
+            trace_w(card, "ACMD41 init timeout after %d polls", card->init_timing.acmd41_polls);
             return Sd_Err_Timeout;
         }
+        interval = sd_card_init_backoff(card, interval);
     }
 
+    sd_card_init_mark(card, Sd_Init_Phase_Op_Cond);
+    trace_d(card, "ACMD41 done after %d polls", card->init_timing.acmd41_polls);
+
+#if (SD_SPI_INIT_EARLY_CLOCK == 1)
+    /** 卡已退出识别状态，之后的命令不再受识别阶段的低速时钟限制 **/
+    sd_clock_set_default(card);
+#endif
+
+    return Sd_Err_OK;
+}
+
+/**
+ * @brief 检查卡是否可能是 v2.00 版本
+ * @param card            [in]  SD卡对象
+ * @return enum sd_error  [out] 错误码
+ */
+static enum sd_error _check_card_maybe_v2(struct sd_card* card)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    /** 1. 发送 CMD55+ACMD41，开始SD卡初始化并检查SD卡是否初始化完成 **/
+    if ((err = _wait_op_cond(card, 0x40000000, SD_CMD_CRC_ACMD41_HCS)) != Sd_Err_OK)    // 设置HCS位(bit30)表示支持高容量卡
+        return err;
+
     /** 2. 发送CMD58读取OCR寄存器，初步判断卡类型  **/
     {
         struct sd_resp_res resp_cmd58 = {0};
         struct sd_cmd_req req_cmd58 = 
         {
-            .cmd = Sd_Cmd58_Rd_Ocr, .arg = 0, .crc = 1,
+            .cmd = Sd_Cmd58_Rd_Ocr, .arg = 0, .crc = SD_CMD_CRC_CMD58,
             .resp_type = Sd_Resp_Type_R3, .retry = 5
         };
         if ((err = sd_card_send_cmd_req(card, &req_cmd58, &resp_cmd58)) != Sd_Err_OK)
@@ -183,7 +226,7 @@ static enum sd_error _check_card_maybe_v2(struct sd_card* card)
         struct sd_resp_res resp_cmd9 = {0};
         struct sd_cmd_req req_cmd9 = 
         {
-            .cmd = Sd_Cmd9_Csd, .arg = 0, .crc = 1,
+            .cmd = Sd_Cmd9_Csd, .arg = 0, .crc = SD_CMD_CRC_CMD9,
             .resp_type = Sd_Resp_Type_R2, .retry = 5
         };
         sd_spi_hw_send_dummy(card, 2);      // 发送 CMD9 前必须发送 2 个虚拟字节
@@ -231,51 +274,10 @@ static enum sd_error _check_card_maybe_v2(struct sd_card* card)
 static enum sd_error _check_card_maybe_v1(struct sd_card *card)
 {
     enum sd_error err = Sd_Err_OK;
-    uint8_t timeout = 0xff; // 合理的超时次数
 
     /** 1. 发送 CMD55+ACMD41，开始SD卡初始化并检查SD卡是否初始化完成  **/
-    {
-        do
-        {
-            // 发送CMD55 (应用命令前缀)
-            struct sd_resp_res resp_cmd55 = {0};
-            struct sd_cmd_req req_cmd55 = 
-            {
-                .cmd = Sd_Cmd55_App_Cmd, .arg = 0, .crc = 1,
-                .resp_type = Sd_Resp_Type_R1, .retry = 5
-            };
-            if ((err = sd_card_send_cmd_req(card, &req_cmd55, &resp_cmd55)) != Sd_Err_OK)
-                return err;
-
-            // 检查CMD55响应是否有效
-            if (resp_cmd55.buf[0] != 0x01)
-            { // 期望响应：空闲状态
-                trace_e(card, "CMD55 failed: 0x%02X", resp_cmd55.buf[0]);
-                return Sd_Err_Failed;
-            }
-
-            // 发送ACMD41 (初始化卡) - V1卡不需要HCS位
-            struct sd_resp_res resp_acmd41 = {0};
-            struct sd_cmd_req req_acmd41 = 
-            {
-                .cmd = Sd_Acmd41_Op_Cond, .arg = 0, .crc = 1, // V1卡忽略 arg 参数中的 HCS 位
-                .resp_type = Sd_Resp_Type_R1, .retry = 5
-            };
-            if ((err = sd_card_send_cmd_req(card, &req_acmd41, &resp_acmd41)) != Sd_Err_OK)
-                return err;
-
-            // 检查ACMD41响应：当bit0为0时表示初始化完成
-            if ((resp_acmd41.buf[0] & 0x01) == 0)
-                break; // 初始化完成，退出循环
-
-        } while (--timeout);
-
-        if (timeout == 0)
-        {
-            trace_w(card, "ACMD41 initialization timeout for V1 card");
-            return Sd_Err_Timeout;
-        }
-    }
+    if ((err = _wait_op_cond(card, 0, SD_CMD_CRC_ACMD41)) != Sd_Err_OK)      // V1卡不需要HCS位
+        return err;
 
     /** 2. 设置卡类型，并发送 CMD16 读取块长度 **/
     {
@@ -287,7 +289,7 @@ static enum sd_error _check_card_maybe_v1(struct sd_card *card)
         struct sd_resp_res resp_cmd16 = {0};
         struct sd_cmd_req req_cmd16 = 
         {
-            .cmd = Sd_Cmd16_Block_len, .arg = 512, .crc = 1,
+            .cmd = Sd_Cmd16_Block_len, .arg = 512, .crc = SD_CMD_CRC_CMD16_512,
             .resp_type = Sd_Resp_Type_R1, .retry = 5
         };
         if ((err = sd_card_send_cmd_req(card, &req_cmd16, &resp_cmd16)) != Sd_Err_OK)
@@ -306,7 +308,7 @@ static enum sd_error _check_card_maybe_v1(struct sd_card *card)
         struct sd_resp_res resp_cmd9 = {0};
         struct sd_cmd_req req_cmd9 = 
         {
-            .cmd = Sd_Cmd9_Csd, .arg = 0, .crc = 1,
+            .cmd = Sd_Cmd9_Csd, .arg = 0, .crc = SD_CMD_CRC_CMD9,
             .resp_type = Sd_Resp_Type_R2, .retry = 5    // CSD是16字节响应
         };  
         if ((err = sd_card_send_cmd_req(card, &req_cmd9, &resp_cmd9)) != Sd_Err_OK)
@@ -351,11 +353,13 @@ static enum sd_error _card_identify(struct sd_card *card)
     /** 发送CMD8，检查卡电压范围 **/
     struct sd_cmd_req req = 
     {
-        .cmd = Sd_Cmd8_If_Cond, .arg = 0x1AA, .crc = 0x87,
+        .cmd = Sd_Cmd8_If_Cond, .arg = 0x1AA, .crc = SD_CMD_CRC_CMD8_1AA,
         .resp_type = Sd_Resp_Type_R7, .retry = 5,
     };
 
-    if ((err = sd_card_send_cmd_req(card, &req, &resp)) != Sd_Err_OK)
+    err = sd_card_send_cmd_req(card, &req, &resp);
+    sd_card_init_mark(card, Sd_Init_Phase_If_Cond);
+    if (err != Sd_Err_OK)
     {
         trace_e(card, "CMD8 failed, maybe a SDSC v1.x or MMC...");
         err = _check_card_maybe_v1(card);       // 如果CMD8失败，可能是V1卡或MMC
@@ -377,6 +381,12 @@ static enum sd_error _card_identify(struct sd_card *card)
             err = Sd_Err_Unsupported;
         }
     }
+    else if (resp.buf[0] & SD_FR_ILLEGAL_COMMAND)
+    {
+        /** V1.x 的卡不支持CMD8，响应 0x05（空闲 + 非法命令） **/
+        trace_d(card, "CMD8 illegal, maybe a SDSC v1.x or MMC...");
+        err = _check_card_maybe_v1(card);
+    }
     else
     {
         trace_e(card, "CMD8 response error: 0x%02X", resp.buf[0]);
@@ -410,14 +420,38 @@ enum sd_error sd_card_identify(struct sd_card* card)
     /** 令卡进入空闲状态 **/
     if((err = sd_card_into_idle(card))!= Sd_Err_OK)
         return err;
+    sd_card_init_mark(card, Sd_Init_Phase_Idle);
 
     /** 识别卡类型 **/
     if((err = _card_identify(card))!= Sd_Err_OK)
         return err;
+    sd_card_init_mark(card, Sd_Init_Phase_Registers);
 
     return err;
 }
 
+/**
+ * @brief 解析 CMD6 返回的 64 字节功能状态
+ * @note 功能状态按大端位序排列：位 511:496 为最大电流，位 495:400 为功能组 6~1 支持的功能，
+ *       位 399:376 为功能组 6~1 的功能号，位 375:368 为数据结构版本，位 367:272 为功能组 6~1 的忙状态。
+ * @param raw       [in]  功能状态原始数据
+ * @param status    [out] 解析结果
+ */
+void sd_card_parse_switch_status(const uint8_t raw[64], struct sd_switch_status* status)
+{
+    status->max_current = ((uint16_t) raw[0] << 8) | raw[1];
+    status->version     = raw[17];
+
+    for (uint8_t g = 0; g < 6; g++)
+    {
+        uint8_t nibble = raw[16 - g / 2];
+
+        status->support[g]  = ((uint16_t) raw[12 - g * 2] << 8) | raw[13 - g * 2];
+        status->selected[g] = (g & 1) ? (nibble >> 4) : (nibble & 0x0F);
+        status->busy[g]     = (status->version >= 1) ? (((uint16_t) raw[28 - g * 2] << 8) | raw[29 - g * 2]) : 0;
+    }
+}
+
 
 
 
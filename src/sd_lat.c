@@ -0,0 +1,184 @@
+/**
+ * @file sd_lat.c
+ * @author SouthernSandbox (https://github.com/SouthernSandbox)
+ * @brief 延迟直方图：按操作类型记录耗时的对数分桶直方图，并计算百分位数
+ * @version 0.1
+ * @date 2025-08-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "sd_spi_driver.h"
+#include "sd_private.h"
+#include "string.h"
+
+#define SD_TRACE_FILE_ID    7           // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
+/**
+ * @brief 获取桶的上界
+ * @param idx           [in]  桶的下标
+ * @return uint32_t     [out] 桶中耗时的最大值，单位：微秒
+ */
+static uint32_t _bucket_max(uint8_t idx)
+{
+    if (idx >= SD_LAT_BUCKETS - 1 || idx >= 32)
+        return UINT32_MAX;
+    return ((uint32_t) 1 << idx) - 1;
+}
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 计算耗时所在的桶：耗时的二进制位数，超出范围的记入最后一个桶
+ * @note 片上基准测试（sd_bench.c）也使用该分桶方式。
+ * @param us            [in]  耗时，单位：微秒
+ * @return uint8_t      [out] 桶的下标
+ */
+uint8_t sd_lat_bucket(uint32_t us)
+{
+    uint8_t idx = 0;
+
+#if defined(__GNUC__) || defined(__clang__)
+    if (us != 0)
+        idx = (uint8_t) (32 - __builtin_clz(us));
+#else
+    while (us != 0)
+    {
+        idx++;
+        us >>= 1;
+    }
+#endif
+
+    return (idx < SD_LAT_BUCKETS) ? idx : SD_LAT_BUCKETS - 1;
+}
+
+/**
+ * @brief 计算百分位数
+ * @param hist          [in]  延迟直方图
+ * @param permille      [in]  千分位，如 500 为 p50，990 为 p99
+ * @return uint32_t     [out] 百分位数所在桶的上界（不超过最大值），单位：微秒
+ */
+uint32_t sd_lat_percentile(const struct sd_lat_hist *hist, uint32_t permille)
+{
+    uint32_t rank = (uint32_t) (((uint64_t) hist->count * permille + 999) / 1000);
+    uint32_t sum = 0;
+
+    if (rank == 0)
+        rank = 1;
+
+    for (uint8_t i = 0; i < SD_LAT_BUCKETS; i++)
+    {
+        sum += hist->buckets[i];
+        if (sum >= rank)
+        {
+            uint32_t us = _bucket_max(i);
+            return (us < hist->max_us) ? us : hist->max_us;
+        }
+    }
+
+    return hist->max_us;
+}
+
+#if (SD_SPI_LATENCY_ENABLE == 1)
+
+/**
+ * @brief 记录一次操作的耗时
+ * @note 未实现 now_us() 时不记录。
+ * @param card  [in]  SD卡对象
+ * @param op    [in]  操作类型
+ * @param t0    [in]  操作开始时的时间戳，单位：微秒
+ */
+void sd_lat_record(struct sd_card *card, enum sd_lat_op op, uint32_t t0)
+{
+    if (card->spi_if == NULL || card->spi_if->now_us == NULL)
+        return;
+
+    uint32_t us = sd_spi_hw_now_us(card) - t0;
+    struct sd_lat_hist *hist = &card->lat[op];
+
+    card->lat_seq++;
+    sd_barrier();
+    hist->buckets[sd_lat_bucket(us)]++;
+    hist->count++;
+    hist->total_us += us;
+    if (us > hist->max_us)
+        hist->max_us = us;
+    sd_barrier();
+    card->lat_seq++;
+}
+
+#endif  // SD_SPI_LATENCY_ENABLE
+
+/**
+ * @brief 获取一类操作的延迟统计结果
+ * @note 可在其他线程中调用，读取方式与 sd_card_get_stats() 相同。延迟直方图未开启时结果全部为 0。
+ * @param card              [in]  SD卡对象
+ * @param op                [in]  操作类型
+ * @param report            [out] 统计结果
+ * @return enum sd_error    [out] 错误码，延迟直方图未开启时返回 Sd_Err_Unsupported
+ */
+enum sd_error sd_card_get_latency(struct sd_card *card, enum sd_lat_op op, struct sd_lat_report *report)
+{
+    if (card == NULL || report == NULL || (uint32_t) op >= Sd_Lat_Op_Num)
+        return Sd_Err_Param;
+
+    memset(report, 0, sizeof(*report));
+
+#if (SD_SPI_LATENCY_ENABLE == 1)
+    /** 1. 读取完整的直方图快照 **/
+    struct sd_lat_hist hist;
+    uint8_t i = 0;
+    for (; i < 4; i++)
+    {
+        uint32_t seq = card->lat_seq;
+        if (seq & 1)
+            continue;           // 正在更新
+
+        sd_barrier();
+        hist = card->lat[op];
+        sd_barrier();
+        if (card->lat_seq == seq)
+            break;
+    }
+    if (i == 4)
+        return Sd_Err_No_Ready;
+
+    /** 2. 计算统计结果 **/
+    report->count = hist.count;
+    if (hist.count != 0)
+    {
+        report->p50_us = sd_lat_percentile(&hist, 500);
+        report->p99_us = sd_lat_percentile(&hist, 990);
+        report->max_us = hist.max_us;
+        report->avg_us = (uint32_t) (hist.total_us / hist.count);
+    }
+    return Sd_Err_OK;
+#else
+    return Sd_Err_Unsupported;
+#endif
+}
+
+/**
+ * @brief 清零卡的延迟直方图
+ * @note 应在访问该卡的线程中调用，或与该卡的读写互斥。
+ * @param card              [in]  SD卡对象
+ */
+void sd_card_reset_latency(struct sd_card *card)
+{
+    if (card == NULL)
+        return;
+
+#if (SD_SPI_LATENCY_ENABLE == 1)
+    card->lat_seq++;
+    sd_barrier();
+    memset(card->lat, 0, sizeof(card->lat));
+    sd_barrier();
+    card->lat_seq++;
+#endif
+}
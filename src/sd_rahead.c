@@ -0,0 +1,222 @@
+/**
+ * @file sd_rahead.c
+ * @author SouthernSandbox (https://github.com/SouthernSandbox)
+ * @brief 顺序预读：检测顺序读取并以自适应窗口预先读入后续的块
+ * @version 0.1
+ * @date 2025-08-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "sd_spi_driver.h"
+#include "sd_private.h"
+#include "string.h"
+
+#define SD_TRACE_FILE_ID    8           // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
+#if (SD_SPI_RAHEAD_ENABLE == 1)
+
+/**
+ * @brief 预读状态
+ */
+struct rahead
+{
+    struct sd_card*     card;           // 当前顺序流所属的卡
+    uint32_t            buf_blk;        // 缓冲区中第一个块的块号
+    uint32_t            buf_count;      // 缓冲区中有效的块数
+    uint32_t            buf_used;       // 缓冲区中已被读取的块数（从头计算）
+    uint32_t            next_blk;       // 顺序读取时期望的下一个起始块号
+    uint32_t            seq_run;        // 连续顺序读取的次数
+    uint32_t            window;         // 当前预读窗口（块数）
+};
+
+static uint8_t buffer[SD_SPI_RAHEAD_MAX_BLOCKS * SD_SPI_RAHEAD_BLOCK_SIZE];   // 预读缓冲区
+static struct rahead ra;                                                     // 预读状态
+static struct sd_rahead_stats stats;                                         // 统计信息
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 丢弃预读缓冲区中的内容
+ */
+static void _drop(void)
+{
+    if (ra.buf_count > ra.buf_used)
+        stats.discards += ra.buf_count - ra.buf_used;
+    ra.buf_count = 0;
+    ra.buf_used = 0;
+}
+
+/**
+ * @brief 判断块是否在预读缓冲区中
+ * @param blk       [in]  块号
+ * @return true     [out] 在缓冲区中
+ * @return false    [out] 不在缓冲区中
+ */
+static bool _is_buffered(uint32_t blk)
+{
+    return (uint32_t)(blk - ra.buf_blk) < ra.buf_count;
+}
+
+/**
+ * @brief 更新顺序访问检测
+ * @note 起始块号紧接上一次读取的结尾时视为顺序读取；读取缓冲区内的块（如重复读取）不改变检测结果；
+ *       其他情况视为随机访问，停止预读并将窗口恢复为初始值。
+ * @param card  [in]  SD卡对象
+ * @param blk   [in]  起始块号
+ * @param count [in]  块数量
+ */
+static void _detect(struct sd_card *card, uint32_t blk, uint32_t count)
+{
+    if (ra.card != card)
+    {
+        _drop();
+        ra.card = card;
+        ra.seq_run = 0;
+        ra.window = SD_SPI_RAHEAD_MIN_BLOCKS;
+    }
+    else if (blk == ra.next_blk)
+        ra.seq_run++;
+    else if (!_is_buffered(blk))
+    {
+        if (ra.seq_run >= SD_SPI_RAHEAD_TRIGGER)
+            stats.shutoffs++;
+        ra.seq_run = 0;
+        ra.window = SD_SPI_RAHEAD_MIN_BLOCKS;
+    }
+
+    ra.next_blk = blk + count;
+}
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 经过预读缓冲区读取一段连续的块
+ * @note 命中缓冲区的块直接拷贝；其余的块在顺序读取时与预读窗口合并为一次多块读取读入缓冲区，
+ *       每次预读后窗口翻倍，直至 SD_SPI_RAHEAD_MAX_BLOCKS。执行后 card->xfer_blocks 为已完成的块数。
+ * @param card              [in]  SD卡对象
+ * @param blk               [in]  起始块号
+ * @param count             [in]  块数量
+ * @param cur               [out] 数据段游标
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_rahead_read(struct sd_card *card, uint32_t blk, uint32_t count, struct sd_iov_cursor *cur)
+{
+    enum sd_error err = Sd_Err_OK;
+    uint32_t done = 0;
+
+    if (card->info.block_size != SD_SPI_RAHEAD_BLOCK_SIZE)
+        return sd_card_rw_blocks_direct(card, blk, count, cur, false, SD_WR_OPT_NONE);
+
+    /** 1. 检测顺序访问 **/
+    _detect(card, blk, count);
+
+    /** 2. 返回缓冲区中命中的块 **/
+    while (done < count && _is_buffered(blk + done))
+    {
+        uint32_t idx = blk + done - ra.buf_blk;
+        sd_iov_copy(cur, &buffer[idx * SD_SPI_RAHEAD_BLOCK_SIZE], SD_SPI_RAHEAD_BLOCK_SIZE, true);
+        if (ra.buf_used < idx + 1)
+            ra.buf_used = idx + 1;
+        stats.hits++;
+        done++;
+    }
+    blk += done;
+    count -= done;
+
+    /** 3. 读取剩余的块：顺序读取时连同预读窗口一起读入缓冲区，否则直接读取 **/
+    if (count != 0)
+    {
+        uint32_t n = count + ra.window;
+        if (n > SD_SPI_RAHEAD_MAX_BLOCKS)
+            n = SD_SPI_RAHEAD_MAX_BLOCKS;
+        if ((uint64_t) blk + n > card->info.block_count)
+            n = (blk < card->info.block_count) ? (uint32_t) (card->info.block_count - blk) : count;
+
+        if (ra.seq_run < SD_SPI_RAHEAD_TRIGGER || count >= n)
+        {
+            err = sd_card_rw_blocks_direct(card, blk, count, cur, false, SD_WR_OPT_NONE);
+            done += card->xfer_blocks;
+        }
+        else
+        {
+            struct sd_iovec seg = {.buf = buffer, .len = n * SD_SPI_RAHEAD_BLOCK_SIZE};
+            struct sd_iov_cursor fill = {.iov = &seg, .idx = 0, .off = 0};
+
+            _drop();
+            err = sd_card_rw_blocks_direct(card, blk, n, &fill, false, SD_WR_OPT_NONE);
+            ra.buf_blk = blk;
+            ra.buf_count = card->xfer_blocks;
+            ra.buf_used = (ra.buf_count < count) ? ra.buf_count : count;
+
+            sd_iov_copy(cur, buffer, ra.buf_used * SD_SPI_RAHEAD_BLOCK_SIZE, true);
+            done += ra.buf_used;
+            if (ra.buf_used == count)
+                err = Sd_Err_OK;        // 仅预读部分出错不影响本次读取
+
+            stats.prefetches++;
+            stats.prefetch_blocks += ra.buf_count - ra.buf_used;
+            if ((ra.window *= 2) > SD_SPI_RAHEAD_MAX_BLOCKS)
+                ra.window = SD_SPI_RAHEAD_MAX_BLOCKS;
+            trace_d(card, "read-ahead: blk=%d, count=%d, window=%d", blk, ra.buf_count, ra.window);
+        }
+    }
+
+    card->xfer_blocks = done;
+    return err;
+}
+
+/**
+ * @brief 使预读缓冲区中与指定范围重叠的内容失效
+ * @note 写入、擦除卡之前调用，保证之后的读取不会返回旧数据。
+ * @param card  [in]  SD卡对象
+ * @param blk   [in]  起始块号
+ * @param count [in]  块数量
+ */
+void sd_rahead_invalidate(struct sd_card *card, uint32_t blk, uint32_t count)
+{
+    if (ra.card != card || ra.buf_count == 0)
+        return;
+    if ((uint64_t) blk < (uint64_t) ra.buf_blk + ra.buf_count && (uint64_t) ra.buf_blk < (uint64_t) blk + count)
+        _drop();
+}
+
+#endif  // SD_SPI_RAHEAD_ENABLE
+
+/**
+ * @brief 获取顺序预读统计信息
+ * @note 顺序预读未开启时统计信息全部为 0。
+ * @param out       [out] 统计信息
+ */
+void sd_rahead_get_stats(struct sd_rahead_stats *out)
+{
+    if (out == NULL)
+        return;
+#if (SD_SPI_RAHEAD_ENABLE == 1)
+    *out = stats;
+#else
+    memset(out, 0, sizeof(*out));
+#endif
+}
+
+/**
+ * @brief 清零顺序预读统计信息
+ */
+void sd_rahead_reset_stats(void)
+{
+#if (SD_SPI_RAHEAD_ENABLE == 1)
+    memset(&stats, 0, sizeof(stats));
+#endif
+}
\ No newline at end of file
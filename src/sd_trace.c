@@ -0,0 +1,164 @@
+/**
+ * @file sd_trace.c
+ * @author SouthernSandbox (https://github.com/SouthernSandbox)
+ * @brief 追踪记录的运行时等级过滤与二进制环形缓冲区
+ * @version 0.1
+ * @date 2025-08-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "sd_spi_driver.h"
+#include "sd_private.h"
+#include "string.h"
+
+#define SD_TRACE_FILE_ID    11          // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
+#if (SD_SPI_TRACE_ENABLE == 1)
+volatile uint8_t sd_trace_level = SD_SPI_TRACE_LEVEL;       // 运行时记录等级
+#endif
+
+#if (SD_SPI_TRACE_ENABLE == 1) && (SD_SPI_TRACE_MODE == SD_SPI_TRACE_MODE_BINARY)
+
+#if (SD_SPI_TRACE_RING_SIZE & (SD_SPI_TRACE_RING_SIZE - 1)) != 0
+    #error "SD_SPI_TRACE_RING_SIZE must be a power of 2"
+#endif
+
+static struct sd_trace_entry ring[SD_SPI_TRACE_RING_SIZE];     // 环形缓冲区
+static volatile uint32_t head;                                  // 下一条记录的序号（写入方）
+static uint32_t tail;                                           // 下一条待读取记录的序号（读取方）
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 写入一条二进制追踪记录
+ * @note 由 trace_x() 宏调用。写入方通过原子加法领取序号，不加锁，可在多个线程及中断中同时调用；
+ *       缓冲区满时覆盖最旧的记录。
+ * @param card      [in]  SD卡对象，用于获取时间戳
+ * @param id        [in]  事件号
+ * @param level     [in]  等级
+ * @param argc      [in]  参数个数
+ * @param a0        [in]  参数 0
+ * @param a1        [in]  参数 1
+ * @param a2        [in]  参数 2
+ * @param a3        [in]  参数 3
+ */
+void sd_trace_put(struct sd_card *card, uint16_t id, uint8_t level, uint8_t argc, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    uint32_t seq = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+#else
+    uint32_t seq = head++;
+#endif
+    struct sd_trace_entry *e = &ring[seq & (SD_SPI_TRACE_RING_SIZE - 1)];
+
+    e->seq = 0;
+    sd_barrier();
+    e->ts_us = sd_spi_hw_now_us(card);
+    e->id = id;
+    e->level = level;
+    e->argc = argc;
+    e->args[0] = a0;
+    e->args[1] = a1;
+    e->args[2] = a2;
+    e->args[3] = a3;
+    sd_barrier();
+    e->seq = seq + 1;
+}
+
+#endif
+
+/**
+ * @brief 设置运行时记录等级
+ * @note 只能在编译时的 SD_SPI_TRACE_LEVEL 以内降低或恢复等级。等级高于该值的记录在求值参数之前即被跳过，
+ *       例如高负载时设为 SD_SPI_TRACE_LEVEL_WARN 可以保留错误和警告，去掉每次读写的调试记录。
+ * @param level     [in]  等级，SD_SPI_TRACE_LEVEL_XXX
+ */
+void sd_trace_set_level(uint8_t level)
+{
+#if (SD_SPI_TRACE_ENABLE == 1)
+    sd_trace_level = level;
+#else
+    (void) level;
+#endif
+}
+
+/**
+ * @brief 获取运行时记录等级
+ * @return uint8_t  [out] 等级，SD_SPI_TRACE_LEVEL_XXX，追踪未开启时为 SD_SPI_TRACE_LEVEL_NONE
+ */
+uint8_t sd_trace_get_level(void)
+{
+#if (SD_SPI_TRACE_ENABLE == 1)
+    return sd_trace_level;
+#else
+    return SD_SPI_TRACE_LEVEL_NONE;
+#endif
+}
+
+/**
+ * @brief 读出二进制追踪记录
+ * @note 按写入顺序取出上次读取之后的记录。只允许一个读取方；读取方落后超过缓冲区大小时，被覆盖的记录计入 lost。
+ *       读到正在写入的记录时停止，下次调用再读取。读出的记录可原样（小端字节序）保存或发送到主机，由 tools/sd_trace_decode.py 解码。
+ *       非二进制模式下始终返回 0。
+ * @param out           [out] 记录缓冲区
+ * @param max           [in]  最多读取的条数
+ * @param lost          [out] 被覆盖而丢失的条数，可为 NULL
+ * @return uint32_t     [out] 读取的条数
+ */
+uint32_t sd_trace_read(struct sd_trace_entry *out, uint32_t max, uint32_t *lost)
+{
+    uint32_t n = 0;
+
+    if (lost != NULL)
+        *lost = 0;
+    if (out == NULL)
+        return 0;
+
+#if (SD_SPI_TRACE_ENABLE == 1) && (SD_SPI_TRACE_MODE == SD_SPI_TRACE_MODE_BINARY)
+    uint32_t dropped = 0;
+
+    /** 1. 跳过已被覆盖的记录 **/
+    if (head - tail > SD_SPI_TRACE_RING_SIZE)
+    {
+        dropped += head - tail - SD_SPI_TRACE_RING_SIZE;
+        tail = head - SD_SPI_TRACE_RING_SIZE;
+    }
+
+    /** 2. 依次拷贝记录，拷贝前后序号一致才说明记录完整 **/
+    while (n < max && tail != head)
+    {
+        struct sd_trace_entry *e = &ring[tail & (SD_SPI_TRACE_RING_SIZE - 1)];
+        uint32_t seq = e->seq;
+
+        sd_barrier();
+        out[n] = *e;
+        sd_barrier();
+        if (seq == 0 || seq != e->seq || (int32_t) (seq - (tail + 1)) < 0)
+            break;                          // 正在写入
+
+        if (seq != tail + 1)
+        {
+            dropped++;                      // 拷贝前已被新记录覆盖
+            tail++;
+            continue;
+        }
+
+        n++;
+        tail++;
+    }
+
+    if (lost != NULL)
+        *lost = dropped;
+#else
+    (void) max;
+#endif
+
+    return n;
+}
@@ -10,45 +10,121 @@
  */
 #include "sd_spi_driver.h"
 #include "sd_private.h"
+#include "string.h"
+
+#define SD_TRACE_FILE_ID    9           // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
+/**
+ * @brief 轮询总线，直到读到满足条件的字节
+ * @note 先连续查询 SD_SPI_POLL_FAST_COUNT + 1 个字节（按 SD_SPI_XFER_SCAN_CHUNK 分块读取），以便快速捕获短暂的等待，
+ *       之后每隔 SD_SPI_POLL_INTERVAL_US 查询一次。
+ * @param card              [in]  SD卡对象
+ * @param until_ff          [in]  true：等待 0xFF；false：等待非 0xFF 的字节
+ * @param byte              [out] 满足条件的字节
+ * @param timeout_us        [in]  超时时间，单位：微秒
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _wait_bus(struct sd_card* card, bool until_ff, uint8_t* byte, uint32_t timeout_us)
+{
+    enum sd_error err = Sd_Err_OK;
+    uint32_t polls = 0;
+#if (SD_SPI_STATS_ENABLE == 1)
+    uint32_t t0 = sd_spi_hw_now_us(card);
+    uint32_t budget_us = timeout_us;
+#endif
+
+    if((err = sd_spi_hw_scan(card, until_ff, SD_SPI_POLL_FAST_COUNT + 1, byte, &polls)) != Sd_Err_OK)
+        return err;
+
+    while((*byte == 0xFF) != until_ff)
+    {
+        if(timeout_us < SD_SPI_POLL_INTERVAL_US)
+        {
+            err = Sd_Err_Timeout;
+            break;
+        }
+        timeout_us -= SD_SPI_POLL_INTERVAL_US;
+        sd_spi_hw_udelay(card, SD_SPI_POLL_INTERVAL_US);
+
+        if((err = sd_spi_hw_read_byte(card, byte)) != Sd_Err_OK)
+            return err;
+        polls++;
+    }
+
+#if (SD_SPI_STATS_ENABLE == 1)
+    stats_begin(card);
+    if(until_ff)
+    {
+        card->stats.busy_waits += polls;
+        card->stats.busy_us += (card->spi_if->now_us != NULL) ? (uint32_t) (sd_spi_hw_now_us(card) - t0) : budget_us - timeout_us;
+    }
+    else
+        card->stats.token_waits += polls;
+    stats_end(card);
+#else
+    (void) polls;
+#endif
+
+    return err;
+}
+
+
+
+
+
+
+
+
+
 
 /**
  * @brief 令卡进入空闲状态
+ * @note 最多发送 SD_SPI_INIT_CMD0_ATTEMPTS 次 CMD0，每次最多等待 SD_SPI_INIT_CMD0_RESP_BYTES 个字节的响应。
+ *       卡未响应（如仍在上电）或未进入空闲状态时，释放片选并提供时钟，退避等待后重发。
  * @param card              [in]  SD卡对象
  * @return enum sd_error    [out] 错误码
  */
 enum sd_error sd_card_into_idle(struct sd_card* card)
 {
     enum sd_error err = Sd_Err_OK;
-    uint8_t timeout = 0xff;
+    uint32_t interval = SD_SPI_INIT_POLL_MIN_US;
 
     /** 发送 CMD0 尝试进入空闲状态 **/
     if((err = sd_spi_hw_select_card(card)) != Sd_Err_OK)
         return err;       // 选择卡
 
-    while(timeout--)
+    for(uint32_t attempt = 1; ; attempt++)
     {
         /** 发送命令，等待响应 **/
         struct sd_resp_res resp = {0};
         struct sd_cmd_req req =
         {
-            .cmd = Sd_Cmd0_Idle, .arg = 0, .crc = 0x95,
-            .resp_type = Sd_Resp_Type_R1, .retry = 0xff,
+            .cmd = Sd_Cmd0_Idle, .arg = 0, .crc = SD_CMD_CRC_CMD0,
+            .resp_type = Sd_Resp_Type_R1, .retry = SD_SPI_INIT_CMD0_RESP_BYTES,
         };
-        if((err = sd_card_send_cmd_req(card, &req, &resp)) != Sd_Err_OK)
-            goto _FINISH_;
+        err = sd_card_send_cmd_req(card, &req, &resp);
 
-        /** 检查响应 **/
-        if(resp.buf[0] == SD_FR_IN_IDLE_STATE)
+        /** 检查响应，端口出错时不再重发 **/
+        if(err == Sd_Err_OK && resp.buf[0] == SD_FR_IN_IDLE_STATE)
         {
-            trace_i(card, "CMD0 idle success");
+            trace_i(card, "CMD0 idle success, attempt %d", attempt);
+            break;
+        }
+        if(err != Sd_Err_OK && err != Sd_Err_Timeout)
+            goto _FINISH_;
+        if(attempt >= SD_SPI_INIT_CMD0_ATTEMPTS)
+        {
+            trace_w(card, "CMD0 idle timeout");
+            err = Sd_Err_Timeout;
             break;
         }
-    }
 
-    if(timeout == 0)
-    {
-        trace_w(card, "CMD0 idle timeout");
-        err = Sd_Err_Timeout;
+        /** 释放片选并提供时钟，让卡结束正在进行的操作，退避等待后重发 **/
+        sd_spi_hw_deselect_card(card);
+        sd_spi_hw_send_dummy(card, 2);
+        interval = sd_card_init_backoff(card, interval);
+        if((err = sd_spi_hw_select_card(card)) != Sd_Err_OK)
+            return err;
     }
 
 _FINISH_:;
@@ -58,6 +134,57 @@ _FINISH_:;
     return err;
 }
 
+/**
+ * @brief 开始记录初始化的阶段耗时
+ * @param card              [in]  SD卡对象
+ */
+void sd_card_init_begin(struct sd_card* card)
+{
+    memset(&card->init_timing, 0, sizeof(card->init_timing));
+    card->init_timing.t_start = sd_spi_hw_now_us(card);
+    card->init_timing.t_mark = card->init_timing.t_start;
+}
+
+/**
+ * @brief 记录一个初始化阶段结束
+ * @param card              [in]  SD卡对象
+ * @param phase             [in]  结束的阶段
+ */
+void sd_card_init_mark(struct sd_card* card, enum sd_init_phase phase)
+{
+    struct sd_init_timing* t = &card->init_timing;
+    uint32_t now = sd_spi_hw_now_us(card);
+
+    t->phase_us[phase] = now - t->t_mark;
+    t->total_us = now - t->t_start;
+    t->t_mark = now;
+}
+
+/**
+ * @brief 获取初始化已经经过的时间
+ * @param card              [in]  SD卡对象
+ * @return uint32_t         [out] 经过的时间，单位：微秒；未实现 now_us() 时为累计的退避等待时间
+ */
+uint32_t sd_card_init_elapsed(struct sd_card* card)
+{
+    if(card->spi_if->now_us != NULL)
+        return sd_spi_hw_now_us(card) - card->init_timing.t_start;
+    return card->init_timing.waited_us;
+}
+
+/**
+ * @brief 初始化过程中的退避等待
+ * @param card              [in]  SD卡对象
+ * @param interval          [in]  本次等待的时间，单位：微秒
+ * @return uint32_t         [out] 下一次等待的时间：翻倍，不超过 SD_SPI_INIT_POLL_MAX_US
+ */
+uint32_t sd_card_init_backoff(struct sd_card* card, uint32_t interval)
+{
+    sd_spi_hw_udelay(card, interval);
+    card->init_timing.waited_us += interval;
+    return (interval < SD_SPI_INIT_POLL_MAX_US / 2) ? interval * 2 : SD_SPI_INIT_POLL_MAX_US;
+}
+
 /**
  * @brief 发送命令请求，并等待响应
  * @param card              [in]  SD卡对象
@@ -78,21 +205,45 @@ enum sd_error sd_card_send_cmd_req (struct sd_card* card, struct sd_cmd_req* req
         (uint8_t) (req->crc),
     };
 
-    /** 发送命令 **/
-    if((err = sd_spi_hw_write_bytes(card, cmd_buf, sizeof(cmd_buf))) != Sd_Err_OK)
+    /** 参数可变的命令查表计算CRC7，保证卡开启CRC校验（CMD59）后每条命令都能通过检查 **/
+    if(req->crc == SD_CMD_CRC_AUTO)
+        cmd_buf[5] = (uint8_t) ((sd_crc7(cmd_buf, 5) << 1) | 0x01);
+
+    /** 上一次写入推迟了编程忙等待，发送新命令前需要确认卡已退出忙状态 **/
+    if(card->is_busy_pending)
+    {
+        card->is_busy_pending = false;
+        if((err = sd_card_wait_ready(card, SD_SPI_WRITE_TIMEOUT_US)) != Sd_Err_OK)
+        {
+            trace_w(card, "Deferred write busy timeout before CMD%d", (req->cmd & ~0x40) & 0x3F);
+            return err;
+        }
+    }
+
+    /** 发送命令，并在同一次端口调用中读取响应窗口 **/
+    uint32_t t_lat = lat_begin(card);
+    if((err = sd_spi_hw_write_read(card, cmd_buf, sizeof(cmd_buf), SD_SPI_XFER_RESP_WINDOW)) != Sd_Err_OK)
         return err;
 
-    /** 等待响应 **/
+    /** CMD12 在多块读取过程中发出，紧随命令的第一个字节是无效的填充字节（stuff byte），需要丢弃 **/
+    if(req->cmd == Sd_Cmd12_Stop_Xfer)
+    {
+        uint8_t stuff;
+        if((err = sd_spi_hw_read_byte(card, &stuff)) != Sd_Err_OK)
+            return err;
+    }
+
+    /** 等待响应，最多查询 retry 个字节 **/
     {
         uint8_t byte = 0xff;
-        do
-        {
-            if((err = sd_spi_hw_read_bytes(card, &byte, 1))!= Sd_Err_OK)
-                return err;
-        } while (byte == 0xff && --req->retry);
+        uint32_t scanned = 0;
+        if((err = sd_spi_hw_scan(card, false, req->retry, &byte, &scanned)) != Sd_Err_OK)
+            return err;
+        stats_add(card, cmds[req->cmd & 0x3F], 1);
+        stats_add(card, r1_retries, (scanned > 1) ? scanned - 1 : 0);
 
         /** 检查超时 **/
-        if(req->retry == 0)
+        if(byte == 0xff)
         {
             trace_w(card, "CMD%d response timeout", (req->cmd & ~0x40) & 0x3F);
             return Sd_Err_Timeout;
@@ -100,6 +251,7 @@ enum sd_error sd_card_send_cmd_req (struct sd_card* card, struct sd_cmd_req* req
 
         /** 存储刚获取的字节 **/
         resp->buf[resp->filled++] = byte;
+        lat_record(card, Sd_Lat_Cmd_Resp, t_lat);
     }
 
 
@@ -119,19 +271,22 @@ enum sd_error sd_card_send_cmd_req (struct sd_card* card, struct sd_cmd_req* req
             }
             
             // 等待数据令牌0xFE
-            uint8_t token;
-            uint8_t token_retry = 0xff;
-            do 
-            {
-                if((err = sd_spi_hw_read_bytes(card, &token, 1)) != Sd_Err_OK)
-                    return err;
-            } while(token != 0xFE && --token_retry);
+            uint8_t token = 0xff;
+            uint32_t scanned = 0;
+            if((err = sd_spi_hw_scan(card, false, 0xff, &token, &scanned)) != Sd_Err_OK)
+                return err;
+            stats_add(card, token_waits, scanned);
             
-            if(token_retry == 0) 
+            if(token == 0xff) 
             {
                 trace_w(card, "Data token timeout for CMD%d", (req->cmd & ~0x40) & 0x3F);
                 return Sd_Err_Timeout;
             }
+            if(token != 0xFE)
+            {
+                trace_e(card, "CMD%d data error token: 0x%02X", (req->cmd & ~0x40) & 0x3F, token);
+                return Sd_Err_Response;
+            }
             
             // 读取数据块 (16字节)
             resp->filled = 0;
@@ -140,10 +295,17 @@ enum sd_error sd_card_send_cmd_req (struct sd_card* card, struct sd_cmd_req* req
             else
                 resp->filled += 16;
             
-            // 丢弃2字节CRC
+            // 读取2字节CRC，开启CRC校验时比对，否则丢弃
             uint8_t crc[2];
             if((err = sd_spi_hw_read_bytes(card, crc, sizeof(crc))) != Sd_Err_OK)
                 return err;
+#if (SD_SPI_CRC_ENABLE == 1)
+            if((((uint16_t) crc[0] << 8) | crc[1]) != sd_crc16(0, resp->buf, 16))
+            {
+                trace_w(card, "CMD%d data CRC mismatch", (req->cmd & ~0x40) & 0x3F);
+                return Sd_Err_Crc;
+            }
+#endif
         } break;
 
     case Sd_Resp_Type_R3:
@@ -157,20 +319,107 @@ enum sd_error sd_card_send_cmd_req (struct sd_card* card, struct sd_cmd_req* req
 
     case Sd_Resp_Type_R1b:
         {
-            uint8_t busy = 0x00;
-            do
+            // 等待卡退出忙状态，擦除命令的忙时间远长于其他命令
+            uint32_t timeout_us = (req->cmd == Sd_Cmd38_Erase) ? SD_SPI_ERASE_TIMEOUT_US : SD_SPI_BUSY_TIMEOUT_US;
+            uint8_t byte = 0x00;
+            if((err = _wait_bus(card, true, &byte, timeout_us)) != Sd_Err_OK)
             {
-                if((err = sd_spi_hw_read_bytes(card, &busy, 1)) != Sd_Err_OK)
-                    return err;
-                else
-                    sd_spi_hw_udelay(card, 5000);
-            } while (busy != 0xff);     // 等待卡退出忙状态
+                trace_w(card, "CMD%d busy timeout", (req->cmd & ~0x40) & 0x3F);
+                return err;
+            }
         } break;
     }
 
     return Sd_Err_OK;
 }
 
+/**
+ * @brief 等待卡退出忙状态（卡输出 0xFF）
+ * @note 先连续查询 SD_SPI_POLL_FAST_COUNT 个字节，以便快速捕获短暂的忙状态，之后每隔 SD_SPI_POLL_INTERVAL_US 查询一次。
+ *       用于等待写入编程完成，耗时记入写入忙的延迟直方图（R1b 命令的忙等待不经过本函数）。
+ * @param card              [in]  SD卡对象
+ * @param timeout_us        [in]  超时时间，单位：微秒
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_card_wait_ready (struct sd_card* card, uint32_t timeout_us)
+{
+    enum sd_error err = Sd_Err_OK;
+    uint32_t t_lat = lat_begin(card);
+    uint8_t byte = 0x00;
+
+    if((err = _wait_bus(card, true, &byte, timeout_us)) == Sd_Err_OK)
+        lat_record(card, Sd_Lat_Write_Busy, t_lat);
+    return err;
+}
+
+/**
+ * @brief 等待数据令牌（卡输出非 0xFF 的字节）
+ * @note 轮询方式与 sd_card_wait_ready() 相同。返回的令牌可能是数据起始令牌 0xFE，也可能是错误令牌，由调用者判断。
+ * @param card              [in]  SD卡对象
+ * @param token             [out] 接收到的令牌
+ * @param timeout_us        [in]  超时时间，单位：微秒
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_card_wait_token (struct sd_card* card, uint8_t* token, uint32_t timeout_us)
+{
+    enum sd_error err = Sd_Err_OK;
+    uint32_t t_lat = lat_begin(card);
+
+    *token = 0xFF;
+    if((err = _wait_bus(card, false, token, timeout_us)) == Sd_Err_OK)
+        lat_record(card, Sd_Lat_Token_Wait, t_lat);
+    return err;
+}
+
+/**
+ * @brief 获取相邻两个块之间的命令地址步长
+ * @param card              [in]  SD卡对象
+ * @return uint32_t         [out] SDHC/SDXC 使用块地址，步长为 1；SDSC 使用字节地址，步长为块大小
+ */
+uint32_t sd_card_lba_step (struct sd_card* card)
+{
+    if (card->info.type == Sd_Type_SDHC || card->info.type == Sd_Type_SDXC)
+        return 1;
+    return card->info.block_size;
+}
+
+/**
+ * @brief 在数据段游标与连续缓冲区之间拷贝数据
+ * @param cur               [in]  数据段游标，拷贝后前移 len 字节
+ * @param buf               [in]  连续缓冲区，为 NULL 时仅移动游标
+ * @param len               [in]  拷贝长度（字节）
+ * @param to_iov            [in]  true：从 buf 拷贝到数据段；false：从数据段拷贝到 buf
+ */
+void sd_iov_copy (struct sd_iov_cursor* cur, void* buf, uint32_t len, bool to_iov)
+{
+    while(len != 0)
+    {
+        const struct sd_iovec* seg = &cur->iov[cur->idx];
+        uint32_t n = seg->len - cur->off;
+
+        if(n > len)
+            n = len;
+        if(n != 0 && buf != NULL)
+        {
+            uint8_t* ptr = (uint8_t*) seg->buf + cur->off;
+            if(to_iov)
+                memcpy(ptr, buf, n);
+            else
+                memcpy(buf, ptr, n);
+            buf = (uint8_t*) buf + n;
+        }
+        cur->off += n;
+        len -= n;
+
+        /** 当前数据段已用完，切换到下一个数据段 **/
+        if(cur->off == seg->len)
+        {
+            cur->idx++;
+            cur->off = 0;
+        }
+    }
+}
+
 /**
  * @brief 获取SD卡状态
  * @param card              [in]  SD卡对象
@@ -181,7 +430,7 @@ enum sd_error sd_card_get_status(struct sd_card *card, uint8_t *status)
 {
     struct sd_cmd_req req = 
     {
-        .cmd = Sd_Cmd13_Status, .arg = 0, .crc = 1,
+        .cmd = Sd_Cmd13_Status, .arg = 0, .crc = SD_CMD_CRC_CMD13,
         .resp_type = Sd_Resp_Type_R1, .retry = 0xff
     };
     
@@ -223,4 +472,9 @@ void sd_card_print_info (struct sd_card* card)
     trace_l(card, "  > Capacity: %d MB",            sd_card_get_capacity(card) >> 20);
     trace_l(card, "  > Block size: %d B",           sd_card_get_block_size(card));
     trace_l(card, "  > Erase sector size: %d KB",   sd_card_get_erase_size(card) >> 10);
+    if(card->init_timing.total_us != 0)
+        trace_l(card, "  > Init time: %d us",       card->init_timing.total_us);
+    trace_l(card, "  > Max clock: %d kHz%s",        card->info.max_hz / 1000, card->info.is_high_speed ? " (high speed)" : "");
+    if(card->clock.hz != 0)
+        trace_l(card, "  > SPI clock: %d kHz",      card->clock.hz / 1000);
 }
\ No newline at end of file
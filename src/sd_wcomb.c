@@ -0,0 +1,237 @@
+/**
+ * @file sd_wcomb.c
+ * @author SouthernSandbox (https://github.com/SouthernSandbox)
+ * @brief 写合并：收集块号连续的写入，合并为一次多块写入
+ * @version 0.1
+ * @date 2025-08-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+#include "sd_spi_driver.h"
+#include "sd_private.h"
+#include "string.h"
+
+#define SD_TRACE_FILE_ID    10          // 二进制追踪事件号中的源文件编号，各源文件不可重复
+
+#if (SD_SPI_WCOMB_ENABLE == 1)
+
+/**
+ * @brief 写合并状态
+ */
+struct wcomb
+{
+    struct sd_card*     card;           // 缓冲区中数据所属的卡
+    uint32_t            blk;            // 缓冲区中第一个块的块号
+    uint32_t            count;          // 缓冲区中的块数，0 表示缓冲区为空
+    uint32_t            opts;           // 缓冲区中数据的写入选项，选项不同的写入不合并
+    uint32_t            t_first;        // 最早进入缓冲区的数据的时间戳，单位：微秒
+};
+
+static uint8_t buffer[SD_SPI_WCOMB_MAX_BLOCKS * SD_SPI_WCOMB_BLOCK_SIZE];     // 写合并缓冲区
+static struct wcomb wc;                                                      // 写合并状态
+static struct sd_wcomb_stats stats;                                          // 统计信息
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 将缓冲区中的数据以一次多块写入写回卡
+ * @note 写入失败时未写入的块保留在缓冲区中，下一次写回时重试。
+ * @return enum sd_error    [out] 错误码
+ */
+static enum sd_error _flush(void)
+{
+    enum sd_error err = Sd_Err_OK;
+    struct sd_card* card = wc.card;
+    struct sd_iovec seg = {.buf = buffer, .len = wc.count * SD_SPI_WCOMB_BLOCK_SIZE};
+    struct sd_iov_cursor cur = {.iov = &seg, .idx = 0, .off = 0};
+    uint32_t done = 0;
+
+    if (wc.count == 0)
+        return Sd_Err_OK;
+
+    err = sd_card_rw_blocks_direct(card, wc.blk, wc.count, &cur, true, wc.opts);
+    done = (err == Sd_Err_OK) ? wc.count : card->xfer_blocks;
+    stats.flushes++;
+    trace_d(card, "write-combine flush: blk=%d, count=%d, err=%d", wc.blk, wc.count, err);
+
+#if (SD_SPI_RAHEAD_ENABLE == 1)
+    /** 预读可能在写回前读入了这些块的旧数据 **/
+    sd_rahead_invalidate(card, wc.blk, wc.count);
+#endif
+
+    if (done < wc.count)
+        memmove(buffer, &buffer[done * SD_SPI_WCOMB_BLOCK_SIZE], (wc.count - done) * SD_SPI_WCOMB_BLOCK_SIZE);
+    wc.blk += done;
+    wc.count -= done;
+
+    return err;
+}
+
+/**
+ * @brief 判断缓冲区中的数据是否已超时
+ * @return true     [out] 已超时
+ * @return false    [out] 未超时或未限制时间
+ */
+static bool _is_aged(void)
+{
+#if (SD_SPI_WCOMB_MAX_AGE_US != 0)
+    return wc.count != 0 && (uint32_t) (sd_spi_hw_now_us(wc.card) - wc.t_first) >= SD_SPI_WCOMB_MAX_AGE_US;
+#else
+    return false;
+#endif
+}
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 经过写合并缓冲区写入一段连续的块
+ * @note 与缓冲区中的数据块号连续且写入选项相同时追加到缓冲区，否则先写回缓冲区。缓冲区收集满后立即写回，
+ *       块数不小于 SD_SPI_WCOMB_MAX_BLOCKS 或超出卡容量的写入直接写卡。写回时才会发生的错误由之后的读写或 sd_card_sync() 返回。
+ *       执行后 card->xfer_blocks 为已完成（含已进入缓冲区）的块数。
+ * @param card              [in]  SD卡对象
+ * @param blk               [in]  起始块号
+ * @param count             [in]  块数量
+ * @param cur               [in]  数据段游标
+ * @param opts              [in]  写入选项，SD_WR_OPT_XXX 的按位组合
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_wcomb_write(struct sd_card *card, uint32_t blk, uint32_t count, struct sd_iov_cursor *cur, uint32_t opts)
+{
+    enum sd_error err = Sd_Err_OK;
+
+    if (card->info.block_size != SD_SPI_WCOMB_BLOCK_SIZE)
+        return sd_card_rw_blocks_direct(card, blk, count, cur, true, opts);
+
+    /** 1. 无法与缓冲区中的数据合并时先写回缓冲区 **/
+    if (wc.count != 0)
+    {
+        bool flush = true;
+        if (wc.card != card || blk != wc.blk + wc.count || opts != wc.opts)
+            stats.flush_gap++;
+        else if (wc.count + count > SD_SPI_WCOMB_MAX_BLOCKS)
+            stats.flush_full++;
+        else if (_is_aged())
+            stats.flush_age++;
+        else
+            flush = false;
+
+        if (flush && (err = _flush()) != Sd_Err_OK)
+        {
+            card->xfer_blocks = 0;
+            return err;
+        }
+    }
+
+    /** 2. 超过缓冲区大小或超出卡容量的写入直接写卡，错误立即返回 **/
+    if (count >= SD_SPI_WCOMB_MAX_BLOCKS || (uint64_t) blk + count > card->info.block_count)
+        return sd_card_rw_blocks_direct(card, blk, count, cur, true, opts);
+
+    /** 3. 追加到缓冲区 **/
+    if (wc.count == 0)
+    {
+        wc.card = card;
+        wc.blk = blk;
+        wc.opts = opts;
+        wc.t_first = sd_spi_hw_now_us(card);
+    }
+    sd_iov_copy(cur, &buffer[wc.count * SD_SPI_WCOMB_BLOCK_SIZE], count * SD_SPI_WCOMB_BLOCK_SIZE, false);
+    wc.count += count;
+    stats.writes++;
+    stats.blocks += count;
+
+    /** 4. 缓冲区已满时立即写回 **/
+    if (wc.count == SD_SPI_WCOMB_MAX_BLOCKS)
+    {
+        stats.flush_full++;
+        err = _flush();
+    }
+
+    card->xfer_blocks = (err == Sd_Err_OK) ? count : 0;
+    return err;
+}
+
+/**
+ * @brief 写回或丢弃缓冲区中属于指定卡的数据
+ * @param card              [in]  SD卡对象
+ * @param write_back        [in]  true：写回卡；false：直接丢弃（如卡已被更换）
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_wcomb_flush(struct sd_card *card, bool write_back)
+{
+    if (wc.card != card || wc.count == 0)
+        return Sd_Err_OK;
+
+    if (!write_back)
+    {
+        trace_w(card, "write-combine: %d blocks discarded", wc.count);
+        wc.count = 0;
+        return Sd_Err_OK;
+    }
+
+    stats.flush_sync++;
+    return _flush();
+}
+
+/**
+ * @brief 读取前检查写合并缓冲区
+ * @note 读取范围与缓冲区重叠，或缓冲区中的数据已超时时写回缓冲区，保证读取到最新的数据。
+ * @param card              [in]  SD卡对象
+ * @param blk               [in]  起始块号
+ * @param count             [in]  块数量
+ * @return enum sd_error    [out] 错误码
+ */
+enum sd_error sd_wcomb_flush_range(struct sd_card *card, uint32_t blk, uint32_t count)
+{
+    if (wc.card != card || wc.count == 0)
+        return Sd_Err_OK;
+
+    if ((uint64_t) blk < (uint64_t) wc.blk + wc.count && (uint64_t) wc.blk < (uint64_t) blk + count)
+        stats.flush_read++;
+    else if (_is_aged())
+        stats.flush_age++;
+    else
+        return Sd_Err_OK;
+
+    return _flush();
+}
+
+#endif  // SD_SPI_WCOMB_ENABLE
+
+/**
+ * @brief 获取写合并统计信息
+ * @note 写合并未开启时统计信息全部为 0。
+ * @param out       [out] 统计信息
+ */
+void sd_wcomb_get_stats(struct sd_wcomb_stats *out)
+{
+    if (out == NULL)
+        return;
+#if (SD_SPI_WCOMB_ENABLE == 1)
+    *out = stats;
+#else
+    memset(out, 0, sizeof(*out));
+#endif
+}
+
+/**
+ * @brief 清零写合并统计信息
+ */
+void sd_wcomb_reset_stats(void)
+{
+#if (SD_SPI_WCOMB_ENABLE == 1)
+    memset(&stats, 0, sizeof(stats));
+#endif
+}
\ No newline at end of file
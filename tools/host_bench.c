@@ -0,0 +1,595 @@
+/**
+ * @file host_bench.c
+ * @author SouthernSandbox (https://github.com/SouthernSandbox)
+ * @brief 主机端基准测试：在仿真卡上运行顺序/随机/混合/擦除负载，输出吞吐、IOPS、延迟百分位数与总线开销
+ * @version 0.1
+ * @date 2025-08-14
+ *
+ * @copyright Copyright (c) 2025
+ *
+ * @note 基于 port/host_sim_port.c 运行，所有时间均为仿真时间，同一配置下结果可复现，可用于比较不同版本、不同配置的性能。
+ *       编译（使用当前 inc/sd_config.h 的配置，需在其中注册 card0）：
+ *           gcc -std=gnu99 -O2 -Iinc -Iport src/sd_*.c port/host_sim_port.c tools/host_bench.c -o host_bench
+ *       运行：
+ *           ./host_bench                        所有端口能力，SDHC
+ *           ./host_bench -b dma -t sdxc         仅 DMA 端口，SDXC
+ *           ./host_bench -c 5000                每次端口调用的固定开销为 5 us（默认 2 us）
+ *           ./host_bench -o result.csv          同时输出 CSV
+ *           ./host_bench -a                     输出每种卡、每种端口能力下各公开接口单次调用的总线开销
+ *           ./host_bench -a -B tools/bus_budget.txt
+ *                                               与预算比较，任一开销超出预算时返回非 0
+ */
+#include "sd_spi_driver.h"
+#include "host_sim_port.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+#include "unistd.h"
+
+#define BENCH_MAX_REQ       (4 * 1024 * 1024)   // 最大请求长度（字节）
+#define BENCH_SEQ_SPAN      (16ULL << 20)       // 顺序负载覆盖的范围（字节）
+#define BENCH_RAND_SPAN     (256ULL << 20)      // 随机负载覆盖的范围（字节）
+
+/**
+ * @brief 负载类型
+ */
+enum bench_kind
+{
+    Bench_Seq_Read,         // 顺序读
+    Bench_Seq_Write,        // 顺序写
+    Bench_Seq_Write_Pre,    // 顺序写，带 SD_WR_OPT_PRE_ERASE（多块写入前发送 ACMD23），与同长度的顺序写对比
+    Bench_Rand_Read,        // 随机读
+    Bench_Rand_Write,       // 随机写
+    Bench_Mixed,            // 类 FatFs 的混合负载：读目录、读 FAT、追加数据、写 FAT、写目录
+    Bench_Erase,            // 擦除
+};
+
+/**
+ * @brief 负载定义
+ */
+struct bench_case
+{
+    const char*         name;       // 名称
+    enum bench_kind     kind;       // 类型
+    uint32_t            size;       // 请求长度（字节），擦除为擦除扇区数
+    uint32_t            ops;        // 操作次数
+    bool                single;     // 是否关闭多块传输，逐块使用 CMD17/CMD24，与同长度的多块传输对比
+};
+
+/**
+ * @brief 端口能力（传输后端）
+ */
+struct bench_backend
+{
+    const char*         name;       // 名称
+    uint32_t            bulk;       // SD_SIM_BULK_XXX 的按位组合
+};
+
+/**
+ * @brief 总线开销统计的接口调用
+ */
+enum bench_api
+{
+    Bench_Api_Init,         // sd_card_init()
+    Bench_Api_Read,         // sd_card_read()
+    Bench_Api_Write,        // sd_card_write()
+    Bench_Api_Erase,        // sd_card_erase_sector()
+};
+
+/**
+ * @brief 总线开销统计的调用定义
+ */
+struct bench_cost_case
+{
+    const char*         name;       // 名称，即预算文件中的接口列
+    enum bench_api      api;        // 接口
+    uint32_t            size;       // 读写长度（字节），擦除为擦除扇区数
+};
+
+/**
+ * @brief 一个负载的结果
+ */
+struct bench_result
+{
+    uint32_t            ops;        // 完成的操作次数
+    uint32_t            errors;     // 失败的操作次数
+    uint64_t            bytes;      // 接口层传输的数据量（字节）
+    uint64_t            time_us;    // 总耗时（仿真时间）
+    uint32_t            p50_us;     // 延迟 50 百分位数
+    uint32_t            p99_us;     // 延迟 99 百分位数
+    uint32_t            p999_us;    // 延迟 99.9 百分位数
+    uint32_t            max_us;     // 最大延迟
+    uint64_t            spi_bytes;  // 总线字节数
+    uint64_t            xfer_calls; // 端口传输接口调用次数
+};
+
+static const struct bench_case cases[] =
+{
+    {"seq_read",      Bench_Seq_Read,      512,       2000,  false},
+    {"seq_read",      Bench_Seq_Read,      4096,      1000,  false},
+    {"seq_read",      Bench_Seq_Read,      32768,     200,   false},
+    {"seq_read",      Bench_Seq_Read,      131072,    64,    false},
+    {"seq_rd_cmd17",  Bench_Seq_Read,      131072,    64,    true},
+    {"seq_write",     Bench_Seq_Write,     512,       2000,  false},
+    {"seq_write",     Bench_Seq_Write,     4096,      1000,  false},
+    {"seq_write",     Bench_Seq_Write,     32768,     200,   false},
+    {"seq_write",     Bench_Seq_Write,     65536,     64,    false},
+    {"seq_write_pre", Bench_Seq_Write_Pre, 65536,     64,    false},
+    {"seq_write",     Bench_Seq_Write,     131072,    64,    false},
+    {"seq_wr_cmd24",  Bench_Seq_Write,     131072,    64,    true},
+    {"seq_write",     Bench_Seq_Write,     262144,    32,    false},
+    {"seq_write_pre", Bench_Seq_Write_Pre, 262144,    32,    false},
+    {"seq_write",     Bench_Seq_Write,     1048576,   16,    false},
+    {"seq_write_pre", Bench_Seq_Write_Pre, 1048576,   16,    false},
+    {"seq_write",     Bench_Seq_Write,     4194304,   8,     false},
+    {"seq_write_pre", Bench_Seq_Write_Pre, 4194304,   8,     false},
+    {"rand_read",     Bench_Rand_Read,     4096,      1000,  false},
+    {"rand_write",    Bench_Rand_Write,    4096,      1000,  false},
+    {"mixed_fat",     Bench_Mixed,         4096,      500,   false},
+    {"erase",         Bench_Erase,         1,         32,    false},
+};
+
+static const struct bench_cost_case cost_cases[] =
+{
+    {"init",        Bench_Api_Init,     0},
+    {"read_512",    Bench_Api_Read,     512},
+    {"read_4k",     Bench_Api_Read,     4096},
+    {"write_512",   Bench_Api_Write,    512},
+    {"write_4k",    Bench_Api_Write,    4096},
+    {"erase_1",     Bench_Api_Erase,    1},
+};
+
+static const struct bench_backend backends[] =
+{
+    {"byte",    0},
+    {"fill",    SD_SIM_BULK_RX_FILL},
+    {"duplex",  SD_SIM_BULK_DUPLEX},
+    {"dma",     SD_SIM_BULK_RX_FILL | SD_SIM_BULK_DMA},
+};
+
+static const struct
+{
+    const char*         name;       // 名称
+    enum sd_type        type;       // 卡类型
+} types[] =
+{
+    {"v1",      Sd_Type_SDSC_V1},
+    {"v2",      Sd_Type_SDSC_V2},
+    {"sdhc",    Sd_Type_SDHC},
+    {"sdxc",    Sd_Type_SDXC},
+};
+
+static uint8_t buf[BENCH_MAX_REQ];
+static uint32_t rng = 1;
+
+
+
+
+
+
+
+
+
+/**
+ * @brief 伪随机数（xorshift32），保证每次运行的访问序列相同
+ * @return uint32_t [out] 随机数
+ */
+static uint32_t _rand(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+/**
+ * @brief 比较函数，用于延迟排序
+ */
+static int _cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief 计算已排序数组的百分位数
+ * @param lat       [in]  已排序的延迟
+ * @param n         [in]  个数
+ * @param permille  [in]  千分位
+ * @return uint32_t [out] 百分位数（最近秩法）
+ */
+static uint32_t _percentile(const uint32_t* lat, uint32_t n, uint32_t permille)
+{
+    if(n == 0)
+        return 0;
+    uint64_t rank = ((uint64_t) n * permille + 999) / 1000;
+    return lat[(rank == 0) ? 0 : rank - 1];
+}
+
+/**
+ * @brief 执行一次操作
+ * @param card          [in]  SD卡对象
+ * @param bc            [in]  负载定义
+ * @param i             [in]  操作序号
+ * @param bytes         [out] 本次操作传输的数据量
+ * @return enum sd_error [out] 错误码
+ */
+static enum sd_error _do_op(struct sd_card* card, const struct bench_case* bc, uint32_t i, uint64_t* bytes)
+{
+    enum sd_error err = Sd_Err_OK;
+    uint64_t addr = 0;
+
+    switch(bc->kind)
+    {
+    case Bench_Seq_Read:
+    case Bench_Seq_Write:
+    case Bench_Seq_Write_Pre:
+        addr = ((uint64_t) i * bc->size) % BENCH_SEQ_SPAN;
+        *bytes = bc->size;
+        if(bc->kind == Bench_Seq_Read)
+            return sd_card_read(card, addr, buf, bc->size);
+        if(bc->kind == Bench_Seq_Write_Pre)
+            return sd_card_write_ex(card, addr, buf, bc->size, SD_WR_OPT_PRE_ERASE);
+        return sd_card_write(card, addr, buf, bc->size);
+
+    case Bench_Rand_Read:
+    case Bench_Rand_Write:
+        addr = (_rand() % (uint32_t) (BENCH_RAND_SPAN / bc->size)) * (uint64_t) bc->size;
+        *bytes = bc->size;
+        if(bc->kind == Bench_Rand_Read)
+            return sd_card_read(card, addr, buf, bc->size);
+        return sd_card_write(card, addr, buf, bc->size);
+
+    case Bench_Mixed:
+        {
+            /** 分区布局：FAT 区 [1 MB, 2 MB)，目录区 [2 MB, 3 MB)，数据区 4 MB 开始，每追加一个簇更新一次 FAT 和目录项 **/
+            uint64_t fat = (1ULL << 20) + (uint64_t) (i / 128) * 512;
+            uint64_t dir = (2ULL << 20) + (uint64_t) (i % 16) * 512;
+            uint64_t data = (4ULL << 20) + (uint64_t) i * bc->size;
+
+            if((err = sd_card_read(card, dir, buf, 512)) != Sd_Err_OK ||
+               (err = sd_card_read(card, fat, buf, 512)) != Sd_Err_OK ||
+               (err = sd_card_write(card, data, buf, bc->size)) != Sd_Err_OK ||
+               (err = sd_card_write(card, fat, buf, 512)) != Sd_Err_OK ||
+               (err = sd_card_write(card, dir, buf, 512)) != Sd_Err_OK)
+                return err;
+            *bytes = bc->size + 4 * 512;
+            return Sd_Err_OK;
+        }
+
+    case Bench_Erase:
+        *bytes = sd_card_get_erase_size(card) * bc->size;
+        return sd_card_erase_sector(card, (8ULL << 20) + *bytes * i, bc->size);
+    }
+
+    return Sd_Err_Param;
+}
+
+/**
+ * @brief 运行一个负载
+ * @param card      [in]  SD卡对象
+ * @param bc        [in]  负载定义
+ * @param res       [out] 结果
+ */
+static void _run_case(struct sd_card* card, const struct bench_case* bc, struct bench_result* res)
+{
+    uint32_t* lat = calloc(bc->ops, sizeof(uint32_t));
+    struct sd_sim_stats s0, s1;
+    uint64_t t0;
+
+    memset(res, 0, sizeof(*res));
+    rng = 0x9E3779B9;
+    sd_card_set_multi_block(card, !bc->single);
+    sd_sim_get_stats(&s0);
+    t0 = sd_sim_now_us();
+
+    /** 1. 逐个执行操作并记录延迟，最后同步推迟的写入，计入总耗时 **/
+    for(uint32_t i = 0; i < bc->ops; i++)
+    {
+        uint64_t bytes = 0;
+        uint64_t t = sd_sim_now_us();
+        if(_do_op(card, bc, i, &bytes) != Sd_Err_OK)
+        {
+            res->errors++;
+            continue;
+        }
+        lat[res->ops++] = (uint32_t) (sd_sim_now_us() - t);
+        res->bytes += bytes;
+    }
+    if(sd_card_sync(card) != Sd_Err_OK)
+        res->errors++;
+    sd_card_set_multi_block(card, true);
+
+    /** 2. 统计 **/
+    sd_sim_get_stats(&s1);
+    res->time_us = sd_sim_now_us() - t0;
+    res->spi_bytes = s1.bytes - s0.bytes;
+    res->xfer_calls = s1.xfer_calls - s0.xfer_calls;
+
+    qsort(lat, res->ops, sizeof(uint32_t), _cmp_u32);
+    res->p50_us = _percentile(lat, res->ops, 500);
+    res->p99_us = _percentile(lat, res->ops, 990);
+    res->p999_us = _percentile(lat, res->ops, 999);
+    res->max_us = res->ops ? lat[res->ops - 1] : 0;
+    free(lat);
+}
+
+/**
+ * @brief 按卡类型和端口能力创建仿真卡
+ * @param type      [in]  卡类型
+ * @param be        [in]  端口能力
+ * @param call_ns   [in]  每次端口调用的固定开销（纳秒）
+ * @return int      [out] 成功返回 0
+ */
+static int _sim_setup(enum sd_type type, const struct bench_backend* be, uint32_t call_ns)
+{
+    struct sd_sim_config cfg;
+
+    sd_sim_config_default(&cfg, type);
+    cfg.bulk = be->bulk;
+    cfg.call_ns = call_ns;
+    cfg.dma_align = 4;
+    cfg.dma_min_len = 16;
+    cfg.dma_polls = 2;
+    cfg.gc_every = 512;
+    cfg.gc_us = 20000;
+    return sd_sim_setup(&cfg);
+}
+
+/**
+ * @brief 在一种端口能力下运行所有负载
+ * @param type      [in]  卡类型
+ * @param be        [in]  端口能力
+ * @param call_ns   [in]  每次端口调用的固定开销（纳秒）
+ * @param csv       [in]  CSV 输出文件，可为 NULL
+ * @return int      [out] 成功返回 0
+ */
+static int _run_backend(enum sd_type type, const struct bench_backend* be, uint32_t call_ns, FILE* csv)
+{
+    struct sd_card* card = sd_card_find("card0");
+
+    if(card == NULL || _sim_setup(type, be, call_ns) != 0 || sd_card_init(card) != Sd_Err_OK)
+    {
+        fprintf(stderr, "backend %s: card init failed\n", be->name);
+        return -1;
+    }
+
+    for(uint32_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const struct bench_case* bc = &cases[i];
+        struct bench_result res;
+        _run_case(card, bc, &res);
+
+        double secs = res.time_us ? res.time_us / 1e6 : 1e-6;
+        double mbps = res.bytes / secs / (1024.0 * 1024.0);
+        double iops = res.ops / secs;
+        char size[16];
+        if(bc->kind == Bench_Erase)
+            snprintf(size, sizeof(size), "%usec", bc->size);
+        else if(bc->size >= 1024)
+            snprintf(size, sizeof(size), "%uK", bc->size / 1024);
+        else
+            snprintf(size, sizeof(size), "%u", bc->size);
+
+        printf("%-7s %-13s %6s %6u %4u %9.3f %9.1f %8u %8u %8u %8u %12llu %9llu %6.3f %9llu\n",
+               be->name, bc->name, size, res.ops, res.errors, mbps, iops,
+               res.p50_us, res.p99_us, res.p999_us, res.max_us,
+               (unsigned long long) res.spi_bytes, (unsigned long long) res.xfer_calls,
+               res.bytes ? (double) res.spi_bytes / res.bytes : 0.0,
+               res.bytes ? (unsigned long long) (res.spi_bytes * 1048576 / res.bytes) : 0ULL);
+        if(csv != NULL)
+            fprintf(csv, "%s,%s,%s,%u,%u,%u,%llu,%llu,%.3f,%.1f,%u,%u,%u,%u,%llu,%llu\n",
+                    be->name, sd_get_capacity_class_name(type), bc->name, bc->size, res.ops, res.errors,
+                    (unsigned long long) res.bytes, (unsigned long long) res.time_us, mbps, iops,
+                    res.p50_us, res.p99_us, res.p999_us, res.max_us,
+                    (unsigned long long) res.spi_bytes, (unsigned long long) res.xfer_calls);
+    }
+
+    sd_card_deinit(card);
+    sd_sim_teardown();
+    return 0;
+}
+
+/**
+ * @brief 在预算文件中查找一项预算
+ * @note 预算文件每行为 "卡类型 端口能力 接口 调用次数 字节数 时钟数"，# 开头的行为注释。
+ * @param budget    [in]  预算文件，可为 NULL
+ * @param type      [in]  卡类型名称
+ * @param be        [in]  端口能力名称
+ * @param api       [in]  接口名称
+ * @param out       [out] 预算
+ * @return int      [out] 找到返回 0
+ */
+static int _find_budget(FILE* budget, const char* type, const char* be, const char* api, struct sd_bus_cost* out)
+{
+    char line[256], t[16], b[16], a[32];
+    unsigned long long clocks;
+    unsigned calls, bytes;
+
+    if(budget == NULL)
+        return -1;
+
+    rewind(budget);
+    while(fgets(line, sizeof(line), budget) != NULL)
+    {
+        if(line[0] == '#')
+            continue;
+        if(sscanf(line, "%15s %15s %31s %u %u %llu", t, b, a, &calls, &bytes, &clocks) != 6)
+            continue;
+        if(strcmp(t, type) == 0 && strcmp(b, be) == 0 && strcmp(a, api) == 0)
+        {
+            out->calls = calls;
+            out->bytes = bytes;
+            out->clocks = clocks;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 统计一种卡、一种端口能力下各公开接口单次调用的总线开销，并与预算比较
+ * @note 输出格式与预算文件相同，不带预算文件运行时的输出可直接作为新的预算。
+ *       调用次数、字节数任一超出预算即判为退化；低于预算时提示更新预算文件。
+ * @param ti        [in]  卡类型下标
+ * @param be        [in]  端口能力
+ * @param call_ns   [in]  每次端口调用的固定开销（纳秒），影响轮询忙状态的次数
+ * @param budget    [in]  预算文件，可为 NULL
+ * @return int      [out] 无退化返回 0
+ */
+static int _run_cost(uint32_t ti, const struct bench_backend* be, uint32_t call_ns, FILE* budget)
+{
+    struct sd_card* card = sd_card_find("card0");
+    int ret = 0;
+
+    if(card == NULL || _sim_setup(types[ti].type, be, call_ns) != 0)
+    {
+        fprintf(stderr, "%s %s: simulator setup failed\n", types[ti].name, be->name);
+        return -1;
+    }
+
+    for(uint32_t i = 0; i < sizeof(cost_cases) / sizeof(cost_cases[0]); i++)
+    {
+        const struct bench_cost_case* cc = &cost_cases[i];
+        struct sd_bus_cost cost, limit;
+        enum sd_error err = Sd_Err_OK;
+
+        /** 1. 单次调用，前后读取总线开销；写入后先同步再读取，缓存、写合并或推迟的忙等待写回卡的开销计入本次写入 **/
+        sd_card_reset_bus_cost(card);
+        switch(cc->api)
+        {
+        case Bench_Api_Init:    err = sd_card_init(card); break;
+        case Bench_Api_Read:    err = sd_card_read(card, 1ULL << 20, buf, cc->size); break;
+        case Bench_Api_Write:   err = sd_card_write(card, 1ULL << 20, buf, cc->size); break;
+        case Bench_Api_Erase:   err = sd_card_erase_sector(card, 8ULL << 20, cc->size); break;
+        }
+        if(cc->api == Bench_Api_Write && err == Sd_Err_OK)
+            err = sd_card_sync(card);
+        sd_card_get_bus_cost(card, &cost);
+        if(err != Sd_Err_OK)
+        {
+            printf("# %s %s %s: error %d\n", types[ti].name, be->name, cc->name, err);
+            ret = 1;
+            continue;
+        }
+
+        /** 2. 与预算比较 **/
+        printf("%-5s %-7s %-10s %6u %8u %9llu", types[ti].name, be->name, cc->name,
+               cost.calls, cost.bytes, (unsigned long long) cost.clocks);
+        if(budget == NULL)
+            printf("\n");
+        else if(_find_budget(budget, types[ti].name, be->name, cc->name, &limit) != 0)
+        {
+            printf("   NO BUDGET\n");
+            ret = 1;
+        }
+        else if(cost.calls > limit.calls || cost.bytes > limit.bytes)
+        {
+            printf("   OVER BUDGET (calls %u, bytes %u)\n", limit.calls, limit.bytes);
+            ret = 1;
+        }
+        else if(cost.calls < limit.calls || cost.bytes < limit.bytes)
+            printf("   under budget (calls %u, bytes %u), update the budget file\n", limit.calls, limit.bytes);
+        else
+            printf("\n");
+    }
+
+    sd_card_deinit(card);
+    sd_sim_teardown();
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    enum sd_type type = Sd_Type_SDHC;
+    const char* backend = "all";
+    const char* csv_path = NULL;
+    const char* budget_path = NULL;
+    bool cost_mode = false;
+    uint32_t call_ns = 2000;
+    FILE* csv = NULL;
+    int opt, ret = 0;
+
+    while((opt = getopt(argc, argv, "t:b:c:o:aB:h")) != -1)
+    {
+        switch(opt)
+        {
+        case 't':
+            if(strcmp(optarg, "v1") == 0)          type = Sd_Type_SDSC_V1;
+            else if(strcmp(optarg, "v2") == 0)     type = Sd_Type_SDSC_V2;
+            else if(strcmp(optarg, "sdhc") == 0)   type = Sd_Type_SDHC;
+            else if(strcmp(optarg, "sdxc") == 0)   type = Sd_Type_SDXC;
+            else { fprintf(stderr, "unknown card type: %s\n", optarg); return 2; }
+            break;
+        case 'b': backend = optarg; break;
+        case 'c': call_ns = (uint32_t) strtoul(optarg, NULL, 0); break;
+        case 'o': csv_path = optarg; break;
+        case 'a': cost_mode = true; break;
+        case 'B': budget_path = optarg; cost_mode = true; break;
+        default:
+            fprintf(stderr, "usage: %s [-t v1|v2|sdhc|sdxc] [-b all|byte|fill|duplex|dma] [-c call_ns] [-o out.csv]\n"
+                            "       %s -a [-b all|byte|fill|duplex|dma] [-c call_ns] [-B budget.txt]\n", argv[0], argv[0]);
+            return 2;
+        }
+    }
+
+    /** 总线开销模式：遍历所有卡类型 **/
+    if(cost_mode)
+    {
+        FILE* budget = NULL;
+        if(budget_path != NULL && (budget = fopen(budget_path, "r")) == NULL)
+        {
+            perror(budget_path);
+            return 2;
+        }
+
+        sd_trace_set_level(SD_SPI_TRACE_LEVEL_ERROR);
+        sd_spi_lib_init();
+        printf("# card backend  api         calls    bytes    clocks\n");
+        for(uint32_t t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+        {
+            for(uint32_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+            {
+                if(strcmp(backend, "all") != 0 && strcmp(backend, backends[i].name) != 0)
+                    continue;
+                if(_run_cost(t, &backends[i], call_ns, budget) != 0)
+                    ret = 1;
+            }
+        }
+        if(budget != NULL)
+        {
+            fclose(budget);
+            printf(ret ? "# bus cost regression\n" : "# bus cost within budget\n");
+        }
+        return ret;
+    }
+
+    if(csv_path != NULL)
+    {
+        if((csv = fopen(csv_path, "w")) == NULL)
+        {
+            perror(csv_path);
+            return 2;
+        }
+        fprintf(csv, "backend,card,workload,size,ops,errors,bytes,time_us,mb_s,iops,p50_us,p99_us,p999_us,max_us,spi_bytes,xfer_calls\n");
+    }
+
+    sd_trace_set_level(SD_SPI_TRACE_LEVEL_ERROR);
+    sd_spi_lib_init();
+
+    printf("%-7s %-13s %6s %6s %4s %9s %9s %8s %8s %8s %8s %12s %9s %6s %9s\n",
+           "backend", "workload", "size", "ops", "err", "MB/s", "IOPS",
+           "p50us", "p99us", "p999us", "maxus", "spi_bytes", "calls", "wire", "spiB/MB");
+
+    for(uint32_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++)
+    {
+        if(strcmp(backend, "all") != 0 && strcmp(backend, backends[i].name) != 0)
+            continue;
+        if(_run_backend(type, &backends[i], call_ns, csv) != 0)
+            ret = 1;
+    }
+
+    if(csv != NULL)
+        fclose(csv);
+    return ret;
+}
@@ -0,0 +1,315 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+@file sd_capture_decode.py
+@brief 总线抓取日志解码工具（SD_SPI_CAPTURE_ENABLE）
+
+sd_capture_read() 读出的日志由 struct sd_capture_rec（小端字节序，每条 20 字节）及其后的发送/接收数据组成，
+本工具按 SPI 模式的协议还原命令级的时间线：每条命令的参数、R1 及其等待字节数、附加响应（R2/R3/R7）、
+读数据令牌的等待时间、写数据响应以及卡的忙状态持续时间，并按命令汇总耗时，便于离线分析现场的延迟尖峰。
+
+抓取时每次调用最多记录 SD_SPI_CAPTURE_MAX_PAYLOAD 字节，数据块中未记录的部分按长度跳过，不影响命令、响应和令牌的解析。
+
+用法：
+    python3 tools/sd_capture_decode.py capture.bin
+    python3 tools/sd_capture_decode.py --stall 5000 capture.bin     标记总耗时不小于 5 ms 的命令
+    python3 tools/sd_capture_decode.py -v capture.bin               同时输出片选、速率等控制操作
+"""
+import argparse
+import struct
+import sys
+
+REC = struct.Struct('<IIIHBBbBH')
+
+CONTROL, TRANSFER, RX_FILL, DUPLEX, XFER_START, XFER_DONE = range(6)
+F_TX, F_RX, F_GAP = 0x01, 0x02, 0x04
+CTRL_NAMES = ['init hardware', 'deinit hardware', 'is card detached', 'CS low', 'CS high',
+              'take bus', 'release bus', 'low speed', 'high speed']
+
+UNKNOWN = -1            # 未记录的字节
+
+CMD_NAMES = {0: 'GO_IDLE_STATE', 6: 'SWITCH_FUNC', 8: 'SEND_IF_COND', 9: 'SEND_CSD', 10: 'SEND_CID',
+             12: 'STOP_TRANSMISSION', 13: 'SEND_STATUS', 16: 'SET_BLOCKLEN', 17: 'READ_SINGLE_BLOCK',
+             18: 'READ_MULTIPLE_BLOCK', 24: 'WRITE_BLOCK', 25: 'WRITE_MULTIPLE_BLOCK', 32: 'ERASE_WR_BLK_START',
+             33: 'ERASE_WR_BLK_END', 38: 'ERASE', 55: 'APP_CMD', 58: 'READ_OCR', 59: 'CRC_ON_OFF'}
+ACMD_NAMES = {13: 'SD_STATUS', 22: 'SEND_NUM_WR_BLOCKS', 23: 'SET_WR_BLK_ERASE_COUNT', 41: 'SD_SEND_OP_COND',
+              51: 'SEND_SCR'}
+
+READ_LEN = {6: 64, 9: 16, 10: 16, 17: 512, 18: 512}          # 带数据块的命令及其数据长度
+ACMD_READ_LEN = {13: 64, 22: 4, 51: 8}
+EXTRA_LEN = {8: 4, 58: 4, 13: 1}                             # R7/R3/R2 在 R1 之后的字节数
+BUSY_CMDS = (12, 28, 29, 38)                                 # R1b 命令
+
+
+def parse_records(data):
+    """将日志拆分为记录：(记录头字段, 发送数据, 接收数据)"""
+    off = 0
+    while off + REC.size <= len(data):
+        ts, tx_len, rx_len, limit, typ, flags, ret, ctrl, dur = REC.unpack_from(data, off)
+        off += REC.size
+        ntx = min(tx_len, limit) if limit else tx_len
+        nrx = min(rx_len, limit) if limit else rx_len
+        tx = rx = None
+        if flags & F_TX:
+            tx = data[off:off + ntx]
+            off += ntx
+        if flags & F_RX:
+            rx = data[off:off + nrx]
+            off += nrx
+        if off > len(data):
+            print('-- truncated log --')
+            return
+        yield dict(ts=ts, end=(ts + dur) & 0xFFFFFFFF, tx_len=tx_len, rx_len=rx_len, type=typ, flags=flags,
+                   ret=ret, ctrl=ctrl, tx=tx, rx=rx)
+
+
+def expand(data, length, default):
+    """将记录的数据展开为逐字节的列表，未记录的部分为 UNKNOWN"""
+    if data is None:
+        return [default] * length
+    return list(data) + [UNKNOWN] * (length - len(data))
+
+
+def byte_events(records, on_control):
+    """将记录转换为逐字节的总线事件 (调用开始时间, 调用结束时间, MOSI, MISO)"""
+    pending = None
+    for rec in records:
+        if rec['flags'] & F_GAP:
+            yield None                  # 有记录丢失
+        ts, end, typ = rec['ts'], rec['end'], rec['type']
+        if typ == CONTROL:
+            on_control(rec)
+        elif typ == TRANSFER:
+            for mo in expand(rec['tx'], rec['tx_len'], 0xFF):
+                yield ts, end, mo, UNKNOWN
+            for mi in expand(rec['rx'], rec['rx_len'], UNKNOWN):
+                yield ts, end, 0xFF, mi
+        elif typ == RX_FILL:
+            for mi in expand(rec['rx'], rec['rx_len'], UNKNOWN):
+                yield ts, end, 0xFF, mi
+        elif typ == DUPLEX:
+            mosi = expand(rec['tx'], rec['tx_len'], 0xFF)
+            miso = expand(rec['rx'], rec['tx_len'], UNKNOWN)
+            for mo, mi in zip(mosi, miso):
+                yield ts, end, mo, mi
+        elif typ == XFER_START:
+            pending = rec
+        elif typ == XFER_DONE and pending is not None:
+            mosi = expand(pending['tx'], pending['tx_len'], 0xFF)
+            miso = expand(rec['rx'], pending['tx_len'], UNKNOWN)
+            for mo, mi in zip(mosi, miso):
+                yield pending['ts'], end, mo, mi
+            pending = None
+
+
+def elapsed(t1, t0):
+    """计算时间差（允许时间戳回绕）"""
+    return (t1 - t0) & 0xFFFFFFFF
+
+
+class Decoder:
+    """按 SPI 模式协议逐字节解析命令、响应、令牌和忙状态"""
+
+    def __init__(self, stall_us, verbose):
+        self.stall_us = stall_us
+        self.verbose = verbose
+        self.op = None
+        self.state = 'idle'
+        self.frame = []
+        self.app = False
+        self.summary = {}
+
+    # ---- 输出 ----
+
+    def control(self, rec):
+        if self.verbose:
+            name = CTRL_NAMES[rec['ctrl']] if rec['ctrl'] < len(CTRL_NAMES) else 'ctrl %d' % rec['ctrl']
+            print('%12.6f  -- %s%s' % (rec['ts'] / 1e6, name, '' if rec['ret'] == 0 else ' (ret %d)' % rec['ret']))
+
+    def finish(self, note=None):
+        op = self.op
+        if op is None:
+            return
+        self.op = None
+        self.state = 'idle'
+        if note:
+            op['notes'].append(note)
+
+        total = elapsed(op['end'], op['ts'])
+        parts = ['%-24s arg=0x%08x' % (op['name'], op['arg'])]
+        if op['r1'] is None:
+            parts.append('no R1')
+        else:
+            parts.append('R1=0x%02x ncr=%d %d us' % (op['r1'], op['ncr'], op['r1_us']))
+        if op['extra']:
+            parts.append('resp=' + ''.join('%02x' % b if b >= 0 else '??' for b in op['extra']))
+        if op['blocks']:
+            parts.append('blocks=%d' % op['blocks'])
+        if op['token_us']:
+            parts.append('token max %d us' % max(op['token_us']))
+        if op['busy_us']:
+            parts.append('busy %d us' % sum(op['busy_us']) +
+                         (' (max %d)' % max(op['busy_us']) if len(op['busy_us']) > 1 else ''))
+        parts += op['notes']
+        line = '%12.6f  %s  total %d us' % (op['ts'] / 1e6, ', '.join(parts), total)
+        if self.stall_us and total >= self.stall_us:
+            line += '  <== STALL'
+        print(line)
+
+        s = self.summary.setdefault(op['name'], [0, 0, 0])
+        s[0] += 1
+        s[1] += total
+        s[2] = max(s[2], total)
+
+    def gap(self):
+        self.finish('(log gap)')
+        print('-- records lost --')
+        self.state = 'idle'
+        self.frame = []
+
+    # ---- 解析 ----
+
+    def start_cmd(self, ts):
+        cmd = self.frame[0] & 0x3F
+        arg = 0
+        for b in self.frame[1:5]:
+            arg = (arg << 8) | (b if b >= 0 else 0)
+        app = self.app and cmd != 55
+        self.app = (cmd == 55)
+        name = ('ACMD%d' % cmd) if app else ('CMD%d' % cmd)
+        label = (ACMD_NAMES if app else CMD_NAMES).get(cmd)
+        self.op = dict(ts=ts, end=ts, cmd=cmd, app=app, arg=arg, name=name + ('(%s)' % label if label else ''),
+                       r1=None, ncr=0, extra=[], blocks=0, token_us=[], busy_us=[], notes=[], mark=ts, stopped=False)
+        self.state = 'r1'
+        self.skip = 1 if cmd == 12 else 0          # CMD12 之后的第一个字节为填充字节
+
+    def after_r1(self, ts):
+        op = self.op
+        cmd, r1 = op['cmd'], op['r1']
+        if r1 & 0x7E:
+            self.finish()
+            return
+        op['mark'] = ts
+        if not op['app'] and cmd in EXTRA_LEN:
+            self.need = EXTRA_LEN[cmd]
+            self.state = 'extra'
+        elif not op['app'] and cmd in BUSY_CMDS:
+            self.state = 'busy'
+            self.skip = 0
+        elif (op['app'] and cmd in ACMD_READ_LEN) or (not op['app'] and cmd in READ_LEN):
+            self.blen = ACMD_READ_LEN[cmd] if op['app'] else READ_LEN[cmd]
+            self.state = 'token'
+        elif not op['app'] and cmd in (24, 25):
+            self.state = 'wtoken'
+        else:
+            self.finish()
+
+    def feed(self, start, ts, mo, mi):
+        """处理一个字节：start 为所在调用的开始时间，用作命令的开始时间；ts 为调用的结束时间，用作响应、令牌等的到达时间"""
+        # 命令帧的开始（写数据阶段的 MOSI 为数据，不作判断）
+        if self.state not in ('frame', 'wdata') and mo >= 0 and (mo & 0xC0) == 0x40:
+            self.finish()
+            self.frame = [mo]
+            self.frame_ts = start
+            self.state = 'frame'
+            return
+        if self.op is not None:
+            self.op['end'] = ts
+
+        st = self.state
+        if st == 'frame':
+            self.frame.append(mo)
+            if len(self.frame) == 6:
+                self.start_cmd(self.frame_ts)
+        elif st == 'r1':
+            if self.skip:
+                self.skip -= 1
+            elif mi < 0 or mi & 0x80:
+                self.op['ncr'] += 1
+                if self.op['ncr'] > 64:
+                    self.finish()
+            else:
+                self.op['r1'] = mi
+                self.op['r1_us'] = elapsed(ts, self.op['ts'])
+                self.after_r1(ts)
+        elif st == 'extra':
+            self.op['extra'].append(mi)
+            self.need -= 1
+            if self.need == 0:
+                self.finish()
+        elif st == 'token':
+            if mi == 0xFE:
+                self.op['token_us'].append(elapsed(ts, self.op['mark']))
+                self.need = self.blen + 2
+                self.state = 'rdata'
+            elif 0 <= mi < 0x10 and mi != 0:
+                self.finish('data error token 0x%02x' % mi)
+        elif st == 'rdata':
+            self.need -= 1
+            if self.need == 0:
+                self.op['blocks'] += 1
+                self.op['mark'] = ts
+                if self.op['cmd'] == 18 and not self.op['app']:
+                    self.state = 'token'
+                else:
+                    self.finish()
+        elif st == 'wtoken':
+            if mo in (0xFE, 0xFC):
+                self.need = 512 + 2
+                self.state = 'wdata'
+            elif mo == 0xFD:
+                self.op['stopped'] = True
+                self.skip = 1
+                self.op['mark'] = ts
+                self.state = 'busy'
+        elif st == 'wdata':
+            self.need -= 1
+            if self.need == 0:
+                self.state = 'dresp'
+        elif st == 'dresp':
+            if mi >= 0 and (mi & 0x11) == 0x01:
+                status = (mi >> 1) & 0x07
+                self.op['blocks'] += 1
+                if status != 0x02:
+                    self.finish('data response 0x%02x' % mi)
+                    return
+                self.op['mark'] = ts
+                self.skip = 0
+                self.state = 'busy'
+        elif st == 'busy':
+            if self.skip:
+                self.skip -= 1
+            elif mi == 0xFF:
+                self.op['busy_us'].append(elapsed(ts, self.op['mark']))
+                if self.op['cmd'] == 25 and not self.op['app'] and not self.op['stopped']:
+                    self.state = 'wtoken'
+                else:
+                    self.finish()
+
+    def print_summary(self):
+        print()
+        print('%-32s %8s %12s %12s' % ('command', 'count', 'avg us', 'max us'))
+        for name, (count, total, worst) in sorted(self.summary.items(), key=lambda kv: -kv[1][1]):
+            print('%-32s %8d %12d %12d' % (name, count, total // count, worst))
+
+
+def main():
+    ap = argparse.ArgumentParser(description='decode an SD SPI bus capture into a command timeline')
+    ap.add_argument('input', help='file holding the bytes returned by sd_capture_read() ("-" for stdin)')
+    ap.add_argument('--stall', type=int, default=0, help='mark commands taking at least this many microseconds')
+    ap.add_argument('-v', '--verbose', action='store_true', help='also show control() calls (CS, speed, bus)')
+    opts = ap.parse_args()
+
+    data = sys.stdin.buffer.read() if opts.input == '-' else open(opts.input, 'rb').read()
+    dec = Decoder(opts.stall, opts.verbose)
+    for ev in byte_events(parse_records(data), dec.control):
+        if ev is None:
+            dec.gap()
+        else:
+            dec.feed(*ev)
+    dec.finish('(end of log)')
+    dec.print_summary()
+
+
+if __name__ == '__main__':
+    main()
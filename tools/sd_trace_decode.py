@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+@file sd_trace_decode.py
+@brief 二进制追踪记录解码工具（SD_SPI_TRACE_MODE_BINARY）
+
+固件只记录 {时间戳, 事件号, 至多 4 个整数参数}，格式字符串保留在源码中。本工具扫描 src/*.c，
+按每个源文件的 SD_TRACE_FILE_ID 和 trace_x() 调用所在的行号还原事件号对应的等级和格式字符串，
+再将 sd_trace_read() 读出的记录（struct sd_trace_entry 数组，小端字节序，每条 28 字节）格式化输出。
+
+注意：事件号中包含行号，解码时使用的源码必须与固件编译时的源码一致。
+
+用法：
+    python3 tools/sd_trace_decode.py trace.bin
+    python3 tools/sd_trace_decode.py --src path/to/src --level 3 trace.bin
+"""
+import argparse
+import os
+import re
+import struct
+import sys
+
+ENTRY = struct.Struct('<IIHBB4I')
+LEVELS = {1: 'L', 2: 'E', 3: 'W', 4: 'I', 5: 'D'}
+MACRO_LEVELS = {'l': 1, 'e': 2, 'w': 3, 'i': 4, 'd': 5}
+
+RE_FILE_ID = re.compile(r'^#define\s+SD_TRACE_FILE_ID\s+(\d+)', re.M)
+RE_CALL = re.compile(r'\btrace_([ewid])\s*\(\s*\w+\s*,\s*((?:"(?:[^"\\]|\\.)*"\s*)+)', re.S)
+RE_SPEC = re.compile(r'%([-+ #0]*)(\d*)(?:\.\d+)?(hh|h|ll|l|z)?([diuxXcsp%])')
+
+
+def unescape(s):
+    """还原 C 字符串字面量中的转义字符"""
+    return (s.replace('\\"', '"').replace('\\n', '\n').replace('\\r', '\r')
+             .replace('\\t', '\t').replace('\\\\', '\\'))
+
+
+def load_events(src_dir):
+    """扫描源码，建立 事件号 -> (等级, 位置, 格式字符串) 的映射"""
+    events = {}
+    for name in sorted(os.listdir(src_dir)):
+        if not name.endswith('.c'):
+            continue
+        with open(os.path.join(src_dir, name), encoding='utf-8') as f:
+            text = f.read()
+        m = RE_FILE_ID.search(text)
+        if m is None:
+            continue
+        file_id = int(m.group(1))
+        for call in RE_CALL.finditer(text):
+            first = text.count('\n', 0, call.start()) + 1
+            last = text.count('\n', 0, call.end()) + 1
+            fmt = ''.join(unescape(p) for p in re.findall(r'"((?:[^"\\]|\\.)*)"', call.group(2)))
+            info = (MACRO_LEVELS[call.group(1)], '%s:%d' % (name, first), fmt)
+            # 宏调用跨越多行时，不同编译器取的 __LINE__ 可能不同，每一行都登记
+            for line in range(first, last + 1):
+                events.setdefault((file_id << 11) | (line & 0x7FF), info)
+    return events
+
+
+def format_args(fmt, args):
+    """按 C 格式字符串格式化 32 位整数参数"""
+    it = iter(args)
+
+    def conv(m):
+        flags, width, _, spec = m.groups()
+        if spec == '%':
+            return '%'
+        v = next(it, 0)
+        if spec in 'di':
+            v = v - (1 << 32) if v & 0x80000000 else v
+            return ('%' + flags + width + 'd') % v
+        if spec == 'u':
+            return ('%' + flags + width + 'd') % v
+        if spec in 'xX':
+            return ('%' + flags + width + spec) % v
+        if spec == 'c':
+            return chr(v & 0xFF)
+        return '<0x%08x>' % v           # %s/%p 只记录了地址
+
+    return RE_SPEC.sub(conv, fmt)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser(description='decode binary SD trace records')
+    ap.add_argument('input', help='file holding struct sd_trace_entry records ("-" for stdin)')
+    ap.add_argument('--src', default=os.path.join(here, '..', 'src'), help='driver source directory')
+    ap.add_argument('--level', type=int, default=5, help='only show records up to this level (1..5)')
+    opts = ap.parse_args()
+
+    events = load_events(opts.src)
+    data = sys.stdin.buffer.read() if opts.input == '-' else open(opts.input, 'rb').read()
+
+    prev_seq = None
+    for off in range(0, len(data) - ENTRY.size + 1, ENTRY.size):
+        seq, ts, eid, level, argc, *args = ENTRY.unpack_from(data, off)
+        if prev_seq is not None and seq != prev_seq + 1:
+            print('-- %d records lost --' % (seq - prev_seq - 1))
+        prev_seq = seq
+        if level > opts.level:
+            continue
+
+        info = events.get(eid)
+        if info is None:
+            text = 'unknown event 0x%04x args=%s' % (eid, args[:argc])
+            where = '?'
+        else:
+            text = format_args(info[2], args[:argc])
+            where = info[1]
+        print('%10u.%06u %s %-18s %s' % (ts // 1000000, ts % 1000000, LEVELS.get(level, '?'), where, text))
+
+
+if __name__ == '__main__':
+    main()